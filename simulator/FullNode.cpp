@@ -8,8 +8,10 @@
 #include "revokeAndAck_m.h"
 #include "paymentRefused_m.h"
 #include "HTLC.h"
+#include "routing.h"
+#include "checkpoint.h"
 
-class FullNode : public cSimpleModule {
+class FullNode : public cSimpleModule, public MemoryAccountable, public ChannelSnapshotSource, public Checkpointable {
 
     protected:
         // Protected data structures
@@ -18,17 +20,30 @@ class FullNode : public cSimpleModule {
         std::map<std::string, std::string> _myPayments; //paymentHash to status (PENDING, COMPLETED, FAILED, or CANCELED)
         std::map<std::string, BaseMessage *> _myStoredMessages; // paymentHash to baseMsg (for finding reverse path)
         std::map<std::string, cModule*> _senderModules; // paymentHash to Module
+        cMessage *_channelStatsTimer = nullptr; // periodic channel capacity snapshots
+        std::map<std::string, simtime_t> _paymentStartTimes; // paymentHash to INVOICE arrival time (payments we send)
+        bool _recordLatencyQuantiles; // the per-node histograms below are only filled (and recorded) if set
+        double _invoiceDelay; // invoiceDelay, which both delivers invoices and tells the route oracle when payments start
+        LatencyHistogram _paymentLatency;
+        LatencyHistogram _commitBatchingDelay;
+        LatencyHistogram _linkDelay;
+        HandlerProfile _handlerProfile; // only filled when handler profiling is enabled
+        int _nodeId; // numeric id in the node name, as used in trace records
+        int _numScheduledSelfMessages = 0;
 
         // Omnetpp functions
+        virtual ~FullNode();
         virtual void initialize() override;
         virtual void handleMessage(cMessage *msg) override;
+        virtual void dispatchMessage(cMessage *msg);
+        virtual void scheduleAt(simtime_t t, cMessage *msg) override;
         virtual void refreshDisplay() const;
         virtual void finish() override;
 
         // Routing functions
-        virtual std::vector<std::string> getPath(std::map<std::string, std::string> parents, std::string target);
-        virtual std::string minDistanceNode (std::map<std::string, double> distances, std::map<std::string, bool> visited);
-        virtual std::vector<std::string> dijkstraWeightedShortestPath (std::string src, std::string target, std::map<std::string, std::vector<std::pair<std::string, std::vector<double> > > > graph);
+        virtual std::vector<std::string> dijkstraWeightedShortestPath (std::string src, std::string target, const std::map<std::string, std::vector<std::pair<std::string, std::vector<double> > > >& graph);
+        virtual std::vector<std::string> findRoute (std::string src, std::string target);
+        virtual void requestRoute (const std::string& src, const std::string& target, simtime_t time);
 
         // Message handlers
         virtual void initHandler (BaseMessage *baseMsg);
@@ -49,16 +64,37 @@ class FullNode : public cSimpleModule {
         virtual void commitUpdateFulfillHTLC (HTLC *htlc, std::string neighbor);
         virtual void commitUpdateFailHTLC (HTLC *htlc, std::string neighbor);
         virtual void commitHTLC(HTLC *htlc, std::string neighbor);
+        virtual std::vector<HTLC *> commitHTLCs(const std::vector<HTLC *>& HTLCs, std::string neighbor);
+        virtual void commitWithoutExchange(std::string neighbor);
+        virtual void acceptCommitment(const std::vector<HTLC *>& HTLCs, std::string neighbor);
 
         // Statistics
         // virtual void initStatistics();
         virtual void initPerModuleStatistics();
+        virtual void initChannelStatistics(std::string neighborName);
+        virtual void emitChannelCapacity(std::string neighborName);
+        virtual void recordChannelSnapshot();
+
+        // Presentation
+        virtual void decorateMessage(BaseMessage *msg, const char *name, const char *displayString = MESSAGE_DISPLAY_STRING);
+        virtual void recordPaymentLatency(std::string paymentHash);
+        virtual void accountMemory(MemoryUsage& usage) override;
+        virtual void snapshotChannels(ChannelSnapshot& snapshot) override;
+        virtual void traceHTLC(TraceEvent event, const std::string& neighbor, HTLC *htlc);
+        virtual void tracePayment(TraceEvent event, const std::string& neighbor, const std::string& paymentHash, double value);
+        virtual void tracePaymentMessage(BaseMessage *baseMsg);
+
+        // Checkpoints
+        virtual void writeCheckpoint(CheckpointWriter& writer) override;
+        virtual void readCheckpoint(CheckpointReader& reader) override;
+        virtual cMessage *getCheckpointTimer(const std::string& name) override;
 
         // Util functions
         virtual bool tryUpdatePaymentChannel (std::string nodeName, double value, bool increase);
         virtual bool hasCapacityToForward (std::string nodeName, double value);
         virtual bool tryCommitTxOrFail (std::string, bool);
         virtual Invoice* generateInvoice (std::string srcName, double value);
+        virtual void schedulePartitionedPayments ();
         virtual void setInFlight (HTLC *htlc, std::string nextHop);
         virtual bool isInFlight (HTLC *htlc, std::string nextHop);
         virtual std::vector <HTLC *> getSortedPendingHTLCs (std::vector<HTLC *> HTLCs, std::string neighbor);
@@ -69,8 +105,6 @@ class FullNode : public cSimpleModule {
         bool _isFirstSelfMessage;
         cTopology *_localTopology;
         int localCommitCounter;
-        typedef std::map<std::string, int> RoutingTable;  // neighborName to gateIndex
-        RoutingTable rtable;
         std::map<std::string, PaymentChannel> _paymentChannels; // neighborName to PaymentChannel
         std::map<std::string, int> _signals; // myName to signal
 
@@ -90,13 +124,19 @@ Define_Module(FullNode);
 /* OMNETPP FUNCTIONS                                                                                                   */
 /***********************************************************************************************************************/
 
+FullNode::~FullNode() {
+    if (_channelStatsTimer != nullptr && _channelStatsTimer->isScheduled())
+        numStatisticsTimers--;
+    cancelAndDelete(_channelStatsTimer);
+}
+
 void FullNode::initialize() {
 
     // Get name (id) and initialize local topology based on the global topology created by netBuilder
     _localTopology = globalTopology;
     this->localCommitCounter = 0;
     std::string myName = getName();
-    std::map<std::string, std::vector<std::tuple<std::string, double, simtime_t>>> localPendingPayments = pendingPayments;
+    _nodeId = atoi(myName.c_str() + strlen("node"));
 
     // Initialize payment channels
     for (auto& neighborToPCs : nameToPCs[myName]) {
@@ -113,43 +153,39 @@ void FullNode::initialize() {
         cGate* neighborGate = std::get<7>(pcTuple);
 
         PaymentChannel pc = PaymentChannel(capacity, fee, quality, maxAcceptedHTLCs, numHTLCs, HTLCMinimumMsat, channelReserveSatoshis, localGate, neighborGate);
+        pc.setDetailed(allChannelsDetailed || detailedChannels.count(std::make_pair(myName, neighborName)) > 0);
         _paymentChannels[neighborName] = pc;
 
         // Register per channel statistics
-            std::string signalName = myName +"-to-" + neighborName + ":capacity";
-            simsignal_t signal = registerSignal(signalName.c_str());
-            _signals[signalName] = signal;
-            emit(_signals[signalName], _paymentChannels[neighborName]._capacity);
-
-            std::string statisticName = myName +"-to-" + neighborName + ":capacity";
-            cProperty *statisticTemplate = getProperties()->get("statisticTemplate", "pcCapacities");
-            getEnvir()->addResultRecorders(this, signal, statisticName.c_str(), statisticTemplate);
+        initChannelStatistics(neighborName);
     }
 
     // Initialize per module statistics
     initPerModuleStatistics();
-
-    // Build routing table
-    cTopology::Node *thisNode = _localTopology->getNodeFor(this);
-    for (int i = 0; i < _localTopology->getNumNodes(); i++) {
-        if (_localTopology->getNode(i) == thisNode)
-            continue;  // skip ourselves
-
-        _localTopology->calculateWeightedSingleShortestPathsTo(_localTopology->getNode(i));
-
-        if (thisNode->getNumPaths() == 0)
-            continue;  // not connected
-
-        cGate *parentModuleGate = thisNode->getPath(0)->getLocalGate();
-        int gateIndex = parentModuleGate->getIndex();
-        std::string nodeName = _localTopology->getNode(i)->getModule()->getName();
-        rtable[nodeName] = gateIndex;
-        EV << "  towards " << nodeName << " gateIndex is " << gateIndex << endl;
+    _recordLatencyQuantiles = par("recordLatencyQuantiles").boolValue();
+    _invoiceDelay = par("invoiceDelay").doubleValue();
+    if (channelStatsMode == CHANNEL_STATS_PERIODIC)
+        recordChannelSnapshot();
+    else {
+        for (auto& neighborToPC : _paymentChannels)
+            emitChannelCapacity(neighborToPC.first);
+    }
+    if (channelStatsMode == CHANNEL_STATS_PERIODIC && !_paymentChannels.empty()) {
+        _channelStatsTimer = new cMessage("channelStatsTimer");
+        if (!restoringCheckpoint) {
+            scheduleAt(simTime() + channelStatsInterval, _channelStatsTimer);
+            numStatisticsTimers++;
+        }
     }
 
-    // Schedule payments according to workload
+    // Schedule payments according to workload (in parallel runs, payee and payer may be in different partitions). When
+    // restoring a checkpoint, the payments that had not started yet come back with the rest of its future events.
     std::map<std::string, std::vector<std::tuple<std::string, double, simtime_t>>>::iterator it = pendingPayments.find(myName);
-    if (it != pendingPayments.end()) {
+    if (restoringCheckpoint) {
+        return;
+    } else if (numPartitions > 1) {
+        schedulePartitionedPayments();
+    } else if (it != pendingPayments.end()) {
         std::vector<std::tuple<std::string, double, simtime_t>> myWorkload = it->second;
 
         for (const auto& paymentTuple: myWorkload) {
@@ -175,6 +211,7 @@ void FullNode::initialize() {
              // Encapsulate and schedule
              baseMsg->encapsulate(trMsg);
              scheduleAt(simTime()+time, baseMsg);
+             requestRoute(srcName, myName, time);
              _isFirstSelfMessage = true;
         }
     } else {
@@ -183,10 +220,61 @@ void FullNode::initialize() {
 }
 
 void FullNode::handleMessage(cMessage *msg) {
+    // Dispatches the message, measuring the handler if profiling is enabled
+
+    if (msg->isSelfMessage())
+        _numScheduledSelfMessages--;
+
+    if (!handlerProfiler.isEnabled()) {
+        dispatchMessage(msg);
+        return;
+    }
+
+    // The handler may delete the message, so classify it first
+    ProfiledHandler handler = PROFILE_OTHER;
+    if (msg != _channelStatsTimer)
+        handler = getProfiledHandler(check_and_cast<BaseMessage *>(msg)->getMessageType());
+
+    HandlerTimer timer;
+    dispatchMessage(msg);
+    timer.stop(_handlerProfile[handler], handlerProfiler.getNetworkProfile()[handler]);
+    handlerProfiler.dump(simTime().dbl());
+}
+
+void FullNode::scheduleAt(simtime_t t, cMessage *msg) {
+    // Every self message goes through here, so the memory report can count the outstanding ones
+    _numScheduledSelfMessages++;
+    cSimpleModule::scheduleAt(t, msg);
+}
+
+void FullNode::dispatchMessage(cMessage *msg) {
     // Decapsulates and treats messages according to their message types
 
+    if (msg == _channelStatsTimer) {
+        // Snapshots go on as long as there are events other than the snapshot timers themselves, so periodic mode
+        // does not keep an otherwise finished simulation running
+        numStatisticsTimers--;
+        recordChannelSnapshot();
+        if (getSimulation()->getFES()->getLength() > numStatisticsTimers) {
+            scheduleAt(simTime() + channelStatsInterval, _channelStatsTimer);
+            numStatisticsTimers++;
+        }
+        return;
+    }
+
     BaseMessage *baseMsg = check_and_cast<BaseMessage *>(msg);
 
+    if (paymentTracer.isEnabled())
+        tracePaymentMessage(baseMsg);
+
+    // Hop-level link delay (self messages are commitment timeouts and payment starts, invoices travel out of band)
+    if (!msg->isSelfMessage() && baseMsg->getMessageType() != INVOICE && !inWarmup()) {
+        double linkDelay = (msg->getArrivalTime() - msg->getSendingTime()).dbl();
+        if (_recordLatencyQuantiles)
+            _linkDelay.record(linkDelay);
+        networkLinkDelay.record(linkDelay);
+    }
+
     switch(baseMsg->getMessageType()) {
 
         case TRANSACTION_INIT: {
@@ -225,6 +313,10 @@ void FullNode::handleMessage(cMessage *msg) {
 }
 
 void FullNode::refreshDisplay() const {
+    // Only graphical environments call this; headless mode skips it there too
+
+    if (headless)
+        return;
 
     for(auto& it : _paymentChannels) {
         char buf[30];
@@ -259,6 +351,14 @@ void FullNode::finish() {
 
     int countTotal = countCompleted + countFailed + countCanceled;
 
+    if (_recordLatencyQuantiles) {
+        recordLatencyScalars(this, "paymentLatency", _paymentLatency);
+        recordLatencyScalars(this, "commitBatchingDelay", _commitBatchingDelay);
+        recordLatencyScalars(this, "linkDelay", _linkDelay);
+    }
+    if (handlerProfiler.isEnabled())
+        recordHandlerScalars(this, _handlerProfile);
+
     if (countTotal != 0 ) {
         EV << "------------------ Statistics for node " + myName + "------------------\n";
         double goodput = (double(countCompleted)/double(countFailed+countCompleted));
@@ -272,97 +372,44 @@ void FullNode::finish() {
 /* ROUTING FUNCTIONS                                                                                                   */
 /***********************************************************************************************************************/
 
-std::string FullNode::minDistanceNode (std::map<std::string, double> distances, std::map<std::string, bool> visited) {
-    // Selects the node with minimum distance out of a distances list while disregarding visited nodes
+std::vector<std::string> FullNode::dijkstraWeightedShortestPath (std::string src, std::string target, const std::map<std::string, std::vector<std::pair<std::string, std::vector<double> > > >& graph) {
+    // This function returns the Dijkstra's shortest path from a source to some target given an adjacency matrix
+    return ::dijkstraWeightedShortestPath(src, target, graph);
+}
 
-    // Initialize min value
-    double minDist = INT_MAX;
-    std::string minName = "";
+std::vector<std::string> FullNode::findRoute (std::string src, std::string target) {
+    // Finds the route between two nodes. Workload routes precomputed by the NetBuilder are looked up in the topology
+    // cache; anything else is computed on demand with the same algorithm.
 
-    for (auto& node : distances) {
-        std::string nodeName = node.first;
-        double dist = node.second;
-        bool isNodeVisited = visited.find(nodeName)->second;
-        if (!isNodeVisited && dist <= minDist) {
-            minDist = dist;
-            minName = nodeName;
-        }
-    }
-    if (minDist == INT_MAX){
-        return NULL;
+    std::vector<int> cachedRoute;
+    if (topologyCache.getRoute(atoi(src.c_str() + strlen("node")), atoi(target.c_str() + strlen("node")), cachedRoute)) {
+        std::vector<std::string> path;
+        for (int nodeId : cachedRoute)
+            path.push_back("node" + std::to_string(nodeId));
+        return path;
     }
-    else{
-        return minName;
-    }
-
-}
-
-std::vector<std::string> FullNode::getPath (std::map<std::string, std::string> parents, std::string target) {
-    // Return the path to source given a target and its parent nodes
 
+    // Routes are taken when their invoice arrives, so one still there an invoice delay later was never going to be
     std::vector<std::string> path;
-    std::string node = target;
+    routeOracle.expire(simTime().dbl() - _invoiceDelay);
+    if (routeOracle.take(src, target, path))
+        return path;
 
-    // Recursively traverse the parents path
-    while (parents[node] != node) {
-        path.insert(path.begin(), node);
-        node = parents[node];
-    }
+    // On a cache hit the NetBuilder leaves the routing graph empty until a route outside the workload is needed
+    if (adjMatrix.empty() && topologyCache.isValid())
+        addRoutingEdges(topologyCache.getEdges(), leafParents, adjMatrix);
 
-    // Set ourselves as the source node
-    path.insert(path.begin(), getName());
-
-    return path;
+    return computeRoute(src, target, adjMatrix, leafParents);
 }
 
-std::vector<std::string> FullNode::dijkstraWeightedShortestPath (std::string src, std::string target, std::map<std::string, std::vector<std::pair<std::string, std::vector<double> > > > graph) {
-    // This function returns the Dijkstra's shortest path from a source to some target given an adjacency matrix
-
-    int numNodes = graph.size();
-    std::map<std::string, double> distances;
-    std::map<std::string, bool> visited;
-    std::map<std::string, std::string> parents; // a.k.a nodeToParent
+void FullNode::requestRoute (const std::string& src, const std::string& target, simtime_t time) {
+    // Hands the route of a payment starting at time to the route oracle, unless it is in the topology cache
 
-    // Initialize distances as infinite and visited array as false
-    for (auto & node : graph) {
-        distances[node.first] = INT_MAX;
-        visited[node.first] = false;
-        parents[node.first] = "";
-    }
-
-    // Set source node distance to zero and parent to itself
-    distances[src] = 0;
-    parents[src] = src;
-
-    for (int i = 0; i < numNodes-1; i++) {
-        std::string node = minDistanceNode(distances, visited);
-        visited[node] = true;
-
-        std::vector<std::pair<std::string,std::vector<double>>>::iterator it;
-
-        // Update distance value of neighbor nodes of the current node
-        for (it = graph[node].begin(); it != graph[node].end(); it++){
-            std::string neighbor = it->first;
-            std::vector<double> weightVector = it->second;
-            double capacity = weightVector[0];
-            double fee = weightVector[1];
-            double linkQuality = weightVector[2];
-
-            // Define weight as a combination of parameters in the weightVector
-            double linkWeight = 1/capacity;
-
-            if (!visited[neighbor]) {
-                if(distances[node] + linkWeight < distances[neighbor]) {
-                    parents[neighbor] = node;
-                    distances[neighbor] = distances[node] + linkWeight;
-                }
-            }
-        }
-    }
-    return getPath(parents, target);
+    std::vector<int> cachedRoute;
+    if (routeOracle.isEnabled() && !topologyCache.getRoute(atoi(src.c_str() + strlen("node")), atoi(target.c_str() + strlen("node")), cachedRoute))
+        routeOracle.request(src, target, time.dbl() + _invoiceDelay);
 }
 
-
 /***********************************************************************************************************************/
 /* MESSAGE HANDLERS                                                                                                    */
 /***********************************************************************************************************************/
@@ -372,26 +419,17 @@ void FullNode::initHandler (BaseMessage *baseMsg) {
     Payment *initMsg = check_and_cast<Payment *> (baseMsg->decapsulate());
     EV << "TRANSACTION_INIT received. Starting payment "<< initMsg->getName() << "\n";
 
-    // Create ephemeral communication channel with the payment source
     std::string srcName = initMsg->getSource();
     std::string srcPath = "PCN." + srcName;
     double value = initMsg->getValue();
     cModule* srcMod = getModuleByPath(srcPath.c_str());
-    cGate* myGate = this->getOrCreateFirstUnconnectedGate("out", 0, false, true);
-    cGate* srcGate = srcMod->getOrCreateFirstUnconnectedGate("in", 0, false, true);
-    cDelayChannel *tmpChannel = cDelayChannel::create("tmpChannel");
-    tmpChannel->setDelay(100);
-    myGate->connectTo(srcGate, tmpChannel);
 
-    // Create invoice and send it to the payment source
+    // Create invoice and send it to the payment source out of band, so gate vectors keep the size of the topology
     Invoice *invMsg = generateInvoice(srcName, value);
     baseMsg->setMessageType(INVOICE);
     baseMsg->encapsulate(invMsg);
-    baseMsg->setName("INVOICE");
-    send(baseMsg, myGate);
-
-    // Close ephemeral connection
-    myGate->disconnect();
+    decorateMessage(baseMsg, "INVOICE");
+    sendDirect(baseMsg, _invoiceDelay, 0, srcMod, "directIn");
 }
 
 void FullNode::invoiceHandler (BaseMessage *baseMsg) {
@@ -407,32 +445,41 @@ void FullNode::invoiceHandler (BaseMessage *baseMsg) {
     double value = invMsg->getValue();
 
     // Find route to destination
-    std::vector<std::string> path = this->dijkstraWeightedShortestPath(myName, dstName, adjMatrix);
-    std::string firstHop = path[1];
+    std::vector<std::string> path = this->findRoute(myName, dstName);
+    std::string firstHop = path.size() > 1 ? path[1] : "";
 
-    // If payment is larger than our capacity in the outbound payment channel, mark is as canceled and return
-   if (!hasCapacityToForward(firstHop, value)) {
+    // If there is no route or the payment is larger than our capacity in the outbound payment channel, mark is as canceled and return
+   if (firstHop.empty() || !hasCapacityToForward(firstHop, value)) {
        _myPayments[paymentHash] = "CANCELED";
-       EV << "WARNING: Canceling payment " + paymentHash + " on node " + myName + " due to insufficient funds in the first hop.\n";
+       tracePayment(TRACE_CANCELED, firstHop, paymentHash, value);
+       if (firstHop.empty())
+           EV_WARN << "WARNING: Canceling payment " + paymentHash + " on node " + myName + " because there is no route to " + dstName + ".\n";
+       else
+           EV_WARN << "WARNING: Canceling payment " + paymentHash + " on node " + myName + " due to insufficient funds in the first hop.\n";
 
-       _countCanceled++;
-       _paymentGoodputAll = double(_countCompleted)/double(_countCompleted + _countFailed + _countCanceled);
+       if (!inWarmup()) {
+           _countCanceled++;
+           _paymentGoodputAll = double(_countCompleted)/double(_countCompleted + _countFailed + _countCanceled);
 
-       emit(_signals["canceledPayments"], _countCanceled);
-       emit(_signals["paymentGoodputAll"], _paymentGoodputAll);
+           emit(_signals["canceledPayments"], _countCanceled);
+           emit(_signals["paymentGoodputAll"], _paymentGoodputAll);
+       }
 
        return;
    }
 
    // Add payment into payment list and set status = pending
    _myPayments[paymentHash] = "PENDING";
+   _paymentStartTimes[paymentHash] = simTime();
 
    // Print route
-    std::string printPath = "Full route to destination: ";
-    for (auto hop: path)
-        printPath = printPath + hop + ", ";
-    printPath += "\n";
-    EV << printPath;
+    if (LOG_ENABLED(LOGLEVEL_DEBUG)) {
+        std::string printPath = "Full route to destination: ";
+        for (auto hop: path)
+            printPath = printPath + hop + ", ";
+        printPath += "\n";
+        EV_DEBUG << printPath;
+    }
 
     //Create HTLC
     EV << "Creating HTLC to kick off the payment process \n";
@@ -441,8 +488,7 @@ void FullNode::invoiceHandler (BaseMessage *baseMsg) {
     newMessage->setMessageType(UPDATE_ADD_HTLC);
     newMessage->setHopCount(1);
     newMessage->setHops(path);
-    newMessage->setName("UPDATE_ADD_HTLC");
-    newMessage->setDisplayString("i=block/encrypt;is=s");
+    decorateMessage(newMessage, "UPDATE_ADD_HTLC", "i=block/encrypt;is=s");
 
     UpdateAddHTLC *firstUpdateAddHTLC = new UpdateAddHTLC();
     firstUpdateAddHTLC->setHtlcId(htlcId.c_str());
@@ -453,6 +499,7 @@ void FullNode::invoiceHandler (BaseMessage *baseMsg) {
     HTLC *firstHTLC = new HTLC(firstUpdateAddHTLC);
     _paymentChannels[firstHop].setPendingHTLC(htlcId, firstHTLC);
     _paymentChannels[firstHop].setLastPendingHTLCFIFO(firstHTLC);
+    traceHTLC(TRACE_PENDING, firstHop, firstHTLC);
     _paymentChannels[firstHop].setPreviousHopUp(htlcId, myName);
 
     newMessage->encapsulate(firstUpdateAddHTLC);
@@ -497,6 +544,7 @@ void FullNode::updateAddHTLCHandler (BaseMessage *baseMsg) {
         EV << "Payment hash:" + paymentHash + ".\n";
         _paymentChannels[sender].setPendingHTLC(htlcId, htlcBackward);
         _paymentChannels[sender].setLastPendingHTLCFIFO(htlcBackward);
+        traceHTLC(TRACE_PENDING, sender, htlcBackward);
         _paymentChannels[sender].setPreviousHopUp(htlcId, sender);
 
         // If I'm the destination, trigger commit immediately and return
@@ -525,14 +573,14 @@ void FullNode::updateAddHTLCHandler (BaseMessage *baseMsg) {
             _paymentChannels[sender].removePendingHTLC(htlcId);
             _paymentChannels[sender].removeLastPendingHTLCFIFO();
             _paymentChannels[sender].removePreviousHopUp(htlcId);
+            tracePayment(TRACE_REFUSED, nextHop, paymentHash, value);
 
             BaseMessage *newMessage = new BaseMessage();
             newMessage->setDestination(previousHop.c_str());
             newMessage->setMessageType(PAYMENT_REFUSED);
             newMessage->setHopCount(baseMsg->getHopCount()-1);
             newMessage->setHops(path);
-            newMessage->setName("PAYMENT_REFUSED");
-            newMessage->setDisplayString("i=status/stop");
+            decorateMessage(newMessage, "PAYMENT_REFUSED", "i=status/stop");
 
             PaymentRefused *paymentRefusedMsg = new PaymentRefused();
             paymentRefusedMsg->setPaymentHash(paymentHash.c_str());
@@ -553,8 +601,7 @@ void FullNode::updateAddHTLCHandler (BaseMessage *baseMsg) {
             newMessage->setMessageType(UPDATE_ADD_HTLC);
             newMessage->setHopCount(baseMsg->getHopCount() + 1);
             newMessage->setHops(path);
-            newMessage->setDisplayString("i=block/encrypt;is=s");
-            newMessage->setName("UPDATE_ADD_HTLC");
+            decorateMessage(newMessage, "UPDATE_ADD_HTLC", "i=block/encrypt;is=s");
 
             UpdateAddHTLC *newUpdateAddHTLC = new UpdateAddHTLC();
             newUpdateAddHTLC->setHtlcId(htlcId.c_str());
@@ -567,6 +614,7 @@ void FullNode::updateAddHTLCHandler (BaseMessage *baseMsg) {
             // Add HTLC as pending in the forward direction and set previous hop as ourselves
             _paymentChannels[nextHop].setPendingHTLC(htlcId, htlcForward);
             _paymentChannels[nextHop].setLastPendingHTLCFIFO(htlcForward);
+            traceHTLC(TRACE_PENDING, nextHop, htlcForward);
             _paymentChannels[nextHop].setPreviousHopUp(htlcId, myName);
 
             newMessage->encapsulate(newUpdateAddHTLC);
@@ -624,6 +672,7 @@ void FullNode::updateFulfillHTLCHandler (BaseMessage *baseMsg) {
          EV << "Payment hash:" + paymentHash + ".\n";
          _paymentChannels[sender].setPendingHTLC(htlcId, htlcBackward);
          _paymentChannels[sender].setLastPendingHTLCFIFO(htlcBackward);
+         traceHTLC(TRACE_PENDING, sender, htlcBackward);
          _paymentChannels[sender].setPreviousHopDown(htlcId, sender);
 
          // If we are the destination, just try to commit the payment and return
@@ -646,8 +695,7 @@ void FullNode::updateFulfillHTLCHandler (BaseMessage *baseMsg) {
         newMessage->setMessageType(UPDATE_FULFILL_HTLC);
         newMessage->setHopCount(baseMsg->getHopCount()-1);
         newMessage->setHops(path);
-        newMessage->setDisplayString("i=block/decrypt;is=s");
-        newMessage->setName("UPDATE_FULFILL_HTLC");
+        decorateMessage(newMessage, "UPDATE_FULFILL_HTLC", "i=block/decrypt;is=s");
 
         UpdateFulfillHTLC *forwardFulfillHTLC = new UpdateFulfillHTLC();
         forwardFulfillHTLC->setHtlcId(htlcId.c_str());
@@ -659,6 +707,7 @@ void FullNode::updateFulfillHTLCHandler (BaseMessage *baseMsg) {
         HTLC *forwardBaseHTLC  = new HTLC(forwardFulfillHTLC);
         _paymentChannels[nextHop].setPendingHTLC(htlcId, forwardBaseHTLC);
         _paymentChannels[nextHop].setLastPendingHTLCFIFO(forwardBaseHTLC);
+        traceHTLC(TRACE_PENDING, nextHop, forwardBaseHTLC);
         _paymentChannels[nextHop].setPreviousHopDown(htlcId, myName);
 
         newMessage->encapsulate(forwardFulfillHTLC);
@@ -710,6 +759,7 @@ void FullNode::updateFailHTLCHandler (BaseMessage *baseMsg) {
         EV << "Payment hash:" + paymentHash + ".\n";
         _paymentChannels[sender].setPendingHTLC(htlcId, htlcBackward);
         _paymentChannels[sender].setLastPendingHTLCFIFO(htlcBackward);
+        traceHTLC(TRACE_PENDING, sender, htlcBackward);
         _paymentChannels[sender].setPreviousHopDown(htlcId, sender);
 
         // If we are the destination, just try to commit and return
@@ -732,8 +782,7 @@ void FullNode::updateFailHTLCHandler (BaseMessage *baseMsg) {
         newMessage->setMessageType(UPDATE_FAIL_HTLC);
         newMessage->setHopCount(baseMsg->getHopCount()-1);
         newMessage->setHops(path);
-        newMessage->setDisplayString("i=status/stop");
-        newMessage->setName("UPDATE_FAIL_HTLC");
+        decorateMessage(newMessage, "UPDATE_FAIL_HTLC", "i=status/stop");
 
         UpdateFailHTLC *forwardFailHTLC = new UpdateFailHTLC();
         forwardFailHTLC->setHtlcId(htlcId.c_str());
@@ -745,6 +794,7 @@ void FullNode::updateFailHTLCHandler (BaseMessage *baseMsg) {
         HTLC *forwardBaseHTLC  = new HTLC(forwardFailHTLC);
         _paymentChannels[nextHop].setPendingHTLC(htlcId, forwardBaseHTLC);
         _paymentChannels[nextHop].setLastPendingHTLCFIFO(forwardBaseHTLC);
+        traceHTLC(TRACE_PENDING, nextHop, forwardBaseHTLC);
         //_paymentChannels[nextHop].removePreviousHopUp(htlcId);
         _paymentChannels[nextHop].setPreviousHopDown(htlcId, myName);
 
@@ -900,45 +950,8 @@ void FullNode::commitSignedHandler (BaseMessage *baseMsg) {
     commitmentSigned *commitMsg = check_and_cast<commitmentSigned *>(baseMsg->decapsulate());
 
     std::string sender = baseMsg->getSenderModule()->getName();
-    HTLC *htlc = NULL;
-    std::string myName = getName();
-    std::string paymentHash;
-    unsigned short index = 0;
-    std::vector<HTLC *> HTLCs = commitMsg->getHTLCs();
-    size_t numberHTLCs = HTLCs.size();
-    std::vector<HTLC *> sortedHTLCs = this->getSortedPendingHTLCs(HTLCs, sender);
-
-    // Iterate through the sorted HTLC list and attempt to commit them
-    for (const auto & htlc : sortedHTLCs) {
-
-        paymentHash = htlc->getPaymentHash();
-        double value = htlc->getValue();
-        int htlcType = htlc->getType();
-
-        // Skip HTLC if it has already been committed
-        if (_paymentChannels[sender].isCommittedHTLC(htlc)) {
-            EV << "WARNING: Skipped " + std::to_string(htlcType) + " with paymentHash " + paymentHash + " on node " + myName + ".\n";
-            continue;
-        }
-
-        switch(htlc->getType()) {
-            case UPDATE_ADD_HTLC: {
-                commitUpdateAddHTLC(htlc, sender);
-                break;
-            }
-            case UPDATE_FULFILL_HTLC: {
-                commitUpdateFulfillHTLC(htlc, sender);
-                break;
-            }
-            case UPDATE_FAIL_HTLC: {
-                commitUpdateFailHTLC(htlc, sender);
-                break;
-            }
-        }
-     }
-
-    std::string signalName = myName +"-to-" + sender + ":capacity";
-    emit(_signals[signalName], _paymentChannels[sender]._capacity);
+    std::vector<HTLC *> sortedHTLCs = commitHTLCs(commitMsg->getHTLCs(), sender);
+    emitChannelCapacity(sender);
 
     revokeAndAck *ack = new revokeAndAck();
     ack->setAckId(commitMsg->getId());
@@ -948,7 +961,7 @@ void FullNode::commitSignedHandler (BaseMessage *baseMsg) {
     newMessage->setDestination(sender.c_str());
     newMessage->setMessageType(REVOKE_AND_ACK);
     newMessage->setHopCount(0);
-    newMessage->setName("REVOKE_AND_ACK");
+    decorateMessage(newMessage, "REVOKE_AND_ACK");
     //newMessage->setUpstreamDirection(!baseMsg->getUpstreamDirection());
 
     newMessage->encapsulate(ack);
@@ -968,40 +981,7 @@ void FullNode::revokeAndAckHandler (BaseMessage *baseMsg) {
     std::string sender = baseMsg->getSenderModule()->getName();
     int ackId = ackMsg->getAckId();
 
-    std::vector<HTLC *> HTLCs = _paymentChannels[sender].getHTLCsWaitingForAck(ackId);
-    HTLC *htlc;
-    std::string myName = getName();
-    std::string paymentHash;
-    size_t index = 0;
-    std::vector<HTLC *> sortedHTLCs = this->getSortedPendingHTLCs(HTLCs, sender);
-
-    // Iterate through the sorted HTLC list and attempt to commit them
-    for (const auto & htlc : sortedHTLCs) {
-
-        paymentHash = htlc->getPaymentHash();
-        double value = htlc->getValue();
-        int htlcType = htlc->getType();
-
-        if (_paymentChannels[sender].isCommittedHTLC(htlc)) {
-            EV << "WARNING: Skipped " + std::to_string(htlcType) + " with paymentHash " + paymentHash + " on node " + myName + ".\n";
-            continue;
-        }
-
-        switch(htlc->getType()) {
-            case UPDATE_ADD_HTLC: {
-                commitUpdateAddHTLC(htlc, sender);
-                break;
-            }
-            case UPDATE_FULFILL_HTLC: {
-                commitUpdateFulfillHTLC(htlc, sender);
-                break;
-            }
-            case UPDATE_FAIL_HTLC: {
-                commitUpdateFailHTLC(htlc, sender);
-                break;
-            }
-        }
-    }
+    commitHTLCs(_paymentChannels[sender].getHTLCsWaitingForAck(ackId), sender);
     _paymentChannels[sender].removeHTLCsWaitingForAck(ackId);
     _paymentChannels[sender].setWaitingForAck(false);
 }
@@ -1033,8 +1013,7 @@ void FullNode::sendFirstFulfillHTLC (HTLC *htlc, std::string firstHop) {
     newMessage->setMessageType(UPDATE_FULFILL_HTLC);
     newMessage->setHopCount(storedBaseMsg->getHopCount() - 1);
     newMessage->setHops(storedBaseMsg->getHops());
-    newMessage->setName("UPDATE_FULFILL_HTLC");
-    newMessage->setDisplayString("i=block/decrypt;is=s");
+    decorateMessage(newMessage, "UPDATE_FULFILL_HTLC", "i=block/decrypt;is=s");
 
     UpdateFulfillHTLC *firstFulfillHTLC = new UpdateFulfillHTLC();
     firstFulfillHTLC->setHtlcId(htlcId.c_str());
@@ -1046,6 +1025,7 @@ void FullNode::sendFirstFulfillHTLC (HTLC *htlc, std::string firstHop) {
     HTLC *baseHTLC  = new HTLC(firstFulfillHTLC);
     _paymentChannels[firstHop].setPendingHTLC(htlcId, baseHTLC);
     _paymentChannels[firstHop].setLastPendingHTLCFIFO(baseHTLC);
+    traceHTLC(TRACE_PENDING, firstHop, baseHTLC);
     //_paymentChannels[firstHop].removePreviousHopUp(htlcId);
     _paymentChannels[firstHop].setPreviousHopDown(htlcId, myName);
 
@@ -1081,8 +1061,7 @@ void FullNode::sendFirstFailHTLC (HTLC *htlc, std::string firstHop) {
     newMessage->setMessageType(UPDATE_FAIL_HTLC);
     newMessage->setHopCount(storedBaseMsg->getHopCount()-1);
     newMessage->setHops(failPath);
-    newMessage->setName("UPDATE_FAIL_HTLC");
-    newMessage->setDisplayString("i=status/stop");
+    decorateMessage(newMessage, "UPDATE_FAIL_HTLC", "i=status/stop");
 
     UpdateFailHTLC *firstFailHTLC = new UpdateFailHTLC();
     firstFailHTLC->setHtlcId(htlcId.c_str());
@@ -1094,6 +1073,7 @@ void FullNode::sendFirstFailHTLC (HTLC *htlc, std::string firstHop) {
     HTLC *baseHTLC  = new HTLC(firstFailHTLC);
     _paymentChannels[firstHop].setPendingHTLC(htlcId, baseHTLC);
     _paymentChannels[firstHop].setLastPendingHTLCFIFO(baseHTLC);
+    traceHTLC(TRACE_PENDING, firstHop, baseHTLC);
     _paymentChannels[firstHop].setPreviousHopDown(htlcId, myName);
 
     newMessage->encapsulate(firstFailHTLC);
@@ -1167,17 +1147,22 @@ void FullNode::commitUpdateFulfillHTLC (HTLC *htlc, std::string neighbor) {
 
         // If we are the destination, the payment has completed successfully
         if(_myPayments[paymentHash] == "PENDING") {
-            bubble("Payment completed!");
+            if (!headless)
+                bubble("Payment completed!");
             EV << "Payment " + paymentHash + " completed!\n";
 
             _myPayments[paymentHash] = "COMPLETED";
-            _countCompleted++;
-            _paymentGoodputSent = double(_countCompleted)/double(_countCompleted + _countFailed);
-            _paymentGoodputAll = double(_countCompleted)/double(_countCompleted + _countFailed + _countCanceled);
-
-            emit(_signals["completedPayments"], _countCompleted);
-            emit(_signals["paymentGoodputSent"], _paymentGoodputSent);
-            emit(_signals["paymentGoodputAll"], _paymentGoodputAll);
+            recordPaymentLatency(paymentHash);
+            tracePayment(TRACE_FULFILLED, neighbor, paymentHash, value);
+            if (!inWarmup()) {
+                _countCompleted++;
+                _paymentGoodputSent = double(_countCompleted)/double(_countCompleted + _countFailed);
+                _paymentGoodputAll = double(_countCompleted)/double(_countCompleted + _countFailed + _countCanceled);
+
+                emit(_signals["completedPayments"], _countCompleted);
+                emit(_signals["paymentGoodputSent"], _paymentGoodputSent);
+                emit(_signals["paymentGoodputAll"], _paymentGoodputAll);
+            }
         }
 
         // If we are the fulfill's previous hop, we should claim our money
@@ -1212,17 +1197,22 @@ void FullNode::commitUpdateFailHTLC (HTLC *htlc, std::string neighbor) {
 
         // If we are the destination, the payment has failed
         if(_myPayments[paymentHash] == "PENDING") {
-            bubble("Payment failed!");
+            if (!headless)
+                bubble("Payment failed!");
             EV << "Payment " + paymentHash + " failed!\n";
             _myPayments[paymentHash] = "FAILED";
+            _paymentStartTimes.erase(paymentHash);
+            tracePayment(TRACE_FAILED, neighbor, paymentHash, value);
 
-            _countFailed++;
-            _paymentGoodputSent = double(_countCompleted)/double(_countCompleted + _countFailed);
-            _paymentGoodputAll = double(_countCompleted)/double(_countCompleted + _countFailed + _countCanceled);
+            if (!inWarmup()) {
+                _countFailed++;
+                _paymentGoodputSent = double(_countCompleted)/double(_countCompleted + _countFailed);
+                _paymentGoodputAll = double(_countCompleted)/double(_countCompleted + _countFailed + _countCanceled);
 
-            emit(_signals["failedPayments"], _countFailed);
-            emit(_signals["paymentGoodputSent"], _paymentGoodputSent);
-            emit(_signals["paymentGoodputAll"], _paymentGoodputAll);
+                emit(_signals["failedPayments"], _countFailed);
+                emit(_signals["paymentGoodputSent"], _paymentGoodputSent);
+                emit(_signals["paymentGoodputAll"], _paymentGoodputAll);
+            }
         }
 
     // If our neighbor is the fails's next hop, just remove from pending (the updates have been applied in the sender node)
@@ -1243,6 +1233,77 @@ void FullNode::commitHTLC (HTLC *htlc, std::string neighbor) {
     _paymentChannels[neighbor].removePendingHTLCFIFOByValue(htlc);
     _paymentChannels[neighbor].setCommittedHTLC(htlcId, htlc);
     _paymentChannels[neighbor].setLastCommittedHTLCFIFO(htlc);
+    traceHTLC(TRACE_COMMITTED, neighbor, htlc);
+}
+
+std::vector<HTLC *> FullNode::commitHTLCs (const std::vector<HTLC *>& HTLCs, std::string neighbor) {
+    // Commits the HTLCs of a commitment that are still pending on the channel to neighbor, in the local pending order,
+    // and returns them in that order
+
+    std::string myName = getName();
+    std::vector<HTLC *> sortedHTLCs = this->getSortedPendingHTLCs(HTLCs, neighbor);
+
+    // Iterate through the sorted HTLC list and attempt to commit them
+    for (const auto & htlc : sortedHTLCs) {
+
+        // Skip HTLC if it has already been committed
+        if (_paymentChannels[neighbor].isCommittedHTLC(htlc)) {
+            EV_WARN << "WARNING: Skipped " + std::to_string(htlc->getType()) + " with paymentHash " + htlc->getPaymentHash() + " on node " + myName + ".\n";
+            continue;
+        }
+
+        switch(htlc->getType()) {
+            case UPDATE_ADD_HTLC: {
+                commitUpdateAddHTLC(htlc, neighbor);
+                break;
+            }
+            case UPDATE_FULFILL_HTLC: {
+                commitUpdateFulfillHTLC(htlc, neighbor);
+                break;
+            }
+            case UPDATE_FAIL_HTLC: {
+                commitUpdateFailHTLC(htlc, neighbor);
+                break;
+            }
+        }
+    }
+    return sortedHTLCs;
+}
+
+void FullNode::commitWithoutExchange (std::string neighbor) {
+    // Commits the pending HTLCs of a channel outside NetBuilder.detailedChannels on both ends at once: the neighbor
+    // commits them as if it had received our COMMITMENT_SIGNED and we do as if its REVOKE_AND_ACK had arrived, so the
+    // capacity bookkeeping is the same as in the full exchange, without its messages and batching timeouts
+
+    std::string myName = getName();
+    std::deque<HTLC *> pendingHTLCs = _paymentChannels[neighbor].getPendingHTLCsFIFO();
+    std::vector<HTLC *> HTLCVector(pendingHTLCs.begin(), pendingHTLCs.end());
+
+    // Nothing waits for a batch, but the delay is still recorded so that the statistic covers every hop
+    for (const auto & htlc : HTLCVector) {
+        if (htlc->_pendingSince >= 0) {
+            double batchingDelay = (simTime() - htlc->_pendingSince).dbl();
+            if (!inWarmup()) {
+                if (_recordLatencyQuantiles)
+                    _commitBatchingDelay.record(batchingDelay);
+                networkCommitBatchingDelay.record(batchingDelay);
+            }
+            htlc->_pendingSince = -1;
+        }
+    }
+
+    FullNode *neighborNode = check_and_cast<FullNode *>(_paymentChannels[neighbor].getNeighborGate()->getOwnerModule());
+    neighborNode->acceptCommitment(HTLCVector, myName);
+    commitHTLCs(HTLCVector, neighbor);
+    emitChannelCapacity(neighbor);
+}
+
+void FullNode::acceptCommitment (const std::vector<HTLC *>& HTLCs, std::string neighbor) {
+    // Neighbor's side of commitWithoutExchange. It runs in the caller's event, as this module (so what it sends is its own).
+
+    Enter_Method_Silent();
+    commitHTLCs(HTLCs, neighbor);
+    emitChannelCapacity(neighbor);
 }
 
 
@@ -1282,6 +1343,281 @@ void FullNode::initPerModuleStatistics () {
 
     simsignal_t paymentGoodputAll = registerSignal("paymentGoodputAll");
     _signals["paymentGoodputAll"] = paymentGoodputAll;
+
+    simsignal_t channelCapacity = registerSignal("channelCapacity");
+    _signals["channelCapacity"] = channelCapacity;
+}
+
+void FullNode::initChannelStatistics(std::string neighborName) {
+    // Registers the capacity signal of a channel direction and attaches its recorders. Every direction gets one in
+    // full and periodic modes, only the sampled ones in sampled mode, and none in histogram mode.
+
+    std::string myName = getName();
+    if (channelStatsMode == CHANNEL_STATS_HISTOGRAM)
+        return;
+    if (channelStatsMode == CHANNEL_STATS_SAMPLED && sampledChannels.count(std::make_pair(myName, neighborName)) == 0)
+        return;
+
+    std::string signalName = myName +"-to-" + neighborName + ":capacity";
+    simsignal_t signal = registerSignal(signalName.c_str());
+    _signals[signalName] = signal;
+
+    std::string statisticName = myName +"-to-" + neighborName + ":capacity";
+    cProperty *statisticTemplate = getProperties()->get("statisticTemplate", "pcCapacities");
+    getEnvir()->addResultRecorders(this, signal, statisticName.c_str(), statisticTemplate);
+}
+
+void FullNode::emitChannelCapacity(std::string neighborName) {
+    // Records a capacity change of a channel direction according to the channel statistics mode
+
+    switch (channelStatsMode) {
+        case CHANNEL_STATS_HISTOGRAM: {
+            emit(_signals["channelCapacity"], _paymentChannels[neighborName]._capacity);
+            break;
+        }
+        case CHANNEL_STATS_PERIODIC: {
+            // Recorded by recordChannelSnapshot
+            break;
+        }
+        default: {
+            std::map<std::string, int>::iterator it = _signals.find(std::string(getName()) + "-to-" + neighborName + ":capacity");
+            if (it != _signals.end())
+                emit(it->second, _paymentChannels[neighborName]._capacity);
+            break;
+        }
+    }
+}
+
+void FullNode::recordPaymentLatency(std::string paymentHash) {
+    // Records the time from INVOICE to the settled fulfill of a payment we sent
+
+    std::map<std::string, simtime_t>::iterator it = _paymentStartTimes.find(paymentHash);
+    if (it == _paymentStartTimes.end())
+        return;
+
+    double latency = (simTime() - it->second).dbl();
+    _paymentStartTimes.erase(it);
+    if (inWarmup())
+        return;
+    if (_recordLatencyQuantiles)
+        _paymentLatency.record(latency);
+    networkPaymentLatency.record(latency);
+}
+
+void FullNode::snapshotChannels(ChannelSnapshot& snapshot) {
+    for (const auto& neighborToPC : _paymentChannels)
+        snapshot.add(_nodeId, atoi(neighborToPC.first.c_str() + strlen("node")), neighborToPC.second.getCapacity());
+}
+
+void FullNode::writeCheckpoint(CheckpointWriter& writer) {
+    // Writes everything this node accumulated since the start of the run. Payment channels are matched by neighbor name.
+
+    writeStringMap(writer, _myPreImages);
+    writeStringMap(writer, _myInFlights);
+    writeStringMap(writer, _myPayments);
+    writer.writeUInt(_myStoredMessages.size());
+    for (const auto& stored : _myStoredMessages) {
+        writer.writeString(stored.first);
+        writeMessage(writer, stored.second);
+    }
+    writer.writeUInt(_senderModules.size());
+    for (const auto& sender : _senderModules) {
+        writer.writeString(sender.first);
+        writer.writeInt(sender.second->getId());
+    }
+    writer.writeUInt(_paymentStartTimes.size());
+    for (const auto& start : _paymentStartTimes) {
+        writer.writeString(start.first);
+        writeSimTime(writer, start.second);
+    }
+    _paymentLatency.writeTo(writer);
+    _commitBatchingDelay.writeTo(writer);
+    _linkDelay.writeTo(writer);
+    writer.writeInt(_numScheduledSelfMessages);
+    writer.writeBool(_isFirstSelfMessage);
+    writer.writeInt(localCommitCounter);
+
+    writer.writeUInt(_paymentChannels.size());
+    for (const auto& neighborToPC : _paymentChannels) {
+        writer.writeString(neighborToPC.first);
+        writePaymentChannel(writer, neighborToPC.second);
+    }
+
+    writer.writeInt(_countCompleted);
+    writer.writeInt(_countFailed);
+    writer.writeInt(_countCanceled);
+    writer.writeDouble(_paymentGoodputSent);
+    writer.writeDouble(_paymentGoodputAll);
+}
+
+void FullNode::readCheckpoint(CheckpointReader& reader) {
+    // Messages and HTLCs created here belong to this node
+    Enter_Method_Silent();
+
+    readStringMap(reader, _myPreImages);
+    readStringMap(reader, _myInFlights);
+    readStringMap(reader, _myPayments);
+    _myStoredMessages.clear();
+    for (uint64_t n = reader.readUInt(); n > 0; n--) {
+        std::string paymentHash = reader.readString();
+        _myStoredMessages[paymentHash] = check_and_cast<BaseMessage *>(readMessage(reader));
+    }
+    _senderModules.clear();
+    for (uint64_t n = reader.readUInt(); n > 0; n--) {
+        std::string paymentHash = reader.readString();
+        _senderModules[paymentHash] = getSimulation()->getModule(reader.readInt());
+    }
+    _paymentStartTimes.clear();
+    for (uint64_t n = reader.readUInt(); n > 0; n--) {
+        std::string paymentHash = reader.readString();
+        _paymentStartTimes[paymentHash] = readSimTime(reader);
+    }
+    _paymentLatency.readFrom(reader);
+    _commitBatchingDelay.readFrom(reader);
+    _linkDelay.readFrom(reader);
+    _numScheduledSelfMessages = reader.readInt();
+    _isFirstSelfMessage = reader.readBool();
+    localCommitCounter = reader.readInt();
+
+    for (uint64_t n = reader.readUInt(); n > 0; n--) {
+        std::string neighborName = reader.readString();
+        std::map<std::string, PaymentChannel>::iterator it = _paymentChannels.find(neighborName);
+        if (it == _paymentChannels.end())
+            throw std::runtime_error("the checkpoint holds a channel from " + std::string(getName()) + " to " + neighborName + ", which the topology does not have");
+        readPaymentChannel(reader, it->second);
+        emitChannelCapacity(neighborName);
+    }
+
+    _countCompleted = reader.readInt();
+    _countFailed = reader.readInt();
+    _countCanceled = reader.readInt();
+    _paymentGoodputSent = reader.readDouble();
+    _paymentGoodputAll = reader.readDouble();
+}
+
+cMessage *FullNode::getCheckpointTimer(const std::string& name) {
+    return _channelStatsTimer != nullptr && name == _channelStatsTimer->getName() ? _channelStatsTimer : nullptr;
+}
+
+void FullNode::accountMemory(MemoryUsage& usage) {
+    // Adds the entries and estimated bytes of this node's containers to a memory report
+
+    for (const auto& neighborToPC : _paymentChannels)
+        accountPaymentChannel(neighborToPC.second, usage);
+
+    accountMap(usage[MEMORY_MY_PREIMAGES], _myPreImages);
+    accountMap(usage[MEMORY_MY_IN_FLIGHTS], _myInFlights);
+    accountMap(usage[MEMORY_MY_PAYMENTS], _myPayments);
+    accountMap(usage[MEMORY_MY_STORED_MESSAGES], _myStoredMessages);
+    for (const auto& stored : _myStoredMessages) {
+        // Stored messages still encapsulate their UPDATE_ADD_HTLC
+        BaseMessage *baseMsg = stored.second;
+        usage[MEMORY_MY_STORED_MESSAGES].bytes += sizeof(BaseMessage) + heapBytes(baseMsg->getHops());
+        if (baseMsg->getEncapsulatedPacket() != nullptr)
+            usage[MEMORY_MY_STORED_MESSAGES].bytes += sizeof(UpdateAddHTLC);
+    }
+    accountMap(usage[MEMORY_SENDER_MODULES], _senderModules);
+    accountMap(usage[MEMORY_PAYMENT_START_TIMES], _paymentStartTimes);
+    accountMap(usage[MEMORY_SIGNALS], _signals);
+
+    usage[MEMORY_SCHEDULED_SELF_MESSAGES].entries += _numScheduledSelfMessages;
+    usage[MEMORY_SCHEDULED_SELF_MESSAGES].bytes += _numScheduledSelfMessages * sizeof(BaseMessage);
+}
+
+void FullNode::traceHTLC(TraceEvent event, const std::string& neighbor, HTLC *htlc) {
+    // Writes an HTLC state transition on the channel to neighbor to the event trace
+    if (eventTrace.isEnabled())
+        eventTrace.record(simTime().dbl(), _nodeId, atoi(neighbor.c_str() + strlen("node")), htlc->getPaymentHash(), htlc->getType(), htlc->getValue(), event);
+    PAYMENT_LOG(htlc->getPaymentHash()) << htlc->getPaymentHash() << " " << getProfiledHandlerName(getProfiledHandler(htlc->getType()))
+            << " " << getTraceEventName(event) << " on channel to " << neighbor << ", value " << htlc->getValue() << "\n";
+}
+
+void FullNode::tracePayment(TraceEvent event, const std::string& neighbor, const std::string& paymentHash, double value) {
+    // Writes a payment-level event to the event trace (neighbor is the hop involved, if any)
+    if (eventTrace.isEnabled())
+        eventTrace.record(simTime().dbl(), _nodeId, neighbor.empty() ? -1 : atoi(neighbor.c_str() + strlen("node")), paymentHash, 0, value, event);
+    PAYMENT_LOG(paymentHash) << paymentHash << " payment " << getTraceEventName(event)
+            << (neighbor.empty() ? "" : " at hop " + neighbor) << ", value " << value << "\n";
+}
+
+void FullNode::tracePaymentMessage(BaseMessage *baseMsg) {
+    // Logs the arrival of a message that belongs to a traced payment (commitments and acks are logged per traced HTLC)
+
+    std::string from = baseMsg->isSelfMessage() ? "self" : baseMsg->getSenderModule()->getName();
+    const char *type = getProfiledHandlerName(getProfiledHandler(baseMsg->getMessageType()));
+    cPacket *packet = baseMsg->getEncapsulatedPacket();
+    std::string paymentHash;
+
+    switch (baseMsg->getMessageType()) {
+        case INVOICE: {
+            if (Invoice *invoice = dynamic_cast<Invoice *>(packet))
+                paymentHash = invoice->getPaymentHash();
+            break;
+        }
+        case UPDATE_ADD_HTLC: {
+            if (UpdateAddHTLC *updateAddHTLC = dynamic_cast<UpdateAddHTLC *>(packet))
+                paymentHash = updateAddHTLC->getPaymentHash();
+            break;
+        }
+        case UPDATE_FULFILL_HTLC: {
+            if (UpdateFulfillHTLC *updateFulfillHTLC = dynamic_cast<UpdateFulfillHTLC *>(packet))
+                paymentHash = updateFulfillHTLC->getPaymentHash();
+            break;
+        }
+        case UPDATE_FAIL_HTLC: {
+            if (UpdateFailHTLC *updateFailHTLC = dynamic_cast<UpdateFailHTLC *>(packet))
+                paymentHash = updateFailHTLC->getPaymentHash();
+            break;
+        }
+        case PAYMENT_REFUSED: {
+            if (PaymentRefused *paymentRefused = dynamic_cast<PaymentRefused *>(packet))
+                paymentHash = paymentRefused->getPaymentHash();
+            break;
+        }
+        case COMMITMENT_SIGNED:
+        case REVOKE_AND_ACK: {
+            std::vector<HTLC *> HTLCs;
+            if (commitmentSigned *commitMsg = dynamic_cast<commitmentSigned *>(packet))
+                HTLCs = commitMsg->getHTLCs();
+            else if (revokeAndAck *ackMsg = dynamic_cast<revokeAndAck *>(packet))
+                HTLCs = ackMsg->getHTLCs();
+            for (const auto & htlc : HTLCs) {
+                PAYMENT_LOG(htlc->getPaymentHash()) << htlc->getPaymentHash() << " " << type << " from " << from << " carrying "
+                        << getProfiledHandlerName(getProfiledHandler(htlc->getType())) << "\n";
+            }
+            return;
+        }
+        default:
+            return;
+    }
+
+    // Self messages that were already decapsulated (commitment timeouts) carry no payment hash
+    if (!paymentHash.empty()) {
+        PAYMENT_LOG(paymentHash) << paymentHash << " " << type << " from " << from << "\n";
+    }
+}
+
+void FullNode::recordChannelSnapshot() {
+    // Emits the capacity of every channel direction of this node (periodic mode)
+
+    std::string myName = getName();
+    for (auto& neighborToPC : _paymentChannels)
+        emit(_signals[myName + "-to-" + neighborToPC.first + ":capacity"], neighborToPC.second._capacity);
+}
+
+
+/***********************************************************************************************************************/
+/* PRESENTATION                                                                                                        */
+/***********************************************************************************************************************/
+
+void FullNode::decorateMessage(BaseMessage *msg, const char *name, const char *displayString) {
+    // Names a message and sets its icon for graphical environments. Neither is ever shown in batch runs, so headless
+    // mode leaves messages unnamed and undecorated.
+
+    if (headless)
+        return;
+    msg->setName(name);
+    msg->setDisplayString(displayString);
 }
 
 
@@ -1309,38 +1645,7 @@ bool FullNode::tryUpdatePaymentChannel (std::string nodeName, double value, bool
 
 bool FullNode::hasCapacityToForward  (std::string nodeName, double value) {
     // Helper function that calculates the payment channel capacity after applying the pending HTLCs and checks if the node has sufficient funds to forward a payment.
-
-    std::deque< HTLC*> pendingHTLCsFIFO = _paymentChannels[nodeName].getPendingHTLCsFIFO();
-    std::string myName = getName();
-
-    // Calculate the capacity after applying pending HTLCs
-    double capacity = _paymentChannels[nodeName].getCapacity();
-    for (const auto & htlc : pendingHTLCsFIFO) {
-        std::string htlcId  = htlc->getHtlcId();
-        int htlcType = htlc->getType();
-
-        // If it's an add update, subtract value from capacity if we are the previous hop uptstream
-        // (because we'll have less money when we commmit it)
-        if (htlcType == UPDATE_ADD_HTLC) {
-            if (_paymentChannels[nodeName].getPreviousHopUp(htlcId) == myName) {
-                capacity -= htlc->getValue();
-                if (capacity <= 0)
-                    return false;
-            }
-        } else if (htlcType == UPDATE_FAIL_HTLC) {
-            // If it's a fail update, add value to capacity if we are not the previous hop downstream
-            // (because we'll recover money when we commmit it)
-            if (_paymentChannels[nodeName].getPreviousHopDown(htlcId) == nodeName) {
-                capacity += htlc->getValue();
-            }
-        } else {}; // If it's a fulfill update, do nothing (fulfills don't change the capacity in the upstream direction)
-    }
-
-    // Check if the capacity would become negative after forwarding the next payment
-    if ((capacity - value) <= 0)
-        return false;
-    else
-        return true;
+    return _paymentChannels[nodeName].hasCapacityToForward(getName(), nodeName, value);
 }
 
 bool FullNode::tryCommitTxOrFail(std::string sender, bool timeoutFlag) {
@@ -1361,9 +1666,27 @@ bool FullNode::tryCommitTxOrFail(std::string sender, bool timeoutFlag) {
 
     EV << "Entered tryCommitTxOrFail. Current batch size: " + std::to_string(_paymentChannels[sender].getPendingBatchSize()) + "\n";
 
+    // Channels outside the detailed selection commit right away, so there is never a batch to wait for
+    if (!_paymentChannels[sender].isDetailed()) {
+        commitWithoutExchange(sender);
+        return true;
+    }
+
     if (_paymentChannels[sender].getPendingBatchSize() >= COMMITMENT_BATCH_SIZE || timeoutFlag == true) {
         for (const auto & htlc : _paymentChannels[sender].getPendingHTLCsFIFO()) {
             HTLCVector.push_back(htlc);
+            traceHTLC(TRACE_WAITING_FOR_ACK, sender, htlc);
+
+            // Hop-level commit batching delay, counted the first time the HTLC goes out in a commitment
+            if (htlc->_pendingSince >= 0) {
+                double batchingDelay = (simTime() - htlc->_pendingSince).dbl();
+                if (!inWarmup()) {
+                    if (_recordLatencyQuantiles)
+                        _commitBatchingDelay.record(batchingDelay);
+                    networkCommitBatchingDelay.record(batchingDelay);
+                }
+                htlc->_pendingSince = -1;
+            }
         }
 
         EV << "Setting through to true\n";
@@ -1384,7 +1707,7 @@ bool FullNode::tryCommitTxOrFail(std::string sender, bool timeoutFlag) {
         baseMsg->setDestination(sender.c_str());
         baseMsg->setMessageType(COMMITMENT_SIGNED);
         baseMsg->setHopCount(0);
-        baseMsg->setName("COMMITMENT_SIGNED");
+        decorateMessage(baseMsg, "COMMITMENT_SIGNED");
 
         baseMsg->encapsulate(commitTx);
 
@@ -1399,7 +1722,11 @@ Invoice* FullNode::generateInvoice(std::string srcName, double value) {
 
     std::string preImage;
     std::string preImageHash;
-    preImage = generatePreImage();
+    // Drawn from the module's RNG, so payment hashes (and payment tracing by hash) are reproducible across runs. The
+    // two draws are sequenced explicitly: as operands of | their order would be up to the compiler.
+    uint64_t high = getRNG(0)->intRand();
+    uint64_t low = getRNG(0)->intRand();
+    preImage = generatePreImage((high << 32) | low);
     preImageHash = sha256(preImage);
 
     EV<< "Generated pre image " + preImage + " with hash " + preImageHash + "\n";
@@ -1415,6 +1742,47 @@ Invoice* FullNode::generateInvoice(std::string srcName, double value) {
     return invoice;
 }
 
+void FullNode::schedulePartitionedPayments() {
+    // The direct invoice of initHandler cannot reach a payer in another partition. Instead, both ends derive the
+    // preimage of a payment from the payee and the payment's index in its workload: payees store their preimages right
+    // away and payers receive their invoices as self messages, with the delay drawn here.
+
+    std::string myName = getName();
+    std::map<std::string, std::vector<std::tuple<std::string, double, simtime_t>>>::iterator incoming = pendingPayments.find(myName);
+    if (incoming != pendingPayments.end()) {
+        for (size_t i = 0; i < incoming->second.size(); i++) {
+            std::string preImage = generatePreImage(((uint64_t) _nodeId << 32) | i);
+            _myPreImages[sha256(preImage)] = preImage;
+        }
+    }
+
+    std::map<std::string, std::vector<std::tuple<std::string, double, simtime_t, int>>>::iterator outgoing = outgoingPayments.find(myName);
+    if (outgoing == outgoingPayments.end())
+        return;
+
+    for (const auto& paymentTuple : outgoing->second) {
+        std::string dstName = std::get<0>(paymentTuple);
+        double value = std::get<1>(paymentTuple);
+        simtime_t time = std::get<2>(paymentTuple);
+        uint64_t dstId = atoi(dstName.c_str() + strlen("node"));
+        std::string preImage = generatePreImage((dstId << 32) | std::get<3>(paymentTuple));
+
+        Invoice *invMsg = new Invoice();
+        invMsg->setSource(myName.c_str());
+        invMsg->setDestination(dstName.c_str());
+        invMsg->setValue(value);
+        invMsg->setPaymentHash(sha256(preImage).c_str());
+
+        BaseMessage *baseMsg = new BaseMessage();
+        baseMsg->setMessageType(INVOICE);
+        baseMsg->setHopCount(0);
+        baseMsg->encapsulate(invMsg);
+        decorateMessage(baseMsg, "INVOICE");
+        scheduleAt(simTime() + time + _invoiceDelay, baseMsg);
+        requestRoute(myName, dstName, time);
+    }
+}
+
 void FullNode::setInFlight(HTLC *htlc, std::string nextHop) {
     // Sets payment in flight and removes from pending
 
@@ -1449,18 +1817,7 @@ bool FullNode::isInFlight(HTLC *htlc, std::string nextHop) {
 std::vector <HTLC *> FullNode::getSortedPendingHTLCs (std::vector<HTLC *> HTLCs, std::string neighbor) {
     // Util function that receies a vector of HTLCs and sorts them according to the local order
     // (also discards HTLCs that are not in the pending list)
-    std::deque<HTLC *> pendingHTLCsFIFO = _paymentChannels[neighbor].getPendingHTLCsFIFO();
-    std::vector<HTLC *> sortedHTLCs;
-
-    for (const auto & pendingHTLC : pendingHTLCsFIFO) {
-        for (const auto & htlc : HTLCs) {
-            std::string htlcId = htlc->getHtlcId();
-           if (htlcId == pendingHTLC->getHtlcId()) {
-               sortedHTLCs.push_back(htlc);
-           }
-        }
-    }
-    return sortedHTLCs;
+    return _paymentChannels[neighbor].getSortedPendingHTLCs(HTLCs);
 }
 
 std::string FullNode::createHTLCId (std::string paymentHash, int htlcType) {
@@ -5,6 +5,7 @@ HTLC::HTLC(UpdateAddHTLC *htlc) {
     _source = htlc->getSource();
     _paymentHash = htlc->getPaymentHash();
     _value = htlc->getValue();
+    _pendingSince = simTime();
     _timeout = htlc->getTimeout();
 }
 
@@ -14,6 +15,7 @@ HTLC::HTLC(UpdateFulfillHTLC *htlc) {
     _paymentHash = htlc->getPaymentHash();
     _preImage = htlc->getPreImage();
     _value = htlc->getValue();
+    _pendingSince = simTime();
 }
 
 HTLC::HTLC(UpdateFailHTLC *htlc) {
@@ -22,4 +24,44 @@ HTLC::HTLC(UpdateFailHTLC *htlc) {
     _paymentHash = htlc->getPaymentHash();
     _errorReason = htlc->getErrorReason();
     _value = htlc->getValue();
+    _pendingSince = simTime();
+}
+
+namespace {
+
+void packString(cCommBuffer *buffer, const std::string& value) {
+    buffer->pack(opp_string(value.c_str()));
+}
+
+std::string unpackString(cCommBuffer *buffer) {
+    opp_string value;
+    buffer->unpack(value);
+    return value.c_str();
+}
+
+} // namespace
+
+void doParsimPacking(cCommBuffer *buffer, HTLC * const& htlc) {
+    buffer->pack(htlc->_type);
+    packString(buffer, htlc->_htlcId);
+    packString(buffer, htlc->_source);
+    packString(buffer, htlc->_paymentHash);
+    packString(buffer, htlc->_preImage);
+    packString(buffer, htlc->_errorReason);
+    buffer->pack(htlc->_timeout);
+    buffer->pack(htlc->_value);
+    buffer->pack(htlc->_pendingSince);
+}
+
+void doParsimUnpacking(cCommBuffer *buffer, HTLC *& htlc) {
+    htlc = new HTLC();
+    buffer->unpack(htlc->_type);
+    htlc->_htlcId = unpackString(buffer);
+    htlc->_source = unpackString(buffer);
+    htlc->_paymentHash = unpackString(buffer);
+    htlc->_preImage = unpackString(buffer);
+    htlc->_errorReason = unpackString(buffer);
+    buffer->unpack(htlc->_timeout);
+    buffer->unpack(htlc->_value);
+    buffer->unpack(htlc->_pendingSince);
 }
@@ -1,11 +1,19 @@
 #pragma once
 
+#include <string>
+
+#ifdef PCN_STANDALONE
+// Built without the OMNeT++ kernel (see tools/microbench.cpp): no message constructors, simulation times are plain doubles
+#include "messages.h"
+typedef double simtime_t;
+#else
 #include "updateAddHTLC_m.h"
 #include "updateFulfillHTLC_m.h"
 #include "updateFailHTLC_m.h"
 #include <omnetpp.h>
 
 using namespace omnetpp;
+#endif
 
 class HTLC {
 
@@ -18,6 +26,7 @@ public:
     std::string _errorReason = "";
     simtime_t _timeout = 0;
     double _value = 0;
+    simtime_t _pendingSince = -1; // when the HTLC was queued for commitment (-1 once it went out in a commitment)
 
     virtual std::string getHtlcId() { return _htlcId; };
     virtual void setHtlcId(std::string htlcId) { _htlcId = htlcId; };
@@ -35,10 +44,19 @@ public:
     virtual void setValue(double value) { _value = value; };
 
     HTLC () {};
+#ifndef PCN_STANDALONE
     HTLC (UpdateAddHTLC *htlc);
     HTLC (UpdateFulfillHTLC *htlc);
     HTLC (UpdateFailHTLC *htlc);
+#endif
 
 };
 
+#ifndef PCN_STANDALONE
+// Commitment messages carry HTLC pointers, which only make sense within one process. Between the partitions of a
+// parallel run the HTLCs travel by value, and the receiving side works on its own copy.
+void doParsimPacking(cCommBuffer *buffer, HTLC * const& htlc);
+void doParsimUnpacking(cCommBuffer *buffer, HTLC *& htlc);
+#endif
+
 
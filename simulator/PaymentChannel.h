@@ -1,12 +1,23 @@
+#pragma once
+
 #include <stdio.h>
-#include <omnetpp.h>
 #include <vector>
 #include <queue>
+#include <map>
+#include <string>
 #include <algorithm>
-#include <jsoncpp/json/value.h>
 #include "HTLC.h"
 
+#ifdef PCN_STANDALONE
+// Channels built outside the simulation (see tools/microbench.cpp) have no gates
+namespace omnetpp { class cGate; }
+using omnetpp::cGate;
+#else
+#include <omnetpp.h>
+#include <jsoncpp/json/value.h>
+
 using namespace omnetpp;
+#endif
 
 class PaymentChannel {
 
@@ -22,6 +33,7 @@ class PaymentChannel {
         double _channelReserveSatoshis;
 
         bool _isWaitingForAck; // Auxiliary variable to check if we're waiting for an ACK in this channel
+        bool _isDetailed = true; // HTLCs are committed through COMMITMENT_SIGNED/REVOKE_AND_ACK (NetBuilder.detailedChannels)
 
         std::map<std::string, HTLC *> _inFlights; //htlcId to value
         std::map<std::string, HTLC *> _pendingHTLCs; //htlcId to pending HTLC vector
@@ -116,12 +128,18 @@ class PaymentChannel {
          // Ack functions
          virtual void setWaitingForAck (bool value) { this->_isWaitingForAck = value; };
          virtual bool isWaitingForAck() { return this->_isWaitingForAck; };
+         virtual void setDetailed (bool value) { this->_isDetailed = value; };
+         virtual bool isDetailed() const { return this->_isDetailed; };
          virtual std::map<int, std::vector<HTLC *>> getAllHTLCsWaitingForAck () { return this->_HTLCsWaitingForAck; };
          virtual std::vector<HTLC *> getHTLCsWaitingForAck (int id) { return this->_HTLCsWaitingForAck[id]; };
          virtual void setHTLCsWaitingForAck (int id, std::vector<HTLC *> vector) { this->_HTLCsWaitingForAck[id] = vector;};
          virtual void removeHTLCsWaitingForAck (int id) { this->_HTLCsWaitingForAck.erase(id); };
          virtual void removeHTLCFromWaitingForAck (int id, HTLC *htlc) { this->_HTLCsWaitingForAck[id].erase(std::remove(_HTLCsWaitingForAck[id].begin(), _HTLCsWaitingForAck[id].end(), htlc), _HTLCsWaitingForAck[id].end()); };
 
+        // Commitment functions
+        virtual bool hasCapacityToForward (const std::string& myName, const std::string& neighbor, double value) const;
+        virtual std::vector<HTLC *> getSortedPendingHTLCs (const std::vector<HTLC *>& HTLCs) const;
+
         // Auxiliary functions
         //Json::Value toJson() const;
 
@@ -130,7 +148,7 @@ class PaymentChannel {
 
 };
 
-PaymentChannel::PaymentChannel(double capacity, double fee, double quality, int maxAcceptedHTLCs, int numHTLCs, double HTLCMinimumMsat, double channelReserveSatoshis, cGate *localGate, cGate *neighborGate) {
+inline PaymentChannel::PaymentChannel(double capacity, double fee, double quality, int maxAcceptedHTLCs, int numHTLCs, double HTLCMinimumMsat, double channelReserveSatoshis, cGate *localGate, cGate *neighborGate) {
     this->_capacity = capacity;
     this->_fee = fee;
     this->_quality = quality;
@@ -143,7 +161,7 @@ PaymentChannel::PaymentChannel(double capacity, double fee, double quality, int
 }
 
 
-void PaymentChannel::copy(const PaymentChannel& other) {
+inline void PaymentChannel::copy(const PaymentChannel& other) {
     this->_capacity = other._capacity;
     this->_fee = other._fee;
     this->_quality = other._quality;
@@ -151,11 +169,12 @@ void PaymentChannel::copy(const PaymentChannel& other) {
     this->_HTLCMinimumMsat = other._HTLCMinimumMsat;
     this->_numHTLCs = other._numHTLCs;
     this->_channelReserveSatoshis = other._channelReserveSatoshis;
+    this->_isDetailed = other._isDetailed;
     this->_localGate = other._localGate;
     this->_neighborGate = other._neighborGate;
 }
 
-bool PaymentChannel::isPendingHTLC (HTLC *htlc) {
+inline bool PaymentChannel::isPendingHTLC (HTLC *htlc) {
     std::string htlcId = htlc->getPaymentHash() + ":" + std::to_string(htlc->getType());
     if(!_pendingHTLCs[htlcId]) {
         // Remove the null pointer we just added
@@ -166,7 +185,7 @@ bool PaymentChannel::isPendingHTLC (HTLC *htlc) {
     }
 }
 
-bool PaymentChannel::isCommittedHTLC (HTLC *htlc) {
+inline bool PaymentChannel::isCommittedHTLC (HTLC *htlc) {
     std::string htlcId = htlc->getPaymentHash() + ":" + std::to_string(htlc->getType());
     if(!_committedHTLCs[htlcId]) {
         // Remove the null pointer we just added
@@ -177,7 +196,7 @@ bool PaymentChannel::isCommittedHTLC (HTLC *htlc) {
     }
 }
 
-bool PaymentChannel::isInFlight (HTLC *htlc) {
+inline bool PaymentChannel::isInFlight (HTLC *htlc) {
     std::string htlcId = htlc->getPaymentHash() + ":" + std::to_string(htlc->getType());
     if (!_inFlights[htlcId]) {
         // Remove the null pointer we just added
@@ -188,18 +207,65 @@ bool PaymentChannel::isInFlight (HTLC *htlc) {
     }
 }
 
-void PaymentChannel::removePendingHTLCFIFOByValue (HTLC *htlc) {
-    for (auto it = _pendingHTLCsFIFO.begin(); it < _pendingHTLCsFIFO.end(); it++) {
+inline void PaymentChannel::removePendingHTLCFIFOByValue (HTLC *htlc) {
+    for (auto it = _pendingHTLCsFIFO.begin(); it != _pendingHTLCsFIFO.end(); ) {
         HTLC *pendingHTLC = *it;
         if (pendingHTLC->getHtlcId() == htlc->getHtlcId())
-            _pendingHTLCsFIFO.erase(it);
+            it = _pendingHTLCsFIFO.erase(it);
+        else
+            it++;
     }
 }
 
-void PaymentChannel::removeCommittedHTLCFIFOByValue (HTLC *htlc) {
-    for (auto it = _committedHTLCsFIFO.begin(); it < _committedHTLCsFIFO.end(); it++) {
+inline void PaymentChannel::removeCommittedHTLCFIFOByValue (HTLC *htlc) {
+    for (auto it = _committedHTLCsFIFO.begin(); it != _committedHTLCsFIFO.end(); ) {
         HTLC *committedHTLC = *it;
         if (committedHTLC->getHtlcId() == htlc->getHtlcId())
-            _committedHTLCsFIFO.erase(it);
+            it = _committedHTLCsFIFO.erase(it);
+        else
+            it++;
+    }
+}
+
+inline bool PaymentChannel::hasCapacityToForward (const std::string& myName, const std::string& neighbor, double value) const {
+    // Calculates the channel capacity after applying the pending HTLCs and checks if there are sufficient funds to forward a payment.
+
+    double capacity = _capacity;
+    for (const auto & htlc : _pendingHTLCsFIFO) {
+        int htlcType = htlc->getType();
+
+        // If it's an add update, subtract value from capacity if we are the previous hop uptstream
+        // (because we'll have less money when we commmit it)
+        if (htlcType == UPDATE_ADD_HTLC) {
+            auto it = _previousHopUp.find(htlc->getHtlcId());
+            if (it != _previousHopUp.end() && it->second == myName) {
+                capacity -= htlc->getValue();
+                if (capacity <= 0)
+                    return false;
+            }
+        } else if (htlcType == UPDATE_FAIL_HTLC) {
+            // If it's a fail update, add value to capacity if we are not the previous hop downstream
+            // (because we'll recover money when we commmit it)
+            auto it = _previousHopDown.find(htlc->getHtlcId());
+            if (it != _previousHopDown.end() && it->second == neighbor)
+                capacity += htlc->getValue();
+        } else {}; // If it's a fulfill update, do nothing (fulfills don't change the capacity in the upstream direction)
+    }
+
+    // Check if the capacity would become negative after forwarding the next payment
+    return (capacity - value) > 0;
+}
+
+inline std::vector<HTLC *> PaymentChannel::getSortedPendingHTLCs (const std::vector<HTLC *>& HTLCs) const {
+    // Sorts a vector of HTLCs according to the local pending order (also discards HTLCs that are not in the pending list)
+
+    std::vector<HTLC *> sortedHTLCs;
+    for (const auto & pendingHTLC : _pendingHTLCsFIFO) {
+        std::string pendingId = pendingHTLC->getHtlcId();
+        for (const auto & htlc : HTLCs) {
+           if (htlc->getHtlcId() == pendingId)
+               sortedHTLCs.push_back(htlc);
+        }
     }
+    return sortedHTLCs;
 }
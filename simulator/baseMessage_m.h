@@ -38,7 +38,7 @@ class BaseMessage;
  *     int hopCount;
  *     stringVector hops;
  *     //bool upstreamDirection;
- *     string displayString = "b=0,0,rect,o=white,white,0	";
+ *     string displayString; // set by FullNode::decorateMessage unless running headless
  * }
  * </pre>
  */
@@ -49,7 +49,7 @@ class BaseMessage : public ::omnetpp::cPacket
     int messageType = 0;
     int hopCount = 0;
     stringVector hops;
-    omnetpp::opp_string displayString = "b=0,0,rect,o=white,white,0	";
+    omnetpp::opp_string displayString;
 
   private:
     void copy(const BaseMessage& other);
@@ -0,0 +1,106 @@
+#include <cmath>
+#include <stdexcept>
+#include "batchMeans.h"
+#include "checkpointStream.h"
+
+namespace {
+
+double normalQuantile(double p) {
+    // Abramowitz and Stegun 26.2.23 (absolute error below 4.5e-4)
+    double q = p < 0.5 ? p : 1 - p;
+    double t = std::sqrt(-2 * std::log(q));
+    double z = t - (2.515517 + 0.802853 * t + 0.010328 * t * t) / (1 + 1.432788 * t + 0.189269 * t * t + 0.001308 * t * t * t);
+    return p < 0.5 ? -z : z;
+}
+
+// Exact quantiles at p = 0.95, 0.975 and 0.995 for 3 to 10 degrees of freedom, where the expansion is least accurate
+const double T_TABLE_LEVELS[3] = {0.95, 0.975, 0.995};
+const double T_TABLE[8][3] = {
+    {2.353363, 3.182446, 5.840909},
+    {2.131847, 2.776445, 4.604095},
+    {2.015048, 2.570582, 4.032143},
+    {1.943180, 2.446912, 3.707428},
+    {1.894579, 2.364624, 3.499483},
+    {1.859548, 2.306004, 3.355387},
+    {1.833113, 2.262157, 3.249836},
+    {1.812461, 2.228139, 3.169273}
+};
+
+} // namespace
+
+double studentTQuantile(double p, int degreesOfFreedom) {
+
+    if (p <= 0 || p >= 1 || degreesOfFreedom < 1)
+        throw std::invalid_argument("Student t quantiles need 0 < p < 1 and at least one degree of freedom");
+
+    // Closed forms: the Cauchy distribution for 1 degree of freedom, and an algebraic inverse for 2
+    if (degreesOfFreedom == 1)
+        return std::tan(std::acos(-1.0) * (p - 0.5));
+    if (degreesOfFreedom == 2)
+        return (2 * p - 1) / std::sqrt(2 * p * (1 - p));
+
+    if (degreesOfFreedom <= 10) {
+        double upper = p < 0.5 ? 1 - p : p;
+        for (int i = 0; i < 3; i++) {
+            if (std::fabs(upper - T_TABLE_LEVELS[i]) < 1e-9)
+                return p < 0.5 ? -T_TABLE[degreesOfFreedom - 3][i] : T_TABLE[degreesOfFreedom - 3][i];
+        }
+    }
+
+    double z = normalQuantile(p);
+    double n = degreesOfFreedom;
+    double z2 = z * z;
+    return z + z * (z2 + 1) / (4 * n)
+            + z * ((5 * z2 + 16) * z2 + 3) / (96 * n * n)
+            + z * (((3 * z2 + 19) * z2 + 17) * z2 - 15) / (384 * n * n * n)
+            + z * ((((79 * z2 + 776) * z2 + 1482) * z2 - 1920) * z2 - 945) / (92160 * n * n * n * n);
+}
+
+void BatchMeans::setWindow(size_t windowBatches) {
+    if (windowBatches < 2)
+        throw std::invalid_argument("the batch window must hold at least two batches");
+    _windowBatches = windowBatches;
+    while (_batches.size() > _windowBatches)
+        _batches.pop_front();
+}
+
+void BatchMeans::addBatch(double mean) {
+    _batches.push_back(mean);
+    if (_batches.size() > _windowBatches)
+        _batches.pop_front();
+}
+
+double BatchMeans::getMean() const {
+    if (_batches.empty())
+        return 0;
+    double sum = 0;
+    for (double mean : _batches)
+        sum += mean;
+    return sum / _batches.size();
+}
+
+double BatchMeans::getHalfWidth(double confidence) const {
+
+    size_t n = _batches.size();
+    if (n < 2)
+        return 0;
+
+    double mean = getMean();
+    double squares = 0;
+    for (double batch : _batches)
+        squares += (batch - mean) * (batch - mean);
+    double standardError = std::sqrt(squares / (n - 1) / n);
+    return studentTQuantile(0.5 + confidence / 2, n - 1) * standardError;
+}
+
+void BatchMeans::writeTo(CheckpointWriter& writer) const {
+    writer.writeUInt(_batches.size());
+    for (double mean : _batches)
+        writer.writeDouble(mean);
+}
+
+void BatchMeans::readFrom(CheckpointReader& reader) {
+    _batches.clear();
+    for (uint64_t n = reader.readUInt(); n > 0; n--)
+        addBatch(reader.readDouble());
+}
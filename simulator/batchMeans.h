@@ -0,0 +1,41 @@
+#ifndef _BATCHMEANS_H_
+#define _BATCHMEANS_H_
+
+#include <cstddef>
+#include <deque>
+
+class CheckpointWriter;
+class CheckpointReader;
+
+// Sliding window over the means of the last batches of a metric. The batch means are treated as independent samples,
+// so the confidence interval of the metric is the Student t interval over them.
+class BatchMeans {
+
+    public:
+        BatchMeans(size_t windowBatches = 10) : _windowBatches(windowBatches) {};
+
+        void setWindow(size_t windowBatches);
+        void addBatch(double mean);
+        void clear() { _batches.clear(); };
+
+        size_t getNumBatches() const { return _batches.size(); };
+        bool isFull() const { return _batches.size() >= _windowBatches; };
+        double getMean() const;
+        // Half-width of the confidence interval of the mean at the given level (e.g. 0.95), 0 with fewer than 2 batches
+        double getHalfWidth(double confidence) const;
+
+        // Checkpoints (see checkpoint.h). The window size is configuration, so only the batches are saved.
+        void writeTo(CheckpointWriter& writer) const;
+        void readFrom(CheckpointReader& reader);
+
+    private:
+        size_t _windowBatches;
+        std::deque<double> _batches;
+};
+
+// Quantile of the Student t distribution. It is exact for 1 and 2 degrees of freedom, and up to 10 degrees of freedom at
+// the usual levels (p = 0.95, 0.975 and 0.995, or 1 - p). Otherwise it comes from the normal quantile through the
+// Cornish-Fisher expansion, which is within 0.1% from 11 degrees of freedom on and less accurate below that.
+double studentTQuantile(double p, int degreesOfFreedom);
+
+#endif
@@ -0,0 +1,52 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include "channelSnapshot.h"
+
+void ChannelSnapshot::add(int nodeId, int neighborId, double capacity) {
+    ChannelSnapshotEntry entry;
+    entry.nodeId = nodeId;
+    entry.neighborId = neighborId;
+    entry.capacity = capacity;
+    _entries.push_back(entry);
+}
+
+void ChannelSnapshot::write(const std::string& fileName) const {
+
+    ChannelSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHANNEL_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = CHANNEL_SNAPSHOT_VERSION;
+    header.entrySize = sizeof(ChannelSnapshotEntry);
+    header.numEntries = _entries.size();
+
+    std::ofstream file(fileName, std::ofstream::binary | std::ofstream::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(_entries.data()), _entries.size() * sizeof(ChannelSnapshotEntry));
+    if (!file)
+        throw std::runtime_error("could not write channel snapshot " + fileName);
+}
+
+void ChannelSnapshot::read(const std::string& fileName) {
+
+    std::ifstream file(fileName, std::ifstream::binary);
+    if (!file)
+        throw std::runtime_error("could not open channel snapshot " + fileName);
+
+    ChannelSnapshotHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || memcmp(header.magic, CHANNEL_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+            || header.version != CHANNEL_SNAPSHOT_VERSION || header.entrySize != sizeof(ChannelSnapshotEntry))
+        throw std::runtime_error(fileName + " is not a version " + std::to_string(CHANNEL_SNAPSHOT_VERSION) + " channel snapshot");
+
+    // Check the entry count against what follows the header, so a corrupt count fails here instead of in the allocation
+    std::streamoff dataStart = file.tellg();
+    file.seekg(0, std::ifstream::end);
+    uint64_t dataSize = file.tellg() - dataStart;
+    file.seekg(dataStart);
+    if (!file || header.numEntries > dataSize / sizeof(ChannelSnapshotEntry))
+        throw std::runtime_error("channel snapshot " + fileName + " is truncated");
+
+    _entries.resize(header.numEntries);
+    if (!file.read(reinterpret_cast<char *>(_entries.data()), _entries.size() * sizeof(ChannelSnapshotEntry)))
+        throw std::runtime_error("channel snapshot " + fileName + " is truncated");
+}
@@ -0,0 +1,51 @@
+#ifndef _CHANNELSNAPSHOT_H_
+#define _CHANNELSNAPSHOT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Channel snapshot files hold this header followed by numEntries raw ChannelSnapshotEntry records
+#define CHANNEL_SNAPSHOT_MAGIC "PCNCHSNP"
+#define CHANNEL_SNAPSHOT_VERSION 1
+
+struct ChannelSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+    uint64_t numEntries;
+};
+
+// The capacity of one payment channel direction (the PaymentChannel of nodeId towards neighborId)
+struct ChannelSnapshotEntry {
+    int32_t nodeId;
+    int32_t neighborId;
+    double capacity;
+};
+
+// Per-direction channel capacities taken at one point of a run (the end of the warm-up), so that later runs can start
+// from that state instead of the topology's capacities. Values of HTLCs still in flight are not part of any capacity.
+class ChannelSnapshot {
+
+    public:
+        void add(int nodeId, int neighborId, double capacity);
+        void clear() { _entries.clear(); };
+        const std::vector<ChannelSnapshotEntry>& getEntries() const { return _entries; };
+
+        // Both throw std::runtime_error if the file cannot be written or read, or is not a version 1 snapshot
+        void write(const std::string& fileName) const;
+        void read(const std::string& fileName);
+
+    private:
+        std::vector<ChannelSnapshotEntry> _entries;
+};
+
+// Implemented by modules whose channels are part of a snapshot
+class ChannelSnapshotSource {
+
+    public:
+        virtual ~ChannelSnapshotSource() {};
+        virtual void snapshotChannels(ChannelSnapshot& snapshot) = 0;
+};
+
+#endif
@@ -0,0 +1,437 @@
+#include <sstream>
+#include <stdexcept>
+#include "checkpoint.h"
+#include "baseMessage_m.h"
+#include "commitmentSigned_m.h"
+#include "invoice_m.h"
+#include "payment_m.h"
+#include "paymentRefused_m.h"
+#include "revokeAndAck_m.h"
+
+namespace {
+
+// Packets a BaseMessage may encapsulate
+enum CheckpointPacket { PACKET_NONE, PACKET_PAYMENT, PACKET_INVOICE, PACKET_UPDATE_ADD_HTLC, PACKET_UPDATE_FULFILL_HTLC,
+        PACKET_UPDATE_FAIL_HTLC, PACKET_COMMITMENT_SIGNED, PACKET_REVOKE_AND_ACK, PACKET_PAYMENT_REFUSED };
+
+void writeHTLCs(CheckpointWriter& writer, const std::vector<HTLC *>& HTLCs) {
+    writer.writeUInt(HTLCs.size());
+    for (HTLC *htlc : HTLCs)
+        writeHTLC(writer, htlc);
+}
+
+std::vector<HTLC *> readHTLCs(CheckpointReader& reader) {
+    // Grown as the HTLCs are read, so a corrupt count fails as a truncated checkpoint
+    std::vector<HTLC *> HTLCs;
+    for (uint64_t n = reader.readUInt(); n > 0; n--)
+        HTLCs.push_back(readHTLC(reader));
+    return HTLCs;
+}
+
+void writeHTLCMap(CheckpointWriter& writer, const std::map<std::string, HTLC *>& HTLCs) {
+    writer.writeUInt(HTLCs.size());
+    for (const auto& entry : HTLCs) {
+        writer.writeString(entry.first);
+        writeHTLC(writer, entry.second);
+    }
+}
+
+void readHTLCMap(CheckpointReader& reader, std::map<std::string, HTLC *>& HTLCs) {
+    HTLCs.clear();
+    for (uint64_t n = reader.readUInt(); n > 0; n--) {
+        std::string key = reader.readString();
+        HTLCs[key] = readHTLC(reader);
+    }
+}
+
+void writePacket(CheckpointWriter& writer, cPacket *packet) {
+
+    if (packet == nullptr) {
+        writer.writeUInt(PACKET_NONE);
+    } else if (Payment *payment = dynamic_cast<Payment *>(packet)) {
+        writer.writeUInt(PACKET_PAYMENT);
+        writer.writeString(payment->getSource());
+        writer.writeString(payment->getDestination());
+        writer.writeInt(payment->getHopCount());
+        writer.writeDouble(payment->getValue());
+    } else if (Invoice *invoice = dynamic_cast<Invoice *>(packet)) {
+        writer.writeUInt(PACKET_INVOICE);
+        writer.writeString(invoice->getSource());
+        writer.writeString(invoice->getDestination());
+        writer.writeDouble(invoice->getValue());
+        writer.writeString(invoice->getPaymentHash());
+    } else if (UpdateAddHTLC *add = dynamic_cast<UpdateAddHTLC *>(packet)) {
+        writer.writeUInt(PACKET_UPDATE_ADD_HTLC);
+        writer.writeString(add->getSource());
+        writer.writeString(add->getHtlcId());
+        writer.writeString(add->getPaymentHash());
+        writeSimTime(writer, add->getTimeout());
+        writer.writeDouble(add->getValue());
+    } else if (UpdateFulfillHTLC *fulfill = dynamic_cast<UpdateFulfillHTLC *>(packet)) {
+        writer.writeUInt(PACKET_UPDATE_FULFILL_HTLC);
+        writer.writeString(fulfill->getHtlcId());
+        writer.writeString(fulfill->getPaymentHash());
+        writer.writeString(fulfill->getPreImage());
+        writer.writeDouble(fulfill->getValue());
+    } else if (UpdateFailHTLC *fail = dynamic_cast<UpdateFailHTLC *>(packet)) {
+        writer.writeUInt(PACKET_UPDATE_FAIL_HTLC);
+        writer.writeString(fail->getHtlcId());
+        writer.writeString(fail->getPaymentHash());
+        writer.writeString(fail->getErrorReason());
+        writer.writeDouble(fail->getValue());
+    } else if (commitmentSigned *commit = dynamic_cast<commitmentSigned *>(packet)) {
+        writer.writeUInt(PACKET_COMMITMENT_SIGNED);
+        writeHTLCs(writer, commit->getHTLCs());
+        writer.writeInt(commit->getId());
+    } else if (revokeAndAck *ack = dynamic_cast<revokeAndAck *>(packet)) {
+        writer.writeUInt(PACKET_REVOKE_AND_ACK);
+        writeHTLCs(writer, ack->getHTLCs());
+        writer.writeInt(ack->getAckId());
+    } else if (PaymentRefused *refused = dynamic_cast<PaymentRefused *>(packet)) {
+        writer.writeUInt(PACKET_PAYMENT_REFUSED);
+        writer.writeString(refused->getPaymentHash());
+        writer.writeString(refused->getErrorReason());
+        writer.writeDouble(refused->getValue());
+    } else {
+        throw std::runtime_error(std::string("cannot checkpoint packets of class ") + packet->getClassName());
+    }
+
+    if (packet != nullptr) {
+        writer.writeString(packet->getName());
+        writer.writeInt(packet->getKind());
+    }
+}
+
+cPacket *readPacket(CheckpointReader& reader) {
+
+    cPacket *packet = nullptr;
+    switch (reader.readUInt()) {
+        case PACKET_NONE:
+            return nullptr;
+        case PACKET_PAYMENT: {
+            Payment *payment = new Payment();
+            payment->setSource(reader.readString().c_str());
+            payment->setDestination(reader.readString().c_str());
+            payment->setHopCount(reader.readInt());
+            payment->setValue(reader.readDouble());
+            packet = payment;
+            break;
+        }
+        case PACKET_INVOICE: {
+            Invoice *invoice = new Invoice();
+            invoice->setSource(reader.readString().c_str());
+            invoice->setDestination(reader.readString().c_str());
+            invoice->setValue(reader.readDouble());
+            invoice->setPaymentHash(reader.readString().c_str());
+            packet = invoice;
+            break;
+        }
+        case PACKET_UPDATE_ADD_HTLC: {
+            UpdateAddHTLC *add = new UpdateAddHTLC();
+            add->setSource(reader.readString().c_str());
+            add->setHtlcId(reader.readString().c_str());
+            add->setPaymentHash(reader.readString().c_str());
+            add->setTimeout(readSimTime(reader));
+            add->setValue(reader.readDouble());
+            packet = add;
+            break;
+        }
+        case PACKET_UPDATE_FULFILL_HTLC: {
+            UpdateFulfillHTLC *fulfill = new UpdateFulfillHTLC();
+            fulfill->setHtlcId(reader.readString().c_str());
+            fulfill->setPaymentHash(reader.readString().c_str());
+            fulfill->setPreImage(reader.readString().c_str());
+            fulfill->setValue(reader.readDouble());
+            packet = fulfill;
+            break;
+        }
+        case PACKET_UPDATE_FAIL_HTLC: {
+            UpdateFailHTLC *fail = new UpdateFailHTLC();
+            fail->setHtlcId(reader.readString().c_str());
+            fail->setPaymentHash(reader.readString().c_str());
+            fail->setErrorReason(reader.readString().c_str());
+            fail->setValue(reader.readDouble());
+            packet = fail;
+            break;
+        }
+        case PACKET_COMMITMENT_SIGNED: {
+            commitmentSigned *commit = new commitmentSigned();
+            commit->setHTLCs(readHTLCs(reader));
+            commit->setId(reader.readInt());
+            packet = commit;
+            break;
+        }
+        case PACKET_REVOKE_AND_ACK: {
+            revokeAndAck *ack = new revokeAndAck();
+            ack->setHTLCs(readHTLCs(reader));
+            ack->setAckId(reader.readInt());
+            packet = ack;
+            break;
+        }
+        case PACKET_PAYMENT_REFUSED: {
+            PaymentRefused *refused = new PaymentRefused();
+            refused->setPaymentHash(reader.readString().c_str());
+            refused->setErrorReason(reader.readString().c_str());
+            refused->setValue(reader.readDouble());
+            packet = refused;
+            break;
+        }
+        default:
+            throw std::runtime_error("the checkpoint holds a packet of unknown type");
+    }
+
+    packet->setName(reader.readString().c_str());
+    packet->setKind(reader.readInt());
+    return packet;
+}
+
+} // namespace
+
+Register_Class(CheckpointRNG);
+
+void CheckpointRNG::initialize(int seedSet, int rngId, int numRngs, int parsimProcId, int parsimNumPartitions,
+        cConfiguration *cfg) {
+    std::string seedKey = "seed-" + std::to_string(rngId) + "-mt";
+    const char *seed = cfg->getConfigValue(seedKey.c_str());
+    if (seed != nullptr)
+        _engine.seed(std::stoul(seed));
+    else
+        _engine.seed(((uint32_t) seedSet * parsimNumPartitions + parsimProcId) * numRngs + rngId);
+    numDrawn = 0;
+}
+
+uint32_t CheckpointRNG::intRand() {
+    numDrawn++;
+    return _engine();
+}
+
+uint32_t CheckpointRNG::intRand(uint32_t n) {
+    // Draws are masked to the bits n - 1 needs and the ones above it rejected, so every value is equally likely
+    if (n == 0)
+        throw cRuntimeError("CheckpointRNG::intRand(n): n must be positive");
+    uint32_t max = n - 1;
+    uint32_t mask = max;
+    for (int shift = 1; shift < 32; shift <<= 1)
+        mask |= mask >> shift;
+    uint32_t value;
+    do {
+        value = _engine() & mask;
+    } while (value > max);
+    numDrawn++;
+    return value;
+}
+
+double CheckpointRNG::doubleRand() {
+    return intRand() * (1.0 / 4294967296.0);
+}
+
+double CheckpointRNG::doubleRandNonz() {
+    return (intRand() + 0.5) * (1.0 / 4294967296.0);
+}
+
+double CheckpointRNG::doubleRandIncl1() {
+    return intRand() * (1.0 / 4294967295.0);
+}
+
+void CheckpointRNG::writeState(CheckpointWriter& writer) const {
+    std::ostringstream state;
+    state << _engine;
+    writer.writeString(state.str());
+    writer.writeUInt(numDrawn);
+}
+
+void CheckpointRNG::readState(CheckpointReader& reader) {
+    std::istringstream state(reader.readString());
+    state >> _engine;
+    if (state.fail())
+        throw std::runtime_error("invalid RNG state in checkpoint");
+    numDrawn = reader.readUInt();
+}
+
+void writeSimTime(CheckpointWriter& writer, simtime_t time) {
+    writer.writeInt(time.raw());
+}
+
+simtime_t readSimTime(CheckpointReader& reader) {
+    return SimTime::fromRaw(reader.readInt());
+}
+
+void writeStringMap(CheckpointWriter& writer, const std::map<std::string, std::string>& map) {
+    writer.writeUInt(map.size());
+    for (const auto& entry : map) {
+        writer.writeString(entry.first);
+        writer.writeString(entry.second);
+    }
+}
+
+void readStringMap(CheckpointReader& reader, std::map<std::string, std::string>& map) {
+    map.clear();
+    for (uint64_t n = reader.readUInt(); n > 0; n--) {
+        std::string key = reader.readString();
+        map[key] = reader.readString();
+    }
+}
+
+void writeHTLC(CheckpointWriter& writer, HTLC *htlc) {
+
+    if (htlc == nullptr) {
+        writer.writeUInt(0);
+        return;
+    }
+    bool isNew;
+    writer.writeUInt(writer.getObjectId(htlc, isNew));
+    if (!isNew)
+        return;
+
+    writer.writeInt(htlc->_type);
+    writer.writeString(htlc->_htlcId);
+    writer.writeString(htlc->_source);
+    writer.writeString(htlc->_paymentHash);
+    writer.writeString(htlc->_preImage);
+    writer.writeString(htlc->_errorReason);
+    writeSimTime(writer, htlc->_timeout);
+    writer.writeDouble(htlc->_value);
+    writeSimTime(writer, htlc->_pendingSince);
+}
+
+HTLC *readHTLC(CheckpointReader& reader) {
+
+    uint64_t id = reader.readUInt();
+    if (id == 0)
+        return nullptr;
+    if (!reader.isNewObject(id))
+        return static_cast<HTLC *>(reader.getObject(id));
+
+    HTLC *htlc = new HTLC();
+    reader.addObject(htlc);
+    htlc->_type = reader.readInt();
+    htlc->_htlcId = reader.readString();
+    htlc->_source = reader.readString();
+    htlc->_paymentHash = reader.readString();
+    htlc->_preImage = reader.readString();
+    htlc->_errorReason = reader.readString();
+    htlc->_timeout = readSimTime(reader);
+    htlc->_value = reader.readDouble();
+    htlc->_pendingSince = readSimTime(reader);
+    return htlc;
+}
+
+void writeMessage(CheckpointWriter& writer, cMessage *msg) {
+
+    if (msg == nullptr) {
+        writer.writeUInt(0);
+        return;
+    }
+    bool isNew;
+    writer.writeUInt(writer.getObjectId(msg, isNew));
+    if (!isNew)
+        return;
+
+    BaseMessage *baseMsg = dynamic_cast<BaseMessage *>(msg);
+    writer.writeBool(baseMsg != nullptr);
+    if (baseMsg == nullptr) {
+        // Timers are only checkpointed while scheduled, so they are identified by the module they are scheduled for
+        writer.writeInt(msg->getArrivalModuleId());
+        writer.writeString(msg->getName());
+        return;
+    }
+
+    writer.writeString(baseMsg->getName());
+    writer.writeInt(baseMsg->getKind());
+    writer.writeString(baseMsg->getDestination());
+    writer.writeInt(baseMsg->getMessageType());
+    writer.writeInt(baseMsg->getHopCount());
+    writer.writeUInt(baseMsg->getHops().size());
+    for (const auto& hop : baseMsg->getHops())
+        writer.writeString(hop);
+    writer.writeString(baseMsg->getDisplayString());
+    writePacket(writer, baseMsg->getEncapsulatedPacket());
+}
+
+cMessage *readMessage(CheckpointReader& reader) {
+
+    uint64_t id = reader.readUInt();
+    if (id == 0)
+        return nullptr;
+    if (!reader.isNewObject(id))
+        return static_cast<cMessage *>(reader.getObject(id));
+
+    if (!reader.readBool()) {
+        int moduleId = reader.readInt();
+        std::string name = reader.readString();
+        // A timer of a feature the restored run does not enable (e.g. a memory report) is dropped
+        Checkpointable *module = dynamic_cast<Checkpointable *>(getSimulation()->getModule(moduleId));
+        cMessage *timer = module != nullptr ? module->getCheckpointTimer(name) : nullptr;
+        reader.addObject(timer);
+        return timer;
+    }
+
+    BaseMessage *baseMsg = new BaseMessage();
+    reader.addObject(baseMsg);
+    baseMsg->setName(reader.readString().c_str());
+    baseMsg->setKind(reader.readInt());
+    baseMsg->setDestination(reader.readString().c_str());
+    baseMsg->setMessageType(reader.readInt());
+    baseMsg->setHopCount(reader.readInt());
+    stringVector hops;
+    for (uint64_t n = reader.readUInt(); n > 0; n--)
+        hops.push_back(reader.readString());
+    baseMsg->setHops(hops);
+    baseMsg->setDisplayString(reader.readString().c_str());
+    cPacket *packet = readPacket(reader);
+    if (packet != nullptr)
+        baseMsg->encapsulate(packet);
+    return baseMsg;
+}
+
+void writePaymentChannel(CheckpointWriter& writer, const PaymentChannel& channel) {
+
+    writer.writeDouble(channel._capacity);
+    writer.writeDouble(channel._fee);
+    writer.writeDouble(channel._quality);
+    writer.writeInt(channel._maxAcceptedHTLCs);
+    writer.writeDouble(channel._HTLCMinimumMsat);
+    writer.writeInt(channel._numHTLCs);
+    writer.writeDouble(channel._channelReserveSatoshis);
+    writer.writeBool(channel._isWaitingForAck);
+
+    writeHTLCMap(writer, channel._inFlights);
+    writeHTLCMap(writer, channel._pendingHTLCs);
+    writeHTLCs(writer, std::vector<HTLC *>(channel._pendingHTLCsFIFO.begin(), channel._pendingHTLCsFIFO.end()));
+    writer.writeUInt(channel._HTLCsWaitingForAck.size());
+    for (const auto& entry : channel._HTLCsWaitingForAck) {
+        writer.writeInt(entry.first);
+        writeHTLCs(writer, entry.second);
+    }
+    writeHTLCMap(writer, channel._committedHTLCs);
+    writeHTLCs(writer, std::vector<HTLC *>(channel._committedHTLCsFIFO.begin(), channel._committedHTLCsFIFO.end()));
+    writeStringMap(writer, channel._previousHopUp);
+    writeStringMap(writer, channel._previousHopDown);
+}
+
+void readPaymentChannel(CheckpointReader& reader, PaymentChannel& channel) {
+
+    channel._capacity = reader.readDouble();
+    channel._fee = reader.readDouble();
+    channel._quality = reader.readDouble();
+    channel._maxAcceptedHTLCs = reader.readInt();
+    channel._HTLCMinimumMsat = reader.readDouble();
+    channel._numHTLCs = reader.readInt();
+    channel._channelReserveSatoshis = reader.readDouble();
+    channel._isWaitingForAck = reader.readBool();
+
+    readHTLCMap(reader, channel._inFlights);
+    readHTLCMap(reader, channel._pendingHTLCs);
+    std::vector<HTLC *> pendingFIFO = readHTLCs(reader);
+    channel._pendingHTLCsFIFO.assign(pendingFIFO.begin(), pendingFIFO.end());
+    channel._HTLCsWaitingForAck.clear();
+    for (uint64_t n = reader.readUInt(); n > 0; n--) {
+        int ackId = reader.readInt();
+        channel._HTLCsWaitingForAck[ackId] = readHTLCs(reader);
+    }
+    readHTLCMap(reader, channel._committedHTLCs);
+    std::vector<HTLC *> committedFIFO = readHTLCs(reader);
+    channel._committedHTLCsFIFO.assign(committedFIFO.begin(), committedFIFO.end());
+    readStringMap(reader, channel._previousHopUp);
+    readStringMap(reader, channel._previousHopDown);
+}
@@ -0,0 +1,72 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <map>
+#include <random>
+#include <string>
+#include <omnetpp.h>
+#include "checkpointStream.h"
+#include "HTLC.h"
+#include "PaymentChannel.h"
+
+using namespace omnetpp;
+
+// Simulation times are written as their raw value, so they are restored exactly (with the same time resolution)
+void writeSimTime(CheckpointWriter& writer, simtime_t time);
+simtime_t readSimTime(CheckpointReader& reader);
+
+void writeStringMap(CheckpointWriter& writer, const std::map<std::string, std::string>& map);
+void readStringMap(CheckpointReader& reader, std::map<std::string, std::string>& map);
+
+// HTLCs are shared by the channels of both ends and by the commitment messages between them, so each one is written
+// the first time it is referenced and referred to by id afterwards
+void writeHTLC(CheckpointWriter& writer, HTLC *htlc);
+HTLC *readHTLC(CheckpointReader& reader);
+
+// Protocol messages (a BaseMessage and the packet it encapsulates) are written like HTLCs, since a node may keep a
+// message it has also scheduled. Any other message is a timer of the module it is scheduled for, which is rescheduled
+// on restore rather than recreated (see Checkpointable::getCheckpointTimer), or nullptr if the restored run has no
+// such timer.
+void writeMessage(CheckpointWriter& writer, cMessage *msg);
+cMessage *readMessage(CheckpointReader& reader);
+
+// Everything but the gates, which the restored network already has
+void writePaymentChannel(CheckpointWriter& writer, const PaymentChannel& channel);
+void readPaymentChannel(CheckpointReader& reader, PaymentChannel& channel);
+
+// Mersenne Twister whose whole state is written to checkpoints, so a restored run draws the same numbers as the
+// checkpointed one. Checkpoints require it (rng-class = "CheckpointRNG"): the state of OMNeT++'s own RNGs cannot be
+// read, and their position cannot be recovered from the count of numbers drawn, since draws such as intuniform()
+// reject and redraw values without counting them. Seeded from seed-<k>-mt if set, otherwise from the seed set.
+class CheckpointRNG : public cRNG {
+
+    private:
+        std::mt19937 _engine;
+
+    public:
+        virtual void initialize(int seedSet, int rngId, int numRngs, int parsimProcId, int parsimNumPartitions,
+                cConfiguration *cfg) override;
+        virtual void selfTest() override {};
+        virtual uint32_t intRand() override;
+        virtual uint32_t intRandMax() override { return std::mt19937::max(); };
+        virtual uint32_t intRand(uint32_t n) override;
+        virtual double doubleRand() override;
+        virtual double doubleRandNonz() override;
+        virtual double doubleRandIncl1() override;
+
+        void writeState(CheckpointWriter& writer) const;
+        void readState(CheckpointReader& reader);
+};
+
+// Implemented by modules whose state is part of a checkpoint
+class Checkpointable {
+
+    public:
+        virtual ~Checkpointable() {};
+        virtual void writeCheckpoint(CheckpointWriter& writer) = 0;
+        virtual void readCheckpoint(CheckpointReader& reader) = 0;
+        // The timer of this module with the given name (nullptr if there is none)
+        virtual cMessage *getCheckpointTimer(const std::string& name) { return nullptr; };
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include "checkpointStream.h"
+
+CheckpointWriter::~CheckpointWriter() {
+    // A checkpoint that was not closed is incomplete, so it never replaces the previous one
+    if (_file != nullptr) {
+        gzclose(_file);
+        std::remove(_tmpFileName.c_str());
+    }
+}
+
+void CheckpointWriter::open(const std::string& fileName) {
+
+    _fileName = fileName;
+    _tmpFileName = fileName + ".tmp" + std::to_string(getpid());
+    _failed = false;
+    _objectIds.clear();
+
+    // Level 1: checkpoints are written while the simulation waits
+    _file = gzopen(_tmpFileName.c_str(), "wb1");
+    if (_file == nullptr)
+        throw std::runtime_error("could not open checkpoint file " + _tmpFileName);
+    write(CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC));
+    writeUInt(CHECKPOINT_VERSION);
+}
+
+void CheckpointWriter::close() {
+
+    if (_file == nullptr)
+        return;
+    bool failed = gzclose(_file) != Z_OK || _failed;
+    _file = nullptr;
+    _objectIds.clear();
+    if (failed || std::rename(_tmpFileName.c_str(), _fileName.c_str()) != 0) {
+        std::remove(_tmpFileName.c_str());
+        throw std::runtime_error("could not write checkpoint file " + _fileName);
+    }
+}
+
+void CheckpointWriter::write(const void *data, size_t size) {
+    if (!_failed && gzwrite(_file, data, size) != (int) size)
+        _failed = true;
+}
+
+void CheckpointWriter::writeUInt(uint64_t value) {
+    write(&value, sizeof(value));
+}
+
+void CheckpointWriter::writeInt(int64_t value) {
+    write(&value, sizeof(value));
+}
+
+void CheckpointWriter::writeDouble(double value) {
+    write(&value, sizeof(value));
+}
+
+void CheckpointWriter::writeString(const std::string& value) {
+    writeUInt(value.size());
+    write(value.data(), value.size());
+}
+
+uint64_t CheckpointWriter::getObjectId(const void *object, bool& isNew) {
+    auto it = _objectIds.find(object);
+    isNew = (it == _objectIds.end());
+    if (isNew)
+        it = _objectIds.insert(std::make_pair(object, _objectIds.size() + 1)).first;
+    return it->second;
+}
+
+void CheckpointReader::open(const std::string& fileName) {
+
+    close();
+    _file = gzopen(fileName.c_str(), "rb");
+    if (_file == nullptr)
+        throw std::runtime_error("could not open checkpoint file " + fileName);
+
+    char magic[sizeof(CHECKPOINT_MAGIC) - 1];
+    if (gzread(_file, magic, sizeof(magic)) != (int) sizeof(magic) || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0
+            || readUInt() != CHECKPOINT_VERSION)
+        throw std::runtime_error(fileName + " is not a version " + std::to_string(CHECKPOINT_VERSION) + " checkpoint");
+}
+
+void CheckpointReader::close() {
+    if (_file != nullptr)
+        gzclose(_file);
+    _file = nullptr;
+    _objects.clear();
+}
+
+void CheckpointReader::read(void *data, size_t size) {
+    if (gzread(_file, data, size) != (int) size)
+        throw std::runtime_error("the checkpoint is truncated");
+}
+
+uint64_t CheckpointReader::readUInt() {
+    uint64_t value;
+    read(&value, sizeof(value));
+    return value;
+}
+
+int64_t CheckpointReader::readInt() {
+    int64_t value;
+    read(&value, sizeof(value));
+    return value;
+}
+
+double CheckpointReader::readDouble() {
+    double value;
+    read(&value, sizeof(value));
+    return value;
+}
+
+std::string CheckpointReader::readString() {
+    uint64_t size = readUInt();
+    std::string value;
+    while (value.size() < size) {
+        size_t chunkSize = std::min<uint64_t>(size - value.size(), 1 << 20);
+        value.resize(value.size() + chunkSize);
+        read(&value[value.size() - chunkSize], chunkSize);
+    }
+    return value;
+}
+
+void *CheckpointReader::getObject(uint64_t id) const {
+    if (id == 0 || id > _objects.size())
+        throw std::runtime_error("the checkpoint refers to an object it does not contain");
+    return _objects[id - 1];
+}
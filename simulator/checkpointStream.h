@@ -0,0 +1,74 @@
+#ifndef _CHECKPOINTSTREAM_H_
+#define _CHECKPOINTSTREAM_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+
+// Checkpoint files are gzip streams of little-endian values that start with this magic and version
+#define CHECKPOINT_MAGIC "PCNCHKPT"
+#define CHECKPOINT_VERSION 5
+
+// Writes a checkpoint. Objects referenced from several places (HTLCs, messages) get an id the first time they are
+// written, so that the reader can share them again. The file only replaces an existing one once it is complete.
+class CheckpointWriter {
+
+    public:
+        ~CheckpointWriter();
+
+        // Both throw std::runtime_error if the file cannot be written
+        void open(const std::string& fileName);
+        void close();
+
+        void writeUInt(uint64_t value);
+        void writeInt(int64_t value);
+        void writeDouble(double value);
+        void writeBool(bool value) { writeUInt(value); };
+        void writeString(const std::string& value);
+
+        // Returns the id of object (ids start at 1) and whether this is the first time it is written
+        uint64_t getObjectId(const void *object, bool& isNew);
+
+    private:
+        void write(const void *data, size_t size);
+
+        gzFile _file = nullptr;
+        std::string _fileName;
+        std::string _tmpFileName;
+        bool _failed = false;
+        std::unordered_map<const void *, uint64_t> _objectIds;
+};
+
+// Reads a checkpoint written by CheckpointWriter. Every read throws std::runtime_error on a truncated file. Lengths
+// stored in the file are not trusted: strings grow as their bytes are read, so a corrupt length ends as a truncated
+// file rather than as one huge allocation.
+class CheckpointReader {
+
+    public:
+        ~CheckpointReader() { close(); };
+
+        // Throws std::runtime_error if the file cannot be opened or is not a checkpoint of the current version
+        void open(const std::string& fileName);
+        void close();
+
+        uint64_t readUInt();
+        int64_t readInt();
+        double readDouble();
+        bool readBool() { return readUInt() != 0; };
+        std::string readString();
+
+        // Objects must be added in the order of their ids, as soon as they are read
+        void addObject(void *object) { _objects.push_back(object); };
+        bool isNewObject(uint64_t id) const { return id == _objects.size() + 1; };
+        void *getObject(uint64_t id) const;
+
+    private:
+        void read(void *data, size_t size);
+
+        gzFile _file = nullptr;
+        std::vector<void *> _objects;
+};
+
+#endif
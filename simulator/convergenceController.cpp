@@ -0,0 +1,210 @@
+#include "globals.h"
+#include "batchMeans.h"
+#include "checkpoint.h"
+#include <cmath>
+
+// Why a run ended, recorded as the terminationReason scalar
+enum TerminationReason {
+    TERMINATION_END_OF_RUN, // the workload or a time/event limit ended the run before the metrics converged
+    TERMINATION_CONVERGED // every metric was within the configured precision
+};
+
+// Metrics watched by the controller, in the order they are reported
+enum ConvergenceMetric { METRIC_GOODPUT, METRIC_COMPLETED_RATE, METRIC_FAILED_RATE, NUM_METRICS };
+
+// Splits the run in batches of batchLength simulated seconds and keeps, per metric, the means of the last batches: the
+// goodput of the payments that ended in the batch (completed over completed, failed and canceled, as paymentGoodputAll)
+// and the completed and failed payments per simulated second. The batch goodput is computed from the batch's own
+// counts rather than from the running ratios the nodes emit, which are strongly autocorrelated and would make the
+// intervals far too narrow. Once the confidence interval of every metric is narrower than the configured precision,
+// the run ends (Cmdenv then moves on to the next run, if any).
+class ConvergenceController : public cSimpleModule, public cListener, public Checkpointable {
+
+    public:
+        virtual ~ConvergenceController();
+        virtual void writeCheckpoint(CheckpointWriter& writer) override;
+        virtual void readCheckpoint(CheckpointReader& reader) override;
+        virtual cMessage *getCheckpointTimer(const std::string& name) override;
+
+    protected:
+        virtual void initialize() override;
+        virtual void handleMessage(cMessage *msg) override;
+        virtual void finish() override;
+
+        using cListener::receiveSignal;
+        virtual void receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) override;
+
+    private:
+        void closeBatch();
+        bool hasConverged();
+
+        cMessage *_batchTimer = nullptr;
+        cModule *_network = nullptr; // where the listener is subscribed
+        simsignal_t _completedSignal;
+        simsignal_t _failedSignal;
+        simsignal_t _canceledSignal;
+
+        simtime_t _batchLength;
+        double _precision = 0;
+        double _confidence = 0;
+        simtime_t _minTime;
+
+        // Payments that ended in the current batch
+        uint64_t _completed = 0;
+        uint64_t _failed = 0;
+        uint64_t _canceled = 0;
+
+        BatchMeans _metrics[NUM_METRICS];
+        int _numBatches = 0;
+        TerminationReason _reason = TERMINATION_END_OF_RUN;
+};
+
+Define_Module(ConvergenceController);
+
+ConvergenceController::~ConvergenceController() {
+    if (_batchTimer != nullptr && _batchTimer->isScheduled())
+        numStatisticsTimers--;
+    cancelAndDelete(_batchTimer);
+    if (_network != nullptr) {
+        _network->unsubscribe(_completedSignal, this);
+        _network->unsubscribe(_failedSignal, this);
+        _network->unsubscribe(_canceledSignal, this);
+    }
+}
+
+void ConvergenceController::initialize() {
+
+    if (!par("enabled").boolValue())
+        return;
+    if (numPartitions > 1)
+        throw cRuntimeError("The convergence controller only sees its own partition, so it cannot be used in parallel runs");
+
+    _batchLength = par("batchLength").doubleValue();
+    _precision = par("precision").doubleValue();
+    _confidence = par("confidence").doubleValue();
+    _minTime = par("minTime").doubleValue();
+    if (_batchLength <= 0)
+        throw cRuntimeError("batchLength must be positive");
+    if (_confidence <= 0 || _confidence >= 1)
+        throw cRuntimeError("confidence must be between 0 and 1");
+    try {
+        for (auto& metric : _metrics)
+            metric.setWindow(par("windowBatches").intValue());
+    } catch (const std::exception& e) {
+        throw cRuntimeError("%s", e.what());
+    }
+
+    // Signals emitted by the nodes propagate up to the network
+    _completedSignal = registerSignal("completedPayments");
+    _failedSignal = registerSignal("failedPayments");
+    _canceledSignal = registerSignal("canceledPayments");
+    _network = getSystemModule();
+    _network->subscribe(_completedSignal, this);
+    _network->subscribe(_failedSignal, this);
+    _network->subscribe(_canceledSignal, this);
+
+    // Payments are only counted after the warm-up (see inWarmup), so that is where the first batch starts
+    _batchTimer = new cMessage("convergenceBatch");
+    if (restoringCheckpoint)
+        return;
+    scheduleAt(getSimulation()->getWarmupPeriod() + _batchLength, _batchTimer);
+    numStatisticsTimers++;
+}
+
+void ConvergenceController::receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) {
+    // Nodes emit their own running counts, so every emission is one payment
+    if (signalID == _completedSignal)
+        _completed++;
+    else if (signalID == _failedSignal)
+        _failed++;
+    else if (signalID == _canceledSignal)
+        _canceled++;
+}
+
+void ConvergenceController::handleMessage(cMessage *msg) {
+    if (msg != _batchTimer)
+        throw cRuntimeError("This module does not process messages.");
+
+    numStatisticsTimers--;
+    closeBatch();
+
+    if (simTime() >= _minTime && hasConverged()) {
+        _reason = TERMINATION_CONVERGED;
+        EV_INFO << "Payment metrics converged after " << _numBatches << " batches, ending the run at t=" << simTime() << "\n";
+        endSimulation();
+    }
+
+    // Like the other statistics timers, batches go on only while there are other events
+    if (getSimulation()->getFES()->getLength() > numStatisticsTimers) {
+        scheduleAt(simTime() + _batchLength, _batchTimer);
+        numStatisticsTimers++;
+    }
+}
+
+void ConvergenceController::closeBatch() {
+
+    double length = _batchLength.dbl();
+    // A batch in which no payment ended says nothing about the goodput
+    uint64_t ended = _completed + _failed + _canceled;
+    if (ended > 0)
+        _metrics[METRIC_GOODPUT].addBatch(double(_completed) / ended);
+    _metrics[METRIC_COMPLETED_RATE].addBatch(_completed / length);
+    _metrics[METRIC_FAILED_RATE].addBatch(_failed / length);
+    _numBatches++;
+
+    _completed = 0;
+    _failed = 0;
+    _canceled = 0;
+}
+
+bool ConvergenceController::hasConverged() {
+    // A metric that stayed at 0 over the whole window (e.g. no failures) has a zero-width interval and counts as converged
+
+    for (const auto& metric : _metrics) {
+        if (!metric.isFull())
+            return false;
+        if (metric.getHalfWidth(_confidence) > _precision * std::fabs(metric.getMean()))
+            return false;
+    }
+    return true;
+}
+
+void ConvergenceController::writeCheckpoint(CheckpointWriter& writer) {
+    // Written whether or not the controller is enabled, so a checkpoint can be restored with either setting
+
+    writer.writeUInt(_completed);
+    writer.writeUInt(_failed);
+    writer.writeUInt(_canceled);
+    for (const auto& metric : _metrics)
+        metric.writeTo(writer);
+    writer.writeInt(_numBatches);
+}
+
+void ConvergenceController::readCheckpoint(CheckpointReader& reader) {
+
+    _completed = reader.readUInt();
+    _failed = reader.readUInt();
+    _canceled = reader.readUInt();
+    for (auto& metric : _metrics)
+        metric.readFrom(reader);
+    _numBatches = reader.readInt();
+}
+
+cMessage *ConvergenceController::getCheckpointTimer(const std::string& name) {
+    return _batchTimer != nullptr && name == _batchTimer->getName() ? _batchTimer : nullptr;
+}
+
+void ConvergenceController::finish() {
+
+    if (!par("enabled").boolValue())
+        return;
+
+    static const char *metricNames[NUM_METRICS] = {"paymentGoodputAll", "completedRate", "failedRate"};
+    recordScalar("terminationReason", _reason);
+    recordScalar("terminationTime", simTime().dbl(), "s");
+    recordScalar("batches", _numBatches);
+    for (int i = 0; i < NUM_METRICS; i++) {
+        recordScalar((std::string(metricNames[i]) + ":mean").c_str(), _metrics[i].getMean());
+        recordScalar((std::string(metricNames[i]) + ":halfWidth").c_str(), _metrics[i].getHalfWidth(_confidence));
+    }
+}
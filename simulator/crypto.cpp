@@ -5,8 +5,9 @@
 #include <ctime>
 #include <unistd.h>
 #include <random>
+#include <cstring>
 
-#include "globals.h"
+#include "crypto.h"
 
 using namespace std;
 
@@ -27,9 +28,8 @@ string sha256(const string str)
     return ss.str();
 }
 
-string generatePreImage() {
-    std::random_device rd;
-    std::default_random_engine gen(rd());
+string generatePreImage(uint64_t seed) {
+    std::mt19937_64 gen(seed);
 
     const char charset[] =
         "0123456789"
@@ -48,5 +48,7 @@ string generatePreImage() {
     return preImage;
 }
 
-
-
+string generatePreImage() {
+    std::random_device rd;
+    return generatePreImage(((uint64_t) rd() << 32) | rd());
+}
@@ -1,7 +1,14 @@
 #ifndef _CRYPTO_H_
 #define _CRYPTO_H_
 
+#include <cstdint>
+#include <string>
+
+#define PREIMAGE_SIZE 32
+
 std::string sha256 (const std::string);
 std::string generatePreImage();
+// Same, drawn from the given seed (used by the simulation so payment hashes are reproducible)
+std::string generatePreImage(uint64_t seed);
 
 #endif
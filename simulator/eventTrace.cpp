@@ -0,0 +1,126 @@
+#include <cstring>
+#include <stdexcept>
+#include "eventTrace.h"
+
+namespace {
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return 0;
+}
+
+} // namespace
+
+const char* getTraceEventName(int event) {
+    static const char *names[] = {"PENDING", "WAITING_FOR_ACK", "COMMITTED", "REFUSED", "FAILED", "FULFILLED", "CANCELED"};
+    return (event >= TRACE_PENDING && event <= TRACE_CANCELED) ? names[event] : "UNKNOWN";
+}
+
+void EventTrace::open(const std::string& fileName, size_t bufferRecords) {
+
+    close();
+    if (bufferRecords == 0)
+        throw std::runtime_error("the trace buffer must hold at least one record");
+
+    // Level 1 keeps compression well ahead of the simulation
+    _file = gzopen(fileName.c_str(), "wb1");
+    if (_file == nullptr)
+        throw std::runtime_error("could not open trace file " + fileName);
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.recordSize = sizeof(TraceRecord);
+    if (gzwrite(_file, &header, sizeof(header)) != (int) sizeof(header)) {
+        gzclose(_file);
+        _file = nullptr;
+        throw std::runtime_error("could not write trace file " + fileName);
+    }
+
+    _bufferRecords = bufferRecords;
+    _buffer.reserve(bufferRecords);
+    _writing.reserve(bufferRecords);
+    _hasWriting = false;
+    _stopping = false;
+    _writeFailed = false;
+    _writer = std::thread(&EventTrace::writerLoop, this);
+    _enabled = true;
+}
+
+void EventTrace::close() {
+
+    if (!_enabled)
+        return;
+    _enabled = false;
+
+    if (!_buffer.empty())
+        handOver();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _condition.notify_all();
+    _writer.join();
+
+    bool failed = _writeFailed || gzclose(_file) != Z_OK;
+    _file = nullptr;
+    _buffer = std::vector<TraceRecord>();
+    _writing = std::vector<TraceRecord>();
+    if (failed)
+        throw std::runtime_error("could not write the event trace");
+}
+
+void EventTrace::record(double time, int nodeId, int neighborId, const std::string& paymentHash, int htlcType, double value, TraceEvent event) {
+
+    TraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.time = time;
+    record.value = value;
+    record.nodeId = nodeId;
+    record.neighborId = neighborId;
+    record.htlcType = htlcType;
+    record.event = event;
+    for (size_t i = 0; i < sizeof(record.paymentHash) && 2 * i + 1 < paymentHash.size(); i++)
+        record.paymentHash[i] = (hexValue(paymentHash[2 * i]) << 4) | hexValue(paymentHash[2 * i + 1]);
+
+    _buffer.push_back(record);
+    if (_buffer.size() >= _bufferRecords)
+        handOver();
+}
+
+void EventTrace::handOver() {
+    // Swaps the full buffer with the one the writer has finished (the simulation only waits if the writer is behind)
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _condition.wait(lock, [this] { return !_hasWriting; });
+    _buffer.swap(_writing);
+    _hasWriting = true;
+    lock.unlock();
+    _condition.notify_all();
+}
+
+void EventTrace::writerLoop() {
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _condition.wait(lock, [this] { return _hasWriting || _stopping; });
+        if (!_hasWriting)
+            return;
+
+        lock.unlock();
+        unsigned int bytes = _writing.size() * sizeof(TraceRecord);
+        bool failed = gzwrite(_file, _writing.data(), bytes) != (int) bytes;
+        _writing.clear();
+        lock.lock();
+
+        _writeFailed = _writeFailed || failed;
+        _hasWriting = false;
+        _condition.notify_all();
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef _EVENTTRACE_H_
+#define _EVENTTRACE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+#define TRACE_MAGIC "PCNTRACE"
+#define TRACE_VERSION 1
+
+// HTLC state transitions recorded in the trace
+enum TraceEvent {
+    TRACE_PENDING, // HTLC queued on a channel, waiting for the next commitment
+    TRACE_WAITING_FOR_ACK, // HTLC sent in a COMMITMENT_SIGNED, waiting for the REVOKE_AND_ACK
+    TRACE_COMMITTED, // HTLC committed on a channel
+    TRACE_REFUSED, // payment refused by a hop for lack of capacity towards the next hop
+    TRACE_FAILED, // payment failed, recorded at the payer
+    TRACE_FULFILLED, // payment completed, recorded at the payer
+    TRACE_CANCELED // payment canceled by the payer before any HTLC was sent
+};
+
+const char* getTraceEventName(int event);
+
+// Trace files are gzip streams holding a TraceHeader followed by TraceRecords, both little-endian
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+struct TraceRecord {
+    double time; // simulation time, in seconds
+    double value;
+    int32_t nodeId; // node where the transition happened
+    int32_t neighborId; // other end of the channel (-1 if none)
+    int16_t htlcType; // UPDATE_ADD_HTLC, UPDATE_FULFILL_HTLC or UPDATE_FAIL_HTLC (0 for payment-level events)
+    uint8_t event; // TraceEvent
+    uint8_t reserved[5];
+    uint8_t paymentHash[32]; // the HTLC key is (paymentHash, htlcType)
+};
+
+static_assert(sizeof(TraceRecord) == 64, "trace records must stay fixed-size");
+
+// Buffers trace records in memory and hands full buffers to a background thread that compresses them to the trace
+// file, so recording a transition costs a copy into the buffer.
+class EventTrace {
+
+    public:
+        ~EventTrace() { try { close(); } catch (const std::exception&) {} };
+
+        // Throws std::runtime_error if the file cannot be opened
+        void open(const std::string& fileName, size_t bufferRecords);
+        // Writes out the buffered records and waits for the writer. Throws std::runtime_error if a write failed.
+        void close();
+        bool isEnabled() const { return _enabled; };
+
+        // paymentHash is the hex SHA-256 of the preimage
+        void record(double time, int nodeId, int neighborId, const std::string& paymentHash, int htlcType, double value, TraceEvent event);
+
+    private:
+        void handOver();
+        void writerLoop();
+
+        bool _enabled = false;
+        gzFile _file = nullptr;
+        size_t _bufferRecords = 0;
+        std::vector<TraceRecord> _buffer; // filled by the simulation
+        std::vector<TraceRecord> _writing; // being compressed by the writer
+        bool _hasWriting = false;
+        bool _stopping = false;
+        bool _writeFailed = false;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        std::thread _writer;
+};
+
+#endif
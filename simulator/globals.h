@@ -1,21 +1,84 @@
+#ifndef _GLOBALS_H_
+#define _GLOBALS_H_
+
 #include <stdio.h>
 #include <omnetpp.h>
 #include <fstream>
 #include <string>
 #include <map>
+#include <set>
+#include "topologyCache.h"
+#include "channelSnapshot.h"
+#include "latencyHistogram.h"
+#include "profiler.h"
+#include "memoryReport.h"
+#include "eventTrace.h"
+#include "paymentTracer.h"
+#include "routeOracle.h"
 
 using namespace omnetpp;
 
+// Logging goes through the EV macros, which only evaluate their arguments if the level passes both the compile-time
+// threshold (COMPILETIME_LOGLEVEL, see makefrag) and the runtime one (cmdenv-log-level, everything off in express mode).
+// Work done only to build a log message outside an EV statement must be guarded with LOG_ENABLED.
+#define LOG_ENABLED(level) (COMPILETIME_LOG_PREDICATE(getThisPtr(), level, nullptr) && cLog::runtimeLogPredicate(getThisPtr(), level, nullptr))
+
+// Logs a line about a payment selected for tracing (NetBuilder.tracePayments/tracePaymentRate) on any node, regardless of
+// EV settings. Untraced payments only pay for the isEnabled check, so the argument is not even evaluated.
+#define PAYMENT_LOG(paymentHash) if (!paymentTracer.isEnabled() || !paymentTracer.isTraced(paymentHash)) ; else paymentTracer.log(simTime().dbl(), getFullName())
+
+// Statistics recorded by hand (latency histograms, payment counters and the signals derived from them) leave out the
+// warm-up period (warmup-period in the ini), like the results OMNeT++ records from signals
+inline bool inWarmup() { return simTime() < getSimulation()->getWarmupPeriod(); }
+
 // Set some macros
-#define PREIMAGE_SIZE 32
+#define MESSAGE_DISPLAY_STRING "b=0,0,rect,o=white,white,0\t" // what BaseMessages show unless given an icon (an invisible box)
 #define COMMITMENT_BATCH_SIZE 10
 #define ENABLE_FEES 1
 
 // Global structures
+extern bool headless; // skip presentation-only work (message names, display strings, bubbles, channel labels)
 extern cTopology *globalTopology;
 extern std::map<std::string, std::vector<std::tuple<std::string, double, simtime_t> > > pendingPayments;
+// Payer to (payee, value, time, index of the payment in pendingPayments[payee]), only filled in parallel runs
+extern std::map<std::string, std::vector<std::tuple<std::string, double, simtime_t, int> > > outgoingPayments;
 extern std::map<std::string, std::map<std::string, std::tuple <double, double, double, int, double, double, cGate*, cGate*> > > nameToPCs;
 extern std::map<std::string, std::vector<std::pair<std::string, std::vector<double> > > > adjMatrix;
+extern std::map<std::string, std::string> leafParents;
+extern TopologyCache topologyCache;
+
+// Parallel runs (each partition is a separate process with its own copy of these structures, built identically by
+// its NetBuilder, so they stay read-only during the run and the statistics below cover the local partition only)
+extern int numPartitions; // 1 in sequential runs
+extern int partitionId;
+
+// Channel statistics collection, configured in NetBuilder
+enum ChannelStatsMode { CHANNEL_STATS_FULL, CHANNEL_STATS_PERIODIC, CHANNEL_STATS_SAMPLED, CHANNEL_STATS_HISTOGRAM };
+extern ChannelStatsMode channelStatsMode;
+extern simtime_t channelStatsInterval;
+extern std::set<std::pair<std::string, std::string> > sampledChannels; // (node, neighbor) directions recorded in sampled mode
+extern int numStatisticsTimers; // periodic statistics self-messages in the FES, which alone must not keep a simulation running
+extern bool restoringCheckpoint; // the run continues from NetBuilder.restoreFile: modules create their timers but schedule nothing
+
+// Commitment fidelity, configured in NetBuilder (detailedChannels). HTLCs on detailed channels go through the
+// COMMITMENT_SIGNED/REVOKE_AND_ACK exchange; on the other channels both ends commit them as soon as a commitment would be sent.
+extern bool allChannelsDetailed;
+extern std::set<std::pair<std::string, std::string> > detailedChannels; // (node, neighbor) directions, unless allChannelsDetailed
 
 // Global statistics
-//extern
+extern LatencyHistogram networkPaymentLatency; // INVOICE received to fulfill committed at the payer, completed payments only
+extern LatencyHistogram networkCommitBatchingDelay; // HTLC queued to commitment sent, per hop
+extern LatencyHistogram networkLinkDelay; // message sent to message received, per hop
+
+extern HandlerProfiler handlerProfiler; // per message type event counts, wall-clock time and allocations
+extern MemoryReporter memoryReporter; // periodic entry counts and estimated bytes of every node's containers
+extern EventTrace eventTrace; // binary trace of HTLC state transitions (disabled unless NetBuilder.traceFile is set)
+extern PaymentTracer paymentTracer; // text log of the events of sampled payments
+extern RouteOracle routeOracle; // routes computed on worker threads ahead of simulated time (disabled unless NetBuilder.routeOracleThreads > 0)
+
+// Records count, mean, p50, p99, p999 and max of a latency histogram as scalars named <name>:<statistic>
+void recordLatencyScalars(cComponent *component, const std::string& name, const LatencyHistogram& histogram);
+// Records the event count, wall-clock time and allocations of every handler that ran as handler<Counter>:<MESSAGE_TYPE> scalars
+void recordHandlerScalars(cComponent *component, const HandlerProfile& profile);
+
+#endif
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "checkpointStream.h"
+#include "latencyHistogram.h"
+
+// Exponent range covered by the buckets (about 1e-12 to 1e12); values outside it are clamped to the first or last bucket
+#define MIN_EXPONENT -40
+#define MAX_EXPONENT 40
+
+LatencyHistogram::LatencyHistogram(int precisionBits) {
+    if (precisionBits < 1 || precisionBits > 16)
+        throw std::invalid_argument("histogram precision must be between 1 and 16 bits");
+    _precisionBits = precisionBits;
+    _subBuckets = 1 << precisionBits;
+}
+
+void LatencyHistogram::record(double value) {
+
+    if (_count == 0 || value < _min)
+        _min = value;
+    if (_count == 0 || value > _max)
+        _max = value;
+    _count++;
+    _sum += value;
+
+    if (value <= 0) {
+        _zeroCount++;
+        return;
+    }
+
+    // value = mantissa * 2^exponent, with mantissa in [0.5, 1)
+    int exponent;
+    double mantissa = frexp(value, &exponent);
+    if (exponent < MIN_EXPONENT) {
+        exponent = MIN_EXPONENT;
+        mantissa = 0.5;
+    } else if (exponent > MAX_EXPONENT) {
+        exponent = MAX_EXPONENT;
+        mantissa = 0.5;
+    }
+    int subBucket = std::min(int((mantissa - 0.5) * 2 * _subBuckets), _subBuckets - 1);
+    size_t index = size_t(exponent - MIN_EXPONENT) * _subBuckets + subBucket;
+
+    addToBucket(index, 1);
+}
+
+void LatencyHistogram::addToBucket(size_t index, uint64_t count) {
+    // Grows the bucket range to include index, so a histogram only holds the span of magnitudes it has seen
+
+    if (_counts.empty())
+        _firstBucket = index;
+    else if (index < _firstBucket) {
+        _counts.insert(_counts.begin(), _firstBucket - index, 0);
+        _firstBucket = index;
+    }
+    if (index - _firstBucket >= _counts.size())
+        _counts.resize(index - _firstBucket + 1, 0);
+    _counts[index - _firstBucket] += count;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    if (other._precisionBits != _precisionBits)
+        throw std::invalid_argument("cannot merge histograms with different precisions");
+    if (other._count == 0)
+        return;
+
+    if (_count == 0 || other._min < _min)
+        _min = other._min;
+    if (_count == 0 || other._max > _max)
+        _max = other._max;
+    _count += other._count;
+    _sum += other._sum;
+    _zeroCount += other._zeroCount;
+
+    if (!other._counts.empty()) {
+        // Covering both ends first means the loop never moves the buckets
+        addToBucket(other._firstBucket, 0);
+        addToBucket(other._firstBucket + other._counts.size() - 1, 0);
+        for (size_t i = 0; i < other._counts.size(); i++)
+            _counts[other._firstBucket + i - _firstBucket] += other._counts[i];
+    }
+}
+
+void LatencyHistogram::clear() {
+    _counts.clear();
+    _firstBucket = 0;
+    _zeroCount = 0;
+    _count = 0;
+    _sum = 0;
+    _min = 0;
+    _max = 0;
+}
+
+double LatencyHistogram::getBucketValue(size_t index) const {
+    // Midpoint of the bucket
+    int exponent = int(index / _subBuckets) + MIN_EXPONENT;
+    int subBucket = index % _subBuckets;
+    return ldexp(0.5 + (subBucket + 0.5) / (2 * _subBuckets), exponent);
+}
+
+double LatencyHistogram::getQuantile(double fraction) const {
+    if (_count == 0)
+        return 0;
+
+    uint64_t rank = std::max<uint64_t>(1, uint64_t(ceil(fraction * _count)));
+    uint64_t seen = _zeroCount;
+    if (seen >= rank)
+        return std::max(_min, 0.0);
+
+    for (size_t i = 0; i < _counts.size(); i++) {
+        seen += _counts[i];
+        if (seen >= rank)
+            return std::min(std::max(getBucketValue(_firstBucket + i), _min), _max);
+    }
+    return _max;
+}
+
+void LatencyHistogram::writeTo(CheckpointWriter& writer) const {
+    writer.writeUInt(_precisionBits);
+    writer.writeUInt(_firstBucket);
+    writer.writeUInt(_counts.size());
+    for (uint64_t count : _counts)
+        writer.writeUInt(count);
+    writer.writeUInt(_zeroCount);
+    writer.writeUInt(_count);
+    writer.writeDouble(_sum);
+    writer.writeDouble(_min);
+    writer.writeDouble(_max);
+}
+
+void LatencyHistogram::readFrom(CheckpointReader& reader) {
+    if ((int) reader.readUInt() != _precisionBits)
+        throw std::runtime_error("the checkpoint holds a histogram with a different precision");
+    // The bucket range is checked before it is allocated, since it comes from the file
+    uint64_t numBuckets = uint64_t(MAX_EXPONENT - MIN_EXPONENT + 1) * _subBuckets;
+    uint64_t firstBucket = reader.readUInt();
+    uint64_t size = reader.readUInt();
+    if (firstBucket >= numBuckets || size > numBuckets - firstBucket)
+        throw std::runtime_error("the checkpoint holds a corrupt histogram");
+    _firstBucket = firstBucket;
+    _counts.resize(size);
+    for (auto& count : _counts)
+        count = reader.readUInt();
+    _zeroCount = reader.readUInt();
+    _count = reader.readUInt();
+    _sum = reader.readDouble();
+    _min = reader.readDouble();
+    _max = reader.readDouble();
+}
@@ -0,0 +1,51 @@
+#ifndef _LATENCYHISTOGRAM_H_
+#define _LATENCYHISTOGRAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CheckpointWriter;
+class CheckpointReader;
+
+// Log-linear (HDR-style) histogram of non-negative values. Every power of two is split into 2^precisionBits linear
+// sub-buckets, so quantiles have a relative error below 2^-precisionBits whatever the magnitude of the values, and
+// recording a value is a frexp plus an increment.
+class LatencyHistogram {
+
+    public:
+        LatencyHistogram(int precisionBits = 7);
+
+        void record(double value);
+        void merge(const LatencyHistogram& other);
+        void clear();
+
+        uint64_t getCount() const { return _count; };
+        double getMin() const { return _count > 0 ? _min : 0; };
+        double getMax() const { return _count > 0 ? _max : 0; };
+        double getMean() const { return _count > 0 ? _sum/_count : 0; };
+        // Value below which the given fraction (0 to 1) of the recorded values falls
+        double getQuantile(double fraction) const;
+
+        // Checkpoints (see checkpoint.h)
+        void writeTo(CheckpointWriter& writer) const;
+        void readFrom(CheckpointReader& reader);
+
+    private:
+        int _precisionBits;
+        int _subBuckets;
+        // Buckets from the lowest to the highest one recorded so far. Bucket index is (exponent - MIN_EXPONENT) *
+        // _subBuckets + subBucket, and _counts[i] holds bucket _firstBucket + i.
+        std::vector<uint64_t> _counts;
+        size_t _firstBucket = 0;
+        uint64_t _zeroCount = 0; // values <= 0
+        uint64_t _count = 0;
+        double _sum = 0;
+        double _min = 0;
+        double _max = 0;
+
+        double getBucketValue(size_t index) const;
+        void addToBucket(size_t index, uint64_t count);
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <jsoncpp/json/reader.h>
+#include "lndGraph.h"
+
+/***********************************************************************************************************************/
+/* readLndGraph imports a snapshot produced by LND's `lncli describegraph`. The file is scanned in fixed-size chunks    */
+/* and only one element of the top-level "nodes" and "edges" arrays is held in memory (and handed to jsoncpp) at a     */
+/* time, so memory stays bounded by the size of the resulting edge list instead of the size of the JSON document.      */
+/***********************************************************************************************************************/
+
+namespace {
+
+enum SnapshotSection { NONE, NODES, EDGES };
+
+double toDouble(const Json::Value& value) {
+    // LND encodes 64-bit integers as strings, so accept both representations
+    if (value.isString())
+        return atof(value.asCString());
+    else if (value.isNumeric())
+        return value.asDouble();
+    else
+        return 0;
+}
+
+bool isUsablePolicy(const Json::Value& policy) {
+    return policy.isObject() && !policy.get("disabled", false).asBool();
+}
+
+class LndGraphImporter {
+
+    public:
+        LndGraphImporter(const LndGraphOptions& options, LndGraphSummary& summary) : _options(options), _summary(summary) {};
+
+        void addNode(const Json::Value& node);
+        void addChannel(const Json::Value& channel);
+        void writeNodeMap() const;
+        std::vector<TopologyEdge>& getEdges() { return _edges; };
+
+    private:
+        const LndGraphOptions& _options;
+        LndGraphSummary& _summary;
+        std::map<std::string, int> _pubKeyToId;
+        std::vector<std::pair<std::string, std::string> > _idToNode; // id to (pubKey, alias)
+        std::vector<TopologyEdge> _edges;
+        std::map<std::pair<int, int>, size_t> _edgeIndex; // (srcId, dstId) to its position in _edges
+
+        int getNodeId(const std::string& pubKey);
+        TopologyEdge makeEdge(int srcId, int dstId, double channelCapacity, const Json::Value& policy) const;
+        void addEdge(const TopologyEdge& edge);
+};
+
+int LndGraphImporter::getNodeId(const std::string& pubKey) {
+    // Assigns consecutive ids in order of appearance
+    auto it = _pubKeyToId.find(pubKey);
+    if (it != _pubKeyToId.end())
+        return it->second;
+
+    int nodeId = _idToNode.size();
+    _pubKeyToId[pubKey] = nodeId;
+    _idToNode.push_back(std::make_pair(pubKey, ""));
+    _summary.numNodes++;
+    return nodeId;
+}
+
+void LndGraphImporter::addNode(const Json::Value& node) {
+    int nodeId = getNodeId(node.get("pub_key", "").asString());
+    _idToNode[nodeId].second = node.get("alias", "").asString();
+}
+
+TopologyEdge LndGraphImporter::makeEdge(int srcId, int dstId, double channelCapacity, const Json::Value& policy) const {
+    // Public gossip does not reveal balances, so each direction starts with half of the channel capacity
+    TopologyEdge edge;
+    edge.srcId = srcId;
+    edge.dstId = dstId;
+    edge.capacity = channelCapacity/2 * _options.satoshiScale;
+    // Only the base fee fits the simulator's flat per-channel fee; fee_rate_milli_msat is left out
+    edge.fee = toDouble(policy["fee_base_msat"])/1000 * _options.satoshiScale;
+    edge.linkQuality = 1;
+    edge.maxAcceptedHTLCs = _options.maxAcceptedHTLCs;
+    edge.HTLCMinimumMsat = toDouble(policy["min_htlc"])/1000 * _options.satoshiScale;
+    edge.channelReserveSatoshis = channelCapacity * _options.reserveRatio * _options.satoshiScale;
+    edge.linkDelay = _options.linkDelay;
+    return edge;
+}
+
+void LndGraphImporter::addEdge(const TopologyEdge& edge) {
+    // A parallel channel between the same nodes is merged into the first one, which keeps its position in the edge list
+
+    auto it = _edgeIndex.find(std::make_pair(edge.srcId, edge.dstId));
+    if (it == _edgeIndex.end()) {
+        _edgeIndex[std::make_pair(edge.srcId, edge.dstId)] = _edges.size();
+        _edges.push_back(edge);
+        return;
+    }
+
+    TopologyEdge& merged = _edges[it->second];
+    merged.capacity += edge.capacity;
+    merged.channelReserveSatoshis += edge.channelReserveSatoshis;
+    merged.fee = std::max(merged.fee, edge.fee);
+    merged.HTLCMinimumMsat = std::max(merged.HTLCMinimumMsat, edge.HTLCMinimumMsat);
+    merged.maxAcceptedHTLCs = std::min(merged.maxAcceptedHTLCs, edge.maxAcceptedHTLCs);
+}
+
+void LndGraphImporter::addChannel(const Json::Value& channel) {
+    // The simulator needs both directions of a channel (fulfills and fails travel back through it), so channels
+    // with a missing or disabled policy on either side are skipped
+    const Json::Value& node1Policy = channel["node1_policy"];
+    const Json::Value& node2Policy = channel["node2_policy"];
+    double capacity = toDouble(channel["capacity"]);
+
+    if (!isUsablePolicy(node1Policy) || !isUsablePolicy(node2Policy) || capacity <= 0) {
+        _summary.numSkippedChannels++;
+        return;
+    }
+
+    int node1Id = getNodeId(channel.get("node1_pub", "").asString());
+    int node2Id = getNodeId(channel.get("node2_pub", "").asString());
+    if (node1Id == node2Id) {
+        _summary.numSkippedChannels++;
+        return;
+    }
+
+    // Both directions of a channel are merged or added together
+    if (_edgeIndex.find(std::make_pair(node1Id, node2Id)) != _edgeIndex.end())
+        _summary.numMergedChannels++;
+    else
+        _summary.numChannels++;
+
+    // nodeX_policy holds the fees nodeX charges to forward through the channel, i.e. in the nodeX -> nodeY direction
+    addEdge(makeEdge(node1Id, node2Id, capacity, node1Policy));
+    addEdge(makeEdge(node2Id, node1Id, capacity, node2Policy));
+}
+
+void LndGraphImporter::writeNodeMap() const {
+    if (_options.nodeMapFile.empty())
+        return;
+
+    std::ofstream nodeMapFile(_options.nodeMapFile, std::ofstream::out);
+    if (!nodeMapFile)
+        throw std::runtime_error("could not open node map file " + _options.nodeMapFile);
+
+    nodeMapFile << "# id pub_key alias\n";
+    for (size_t i = 0; i < _idToNode.size(); i++)
+        nodeMapFile << i << " " << _idToNode[i].first << " " << _idToNode[i].second << "\n";
+}
+
+} // namespace
+
+std::vector<TopologyEdge> readLndGraph(const std::string& fileName, const LndGraphOptions& options, LndGraphSummary& summary) {
+
+    std::ifstream snapshotFile(fileName, std::ifstream::in | std::ifstream::binary);
+    if (!snapshotFile)
+        throw std::runtime_error("could not open LND graph snapshot " + fileName);
+
+    LndGraphImporter importer(options, summary);
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+
+    // Scanner state. Depth counts open objects and arrays; the top-level object is depth 1.
+    int depth = 0;
+    bool inString = false;
+    bool escaped = false;
+    std::string token; // last string seen at depth 1 (top-level keys)
+    std::string lastKey;
+    SnapshotSection section = NONE;
+    bool capturing = false;
+    std::string element; // text of the array element currently being captured
+
+    std::vector<char> buffer(1 << 16);
+    while (snapshotFile) {
+        snapshotFile.read(buffer.data(), buffer.size());
+        std::streamsize numRead = snapshotFile.gcount();
+
+        for (std::streamsize i = 0; i < numRead; i++) {
+            char c = buffer[i];
+            if (capturing)
+                element.push_back(c);
+
+            if (inString) {
+                if (escaped)
+                    escaped = false;
+                else if (c == '\\')
+                    escaped = true;
+                else if (c == '"')
+                    inString = false;
+                else if (depth == 1)
+                    token.push_back(c);
+                continue;
+            }
+
+            switch (c) {
+                case '"': {
+                    inString = true;
+                    if (depth == 1)
+                        token.clear();
+                    break;
+                }
+                case ':': {
+                    if (depth == 1)
+                        lastKey = token;
+                    break;
+                }
+                case '{':
+                case '[': {
+                    if (depth == 2 && section != NONE && c == '{') {
+                        capturing = true;
+                        element = "{";
+                    }
+                    depth++;
+                    if (depth == 2 && c == '[')
+                        section = (lastKey == "nodes") ? NODES : (lastKey == "edges") ? EDGES : NONE;
+                    break;
+                }
+                case '}':
+                case ']': {
+                    depth--;
+                    if (capturing && depth == 2) {
+                        capturing = false;
+                        Json::Value value;
+                        std::string errors;
+                        if (!reader->parse(element.data(), element.data() + element.size(), &value, &errors))
+                            throw std::runtime_error("malformed element in LND graph snapshot: " + errors);
+                        if (section == NODES)
+                            importer.addNode(value);
+                        else
+                            importer.addChannel(value);
+                    }
+                    if (depth == 1)
+                        section = NONE;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (depth != 0 || inString)
+        throw std::runtime_error("truncated LND graph snapshot " + fileName);
+
+    importer.writeNodeMap();
+    return std::move(importer.getEdges());
+}
@@ -0,0 +1,30 @@
+#ifndef _LNDGRAPH_H_
+#define _LNDGRAPH_H_
+
+#include <string>
+#include <vector>
+#include "topology.h"
+
+// Parameters used to map an LND snapshot onto the simulator's channel model
+struct LndGraphOptions {
+    double satoshiScale = 1;        // multiplier applied to every satoshi amount (capacity, fees, HTLC minimum, reserve)
+    double linkDelay = 100;         // link delay assigned to every channel direction
+    double reserveRatio = 0.01;     // channel reserve as a fraction of the channel capacity (LND default)
+    int maxAcceptedHTLCs = 483;     // not announced in gossip, so we use the BOLT#2 maximum
+    std::string nodeMapFile = "";   // if set, the node id to public key mapping is written here
+};
+
+// Counters describing what was imported from (or skipped in) the snapshot
+struct LndGraphSummary {
+    int numNodes = 0;
+    int numChannels = 0;
+    int numSkippedChannels = 0;
+    int numMergedChannels = 0; // parallel channels folded into an earlier channel between the same nodes
+};
+
+// The simulator has one channel per pair of nodes, so parallel channels are merged: capacities and reserves add up and
+// each direction takes the worst policy of the merged channels (highest fee and HTLC minimum). Channels also carry a
+// single flat fee, which is the policy's base fee; the proportional fee (fee_rate_milli_msat) is not imported.
+std::vector<TopologyEdge> readLndGraph(const std::string& fileName, const LndGraphOptions& options, LndGraphSummary& summary);
+
+#endif
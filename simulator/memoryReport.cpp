@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <stdexcept>
+#include "memoryReport.h"
+#include "PaymentChannel.h"
+
+const char* getMemoryContainerName(int container) {
+    static const char *names[NUM_MEMORY_CONTAINERS] = {"inFlights", "pendingHTLCs", "pendingHTLCsFIFO",
+            "HTLCsWaitingForAck", "committedHTLCs", "committedHTLCsFIFO", "previousHopUp", "previousHopDown",
+            "myPreImages", "myInFlights", "myPayments", "myStoredMessages", "senderModules", "paymentStartTimes",
+            "signals", "scheduledSelfMessages", "futureEvents"};
+    return (container >= 0 && container < NUM_MEMORY_CONTAINERS) ? names[container] : "unknown";
+}
+
+uint64_t getTotalBytes(const MemoryUsage& usage) {
+    uint64_t bytes = 0;
+    for (const auto& counters : usage)
+        bytes += counters.bytes;
+    return bytes;
+}
+
+uint64_t estimateHTLCBytes(HTLC *htlc) {
+    return sizeof(HTLC) + heapBytes(htlc->_htlcId) + heapBytes(htlc->_source) + heapBytes(htlc->_paymentHash)
+            + heapBytes(htlc->_preImage) + heapBytes(htlc->_errorReason);
+}
+
+void accountPaymentChannel(const PaymentChannel& channel, MemoryUsage& usage) {
+    // The maps and waiting lists only hold pointers; HTLC objects are counted once, in the FIFO that holds them
+
+    accountMap(usage[MEMORY_IN_FLIGHTS], channel._inFlights);
+    accountMap(usage[MEMORY_PENDING_HTLCS], channel._pendingHTLCs);
+    accountDeque(usage[MEMORY_PENDING_HTLCS_FIFO], channel._pendingHTLCsFIFO);
+    for (const auto& htlc : channel._pendingHTLCsFIFO)
+        usage[MEMORY_PENDING_HTLCS_FIFO].bytes += estimateHTLCBytes(htlc);
+    accountMap(usage[MEMORY_HTLCS_WAITING_FOR_ACK], channel._HTLCsWaitingForAck);
+    accountMap(usage[MEMORY_COMMITTED_HTLCS], channel._committedHTLCs);
+    accountDeque(usage[MEMORY_COMMITTED_HTLCS_FIFO], channel._committedHTLCsFIFO);
+    for (const auto& htlc : channel._committedHTLCsFIFO)
+        usage[MEMORY_COMMITTED_HTLCS_FIFO].bytes += estimateHTLCBytes(htlc);
+    accountMap(usage[MEMORY_PREVIOUS_HOP_UP], channel._previousHopUp);
+    accountMap(usage[MEMORY_PREVIOUS_HOP_DOWN], channel._previousHopDown);
+}
+
+void MemoryReporter::configure(bool enabled, const std::string& fileName, const std::string& format, bool perNode) {
+
+    if (format != "json" && format != "csv")
+        throw std::invalid_argument("unknown memory report format `" + format + "'");
+
+    _enabled = enabled;
+    _json = (format == "json");
+    _perNode = perNode;
+    _networkUsage = MemoryUsage();
+    _peakBytes = 0;
+
+    if (_file.is_open())
+        _file.close();
+    if (!enabled || fileName.empty())
+        return;
+
+    _file.open(fileName, std::ofstream::out | std::ofstream::trunc);
+    if (!_file)
+        throw std::runtime_error("could not open memory report file " + fileName);
+    if (!_json)
+        _file << "simTime,node,container,entries,bytes\n";
+}
+
+void MemoryReporter::beginReport(double simTime) {
+    _simTime = simTime;
+    _numNodes = 0;
+    _networkUsage = MemoryUsage();
+}
+
+void MemoryReporter::addNode(const std::string& nodeName, const MemoryUsage& usage) {
+    _numNodes++;
+    for (int i = 0; i < NUM_MEMORY_CONTAINERS; i++) {
+        _networkUsage[i].entries += usage[i].entries;
+        _networkUsage[i].bytes += usage[i].bytes;
+    }
+    if (_perNode)
+        write(nodeName, usage);
+}
+
+void MemoryReporter::endReport(uint64_t futureEvents, uint64_t futureEventBytes) {
+    _networkUsage[MEMORY_FUTURE_EVENTS].entries = futureEvents;
+    _networkUsage[MEMORY_FUTURE_EVENTS].bytes = futureEventBytes;
+    _peakBytes = std::max(_peakBytes, getTotalBytes(_networkUsage));
+    write("network", _networkUsage);
+}
+
+void MemoryReporter::write(const std::string& nodeName, const MemoryUsage& usage) {
+
+    if (!_file.is_open())
+        return;
+
+    // One JSON object per line (JSON Lines) or one CSV row per container
+    if (_json) {
+        _file << "{\"simTime\":" << _simTime << ",\"node\":\"" << nodeName << "\"";
+        if (nodeName == "network")
+            _file << ",\"nodes\":" << _numNodes;
+        _file << ",\"totalBytes\":" << getTotalBytes(usage) << ",\"containers\":{";
+        for (int i = 0; i < NUM_MEMORY_CONTAINERS; i++) {
+            _file << (i > 0 ? "," : "") << "\"" << getMemoryContainerName(i) << "\":{\"entries\":" << usage[i].entries
+                    << ",\"bytes\":" << usage[i].bytes << "}";
+        }
+        _file << "}}\n";
+    } else {
+        for (int i = 0; i < NUM_MEMORY_CONTAINERS; i++) {
+            _file << _simTime << "," << nodeName << "," << getMemoryContainerName(i) << "," << usage[i].entries << ","
+                    << usage[i].bytes << "\n";
+        }
+    }
+    if (nodeName == "network")
+        _file.flush();
+}
@@ -0,0 +1,119 @@
+#ifndef _MEMORYREPORT_H_
+#define _MEMORYREPORT_H_
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+class HTLC;
+class PaymentChannel;
+
+// Containers whose entries and estimated bytes are accounted, in the order they appear in reports
+enum MemoryContainer {
+    // PaymentChannel containers, summed over the channels of a node
+    MEMORY_IN_FLIGHTS,
+    MEMORY_PENDING_HTLCS,
+    MEMORY_PENDING_HTLCS_FIFO, // also counts the HTLC objects themselves
+    MEMORY_HTLCS_WAITING_FOR_ACK,
+    MEMORY_COMMITTED_HTLCS,
+    MEMORY_COMMITTED_HTLCS_FIFO, // also counts the HTLC objects themselves
+    MEMORY_PREVIOUS_HOP_UP,
+    MEMORY_PREVIOUS_HOP_DOWN,
+    // FullNode containers
+    MEMORY_MY_PREIMAGES,
+    MEMORY_MY_IN_FLIGHTS,
+    MEMORY_MY_PAYMENTS,
+    MEMORY_MY_STORED_MESSAGES, // also counts the stored messages themselves
+    MEMORY_SENDER_MODULES,
+    MEMORY_PAYMENT_START_TIMES,
+    MEMORY_SIGNALS,
+    MEMORY_SCHEDULED_SELF_MESSAGES, // payment starts, commitment timeouts and statistics timers
+    MEMORY_FUTURE_EVENTS, // network-wide only: every event in the future event set
+    NUM_MEMORY_CONTAINERS
+};
+
+const char* getMemoryContainerName(int container);
+
+struct MemoryCounters {
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+};
+
+typedef std::array<MemoryCounters, NUM_MEMORY_CONTAINERS> MemoryUsage;
+
+uint64_t getTotalBytes(const MemoryUsage& usage);
+
+// Byte estimates assume a 64-bit libstdc++: tree nodes carry 32 bytes of links and strings keep up to 15
+// characters inline. They are meant to tell where memory goes, not to match the allocator exactly.
+#define MEMORY_MAP_NODE_OVERHEAD 32
+#define MEMORY_DEQUE_BLOCK_SIZE 512
+
+inline uint64_t heapBytes(const std::string& str) { return str.capacity() > 15 ? str.capacity() + 1 : 0; }
+template <typename T> uint64_t heapBytes(const T&) { return 0; }
+template <typename T> uint64_t heapBytes(const std::vector<T>& vector) {
+    uint64_t bytes = vector.capacity() * sizeof(T);
+    for (const auto& element : vector)
+        bytes += heapBytes(element);
+    return bytes;
+}
+
+template <typename K, typename V> void accountMap(MemoryCounters& counters, const std::map<K, V>& map) {
+    counters.entries += map.size();
+    counters.bytes += map.size() * (MEMORY_MAP_NODE_OVERHEAD + sizeof(typename std::map<K, V>::value_type));
+    for (const auto& entry : map)
+        counters.bytes += heapBytes(entry.first) + heapBytes(entry.second);
+}
+
+template <typename T> void accountDeque(MemoryCounters& counters, const std::deque<T>& deque) {
+    counters.entries += deque.size();
+    counters.bytes += (deque.size() * sizeof(T) + MEMORY_DEQUE_BLOCK_SIZE - 1) / MEMORY_DEQUE_BLOCK_SIZE * MEMORY_DEQUE_BLOCK_SIZE;
+}
+
+// Size of an HTLC object and its strings
+uint64_t estimateHTLCBytes(HTLC *htlc);
+
+// Adds the containers of a payment channel to usage
+void accountPaymentChannel(const PaymentChannel& channel, MemoryUsage& usage);
+
+// Implemented by modules whose containers are part of the memory report
+class MemoryAccountable {
+
+    public:
+        virtual ~MemoryAccountable() {};
+        virtual void accountMemory(MemoryUsage& usage) = 0;
+};
+
+// Aggregates per node memory usage into network-wide reports, optionally appended to a JSON Lines or CSV file
+class MemoryReporter {
+
+    public:
+        // Throws std::invalid_argument for unknown formats and std::runtime_error if the file cannot be opened
+        void configure(bool enabled, const std::string& fileName, const std::string& format, bool perNode);
+        bool isEnabled() const { return _enabled; };
+
+        // A report is every node's usage added between beginReport and endReport
+        void beginReport(double simTime);
+        void addNode(const std::string& nodeName, const MemoryUsage& usage);
+        void endReport(uint64_t futureEvents, uint64_t futureEventBytes);
+
+        const MemoryUsage& getNetworkUsage() const { return _networkUsage; };
+        uint64_t getPeakBytes() const { return _peakBytes; };
+
+    private:
+        void write(const std::string& nodeName, const MemoryUsage& usage);
+
+        bool _enabled = false;
+        bool _json = true;
+        bool _perNode = false;
+        std::ofstream _file;
+        double _simTime = 0;
+        int _numNodes = 0;
+        MemoryUsage _networkUsage;
+        uint64_t _peakBytes = 0;
+};
+
+#endif
@@ -1,47 +1,533 @@
 #include "globals.h"
+#include "topology.h"
+#include "lndGraph.h"
+#include "routing.h"
+#include "checkpoint.h"
+#include "baseMessage_m.h"
 #include <algorithm>
+#include <chrono>
 
 cTopology *globalTopology = new cTopology("globalTopology");
+bool headless = false;
 std::map< std::string, std::vector< std::tuple<std::string, double, simtime_t> > > pendingPayments;
+std::map< std::string, std::vector< std::tuple<std::string, double, simtime_t, int> > > outgoingPayments;
 std::map< std::string, std::map<std::string, std::tuple<double, double, double, int, double, double, cGate*, cGate*> > > nameToPCs;
 std::map< std::string, std::vector< std::pair<std::string, std::vector<double> > > > adjMatrix;
+std::map<std::string, std::string> leafParents;
+TopologyCache topologyCache;
+ChannelStatsMode channelStatsMode = CHANNEL_STATS_FULL;
+simtime_t channelStatsInterval;
+std::set<std::pair<std::string, std::string> > sampledChannels;
+bool allChannelsDetailed = true;
+std::set<std::pair<std::string, std::string> > detailedChannels;
+LatencyHistogram networkPaymentLatency;
+LatencyHistogram networkCommitBatchingDelay;
+LatencyHistogram networkLinkDelay;
+int numStatisticsTimers = 0;
+bool restoringCheckpoint = false;
+HandlerProfiler handlerProfiler;
+MemoryReporter memoryReporter;
+EventTrace eventTrace;
+PaymentTracer paymentTracer;
+RouteOracle routeOracle;
+int numPartitions = 1;
+int partitionId = 0;
+
+void recordLatencyScalars(cComponent *component, const std::string& name, const LatencyHistogram& histogram) {
+    component->recordScalar((name + ":count").c_str(), histogram.getCount());
+    component->recordScalar((name + ":mean").c_str(), histogram.getMean(), "s");
+    component->recordScalar((name + ":p50").c_str(), histogram.getQuantile(0.5), "s");
+    component->recordScalar((name + ":p99").c_str(), histogram.getQuantile(0.99), "s");
+    component->recordScalar((name + ":p999").c_str(), histogram.getQuantile(0.999), "s");
+    component->recordScalar((name + ":max").c_str(), histogram.getMax(), "s");
+}
+
+void recordHandlerScalars(cComponent *component, const HandlerProfile& profile) {
+    for (int i = 0; i < NUM_PROFILED_HANDLERS; i++) {
+        if (profile[i].events == 0)
+            continue;
+        std::string handlerName = getProfiledHandlerName(i);
+        component->recordScalar(("handlerEvents:" + handlerName).c_str(), profile[i].events);
+        component->recordScalar(("handlerTime:" + handlerName).c_str(), profile[i].nanoseconds * 1e-9, "s");
+        if (PROFILE_ALLOCATIONS)
+            component->recordScalar(("handlerAllocations:" + handlerName).c_str(), profile[i].allocations);
+    }
+}
+
+class NetBuilder : public cSimpleModule, public Checkpointable {
+    protected:
+        std::set<int> _workloadNodes; // ids of every payment source and destination
+        std::map<int, int> _leafParentIds; // leafParents by node id, as stored in the topology cache
+        cMessage *_memoryReportTimer = nullptr;
+        cMessage *_warmupTimer = nullptr; // end of the warm-up, where the channel snapshot is saved
+        cMessage *_checkpointTimer = nullptr;
+        simtime_t _memoryReportInterval;
+        simtime_t _checkpointInterval;
+        std::vector<std::pair<std::string, double> > _buildScalars; // recorded once the run starts
+        std::chrono::steady_clock::time_point _startupStart;
 
-class NetBuilder : public cSimpleModule {
     public:
-        virtual void initialize() override;
+        virtual ~NetBuilder();
+        virtual int numInitStages() const override { return 2; };
+        virtual void initialize(int stage) override;
         virtual void handleMessage(cMessage *msg) override;
+        virtual void finish() override;
         void buildNetwork(cModule *parent);
         void initWorkload();
+        void initChannelStats();
+        void selectDetailedChannels(const std::vector<TopologyEdge>& edges, const std::map<int, cModule *>& nodeIdToMod, bool cacheHit);
+        std::vector<TopologyEdge> readTopology();
+        std::vector<TopologyEdge> readLndSnapshot();
+        std::vector<TopologyEdge> parseTopology();
+        std::vector<TopologyEdge> pruneTopology(const std::vector<TopologyEdge>& edges);
+        int dropUnroutablePayments(const std::vector<TopologyEdge>& edges);
+        std::string getCacheFileName();
+        std::string getPartitionFileName(const std::string& fileName);
+        std::map<std::pair<int, int>, std::vector<int> > precomputeRoutes();
+        void reportMemory();
+        void saveChannelSnapshot(const std::string& fileName);
+        void loadChannelSnapshot();
+        void saveCheckpoint();
+        void restoreCheckpoint();
+        virtual void writeCheckpoint(CheckpointWriter& writer) override;
+        virtual void readCheckpoint(CheckpointReader& reader) override;
+        virtual cMessage *getCheckpointTimer(const std::string& name) override;
+        cModule* createNode(cModuleType *modType, cModule *parent, int nodeId, int numOutGates, int numInGates);
         void connect(cGate *src, cGate *dst, double linkDelay);
-        bool nodeExists(std::map<int, cModule*> nodeList, int nodeId);
+        bool nodeExists(const std::map<int, cModule*>& nodeList, int nodeId);
 };
 
 Define_Module(NetBuilder);
 
-void NetBuilder::initialize() {
-    // build the network in event 1, because it is undefined whether the simkernel
-    // will implicitly initialize modules created *during* initialization, or this needs
-    // to be done manually.
-    scheduleAt(0, new cMessage());
+// The network creates its nodes while it is being set up, as if they were declared in NED. Every partition of a parallel
+// run sets up the whole network (with placeholders for the nodes of the other partitions), so its NetBuilder must be
+// present on all partitions.
+class PCNNetwork : public cModule {
+    protected:
+        virtual void doBuildInside() override;
+};
+
+Define_Module(PCNNetwork);
+
+void PCNNetwork::doBuildInside() {
+    cModule::doBuildInside();
+
+    NetBuilder *netBuilder = dynamic_cast<NetBuilder *>(getSubmodule("netBuilder"));
+    if (netBuilder == nullptr)
+        throw cRuntimeError("The NetBuilder must be present on every partition (set **.netBuilder.partition-id = \"*\")");
+    netBuilder->buildNetwork(this);
+}
+
+NetBuilder::~NetBuilder() {
+    cancelAndDelete(_memoryReportTimer);
+    cancelAndDelete(_warmupTimer);
+    cancelAndDelete(_checkpointTimer);
+}
+
+void NetBuilder::initialize(int stage) {
+    // Stage 1 runs once every node has been initialized
+    if (stage == 1) {
+        // Every module has created its timers and channels, which now take the state of the checkpoint
+        if (restoringCheckpoint)
+            restoreCheckpoint();
+
+        // Wall-clock time spent building and initializing the network (reported by the benchmark suite)
+        recordScalar("startupWallTime", std::chrono::duration<double>(std::chrono::steady_clock::now() - _startupStart).count(), "s");
+
+        // Nodes copied what they need from the workload and channel lists, which are not used after initialization
+        pendingPayments.clear();
+        outgoingPayments.clear();
+        nameToPCs.clear();
+        detailedChannels.clear();
+        return;
+    }
+
+    // The network was built during setup. Handler profiling and memory reports cover the whole run, so they are
+    // configured before any node is initialized (the NetBuilder is the first submodule of the network).
+    numStatisticsTimers = 0;
+    try {
+        handlerProfiler.configure(par("profileHandlers").boolValue(), getPartitionFileName(par("profileFile").stdstringValue()),
+                par("profileFormat").stdstringValue(), par("profileInterval").doubleValue());
+        memoryReporter.configure(par("memoryReport").boolValue(), getPartitionFileName(par("memoryReportFile").stdstringValue()),
+                par("memoryReportFormat").stdstringValue(), par("memoryReportPerNode").boolValue());
+        eventTrace.close();
+        if (!par("traceFile").stdstringValue().empty())
+            eventTrace.open(getPartitionFileName(par("traceFile").stdstringValue()), par("traceBufferSize").intValue());
+        paymentTracer.configure(par("tracePayments").stdstringValue(), par("tracePaymentRate").doubleValue(),
+                getPartitionFileName(par("tracePaymentFile").stdstringValue()));
+
+        // Nodes request the routes of their payments as they initialize. Workers read the routing graph concurrently,
+        // so it is built now even on a cache hit (where FullNode::findRoute would otherwise build it on demand).
+        int routeOracleThreads = par("routeOracleThreads").intValue();
+        if (routeOracleThreads > 0 && adjMatrix.empty() && topologyCache.isValid())
+            addRoutingEdges(topologyCache.getEdges(), leafParents, adjMatrix);
+        routeOracle.configure(routeOracleThreads, &adjMatrix, &leafParents);
+    } catch (const std::exception& e) {
+        throw cRuntimeError("%s", e.what());
+    }
+    _memoryReportInterval = par("memoryReportInterval").doubleValue();
+
+    std::string headlessMode = par("headless").stdstringValue();
+    if (headlessMode == "auto")
+        headless = !getEnvir()->isGUI();
+    else if (headlessMode == "true" || headlessMode == "false")
+        headless = (headlessMode == "true");
+    else
+        throw cRuntimeError("headless must be \"auto\", \"true\" or \"false\", not `%s'", headlessMode.c_str());
+
+    if (memoryReporter.isEnabled() && _memoryReportInterval > 0) {
+        _memoryReportTimer = new cMessage("memoryReport");
+        if (!restoringCheckpoint) {
+            scheduleAt(simTime() + _memoryReportInterval, _memoryReportTimer);
+            numStatisticsTimers++;
+        }
+    }
+
+    // Statistics leave out the warm-up (see inWarmup), and the channels at its end can be saved as the starting point of
+    // later runs (channelSnapshotLoadFile)
+    if (!par("channelSnapshotSaveFile").stdstringValue().empty()) {
+        if (getSimulation()->getWarmupPeriod() <= 0)
+            throw cRuntimeError("channelSnapshotSaveFile is written at the end of the warm-up, but there is no warmup-period");
+        if (numPartitions > 1)
+            throw cRuntimeError("Channel snapshots cannot be saved in parallel runs");
+        _warmupTimer = new cMessage("warmupEnd");
+        if (!restoringCheckpoint) {
+            scheduleAt(getSimulation()->getWarmupPeriod(), _warmupTimer);
+            numStatisticsTimers++;
+        }
+    }
+
+    // The whole simulation state can be saved periodically, and later runs continue from such a checkpoint
+    // (restoreFile), e.g. to branch one warmed-up network into several scenarios
+    _checkpointInterval = par("checkpointInterval").doubleValue();
+    if (_checkpointInterval > 0) {
+        if (numPartitions > 1)
+            throw cRuntimeError("Checkpoints cannot be saved in parallel runs");
+        if (par("checkpointFile").stdstringValue().empty())
+            throw cRuntimeError("checkpointInterval requires a checkpointFile");
+        _checkpointTimer = new cMessage("checkpoint");
+        if (!restoringCheckpoint) {
+            scheduleAt(simTime() + _checkpointInterval, _checkpointTimer);
+            numStatisticsTimers++;
+        }
+    }
+
+    // Results can only be recorded once the run has started
+    for (const auto& scalar : _buildScalars)
+        recordScalar(scalar.first.c_str(), scalar.second);
 }
 
 void NetBuilder::handleMessage(cMessage *msg) {
-    if (!msg->isSelfMessage())
+    if (msg == _warmupTimer) {
+        numStatisticsTimers--;
+        saveChannelSnapshot(par("channelSnapshotSaveFile").stdstringValue());
+        return;
+    }
+    if (msg == _checkpointTimer) {
+        // The checkpoint timer is the only event not in the checkpoint, so it goes back in the FES afterwards
+        numStatisticsTimers--;
+        saveCheckpoint();
+        if (getSimulation()->getFES()->getLength() > numStatisticsTimers) {
+            scheduleAt(simTime() + _checkpointInterval, _checkpointTimer);
+            numStatisticsTimers++;
+        }
+        return;
+    }
+    if (msg != _memoryReportTimer)
         throw cRuntimeError("This module does not process messages.");
 
-    delete msg;
-    buildNetwork(getParentModule());
+    // Like the channel snapshots, reports go on only while there are other events
+    numStatisticsTimers--;
+    reportMemory();
+    if (getSimulation()->getFES()->getLength() > numStatisticsTimers) {
+        scheduleAt(simTime() + _memoryReportInterval, _memoryReportTimer);
+        numStatisticsTimers++;
+    }
+}
+
+void NetBuilder::finish() {
+    // Network-wide latency quantiles (FullNodes feed the histograms as payments progress)
+    recordLatencyScalars(this, "paymentLatency", networkPaymentLatency);
+    recordLatencyScalars(this, "commitBatchingDelay", networkCommitBatchingDelay);
+    recordLatencyScalars(this, "linkDelay", networkLinkDelay);
+
+    if (handlerProfiler.isEnabled()) {
+        recordHandlerScalars(this, handlerProfiler.getNetworkProfile());
+        handlerProfiler.dump(simTime().dbl(), true);
+    }
+
+    if (memoryReporter.isEnabled()) {
+        // The final report also goes to the scalars
+        reportMemory();
+        const MemoryUsage& usage = memoryReporter.getNetworkUsage();
+        for (int i = 0; i < NUM_MEMORY_CONTAINERS; i++) {
+            std::string containerName = getMemoryContainerName(i);
+            recordScalar(("memoryEntries:" + containerName).c_str(), usage[i].entries);
+            recordScalar(("memoryBytes:" + containerName).c_str(), usage[i].bytes, "B");
+        }
+        recordScalar("memoryPeakBytes", memoryReporter.getPeakBytes(), "B");
+    }
+
+    // Final channel state, e.g. to compare with tools/flowsim
+    if (!par("channelSnapshotFinalFile").stdstringValue().empty())
+        saveChannelSnapshot(par("channelSnapshotFinalFile").stdstringValue());
+
+    if (routeOracle.isEnabled()) {
+        recordScalar("routeOracleRequests", routeOracle.getNumRequests());
+        recordScalar("routeOracleWaits", routeOracle.getNumWaits());
+        recordScalar("routeOracleInline", routeOracle.getNumInline());
+        recordScalar("routeOracleExpired", routeOracle.getNumExpired());
+        recordScalar("routeOracleWaitTime", routeOracle.getWaitTime(), "s");
+        routeOracle.close();
+    }
+
+    paymentTracer.close();
+    try {
+        eventTrace.close();
+    } catch (const std::exception& e) {
+        throw cRuntimeError("%s", e.what());
+    }
+}
+
+void NetBuilder::reportMemory() {
+    // Collects the memory usage of every node of the network into one report
+
+    memoryReporter.beginReport(simTime().dbl());
+    for (cModule::SubmoduleIterator it(getParentModule()); !it.end(); ++it) {
+        MemoryAccountable *node = dynamic_cast<MemoryAccountable *>(*it);
+        if (node == nullptr)
+            continue;
+        MemoryUsage usage;
+        node->accountMemory(usage);
+        memoryReporter.addNode((*it)->getFullName(), usage);
+    }
+
+    // Most pending events are protocol messages, so the FES is estimated at one BaseMessage per event
+    uint64_t futureEvents = getSimulation()->getFES()->getLength();
+    memoryReporter.endReport(futureEvents, futureEvents * sizeof(BaseMessage));
+}
+
+void NetBuilder::saveChannelSnapshot(const std::string& fileName) {
+    // Writes the capacity of every channel direction of the network
+
+    ChannelSnapshot snapshot;
+    for (cModule::SubmoduleIterator it(getParentModule()); !it.end(); ++it) {
+        ChannelSnapshotSource *node = dynamic_cast<ChannelSnapshotSource *>(*it);
+        if (node != nullptr)
+            node->snapshotChannels(snapshot);
+    }
+
+    try {
+        snapshot.write(fileName);
+    } catch (const std::exception& e) {
+        throw cRuntimeError("%s", e.what());
+    }
+    EV << "Saved the capacities of " << snapshot.getEntries().size() << " channel directions to " << fileName << "\n";
+}
+
+void NetBuilder::loadChannelSnapshot() {
+    // Replaces the capacities of the topology with those of a snapshot before the nodes create their payment channels
+
+    std::string fileName = par("channelSnapshotLoadFile").stdstringValue();
+    ChannelSnapshot snapshot;
+    try {
+        snapshot.read(fileName);
+    } catch (const std::exception& e) {
+        throw cRuntimeError("%s", e.what());
+    }
+
+    for (const auto& entry : snapshot.getEntries()) {
+        auto node = nameToPCs.find("node" + std::to_string(entry.nodeId));
+        if (node == nameToPCs.end())
+            throw cRuntimeError("Channel snapshot %s does not match the topology: there is no node%d", fileName.c_str(), entry.nodeId);
+        auto channel = node->second.find("node" + std::to_string(entry.neighborId));
+        if (channel == node->second.end())
+            throw cRuntimeError("Channel snapshot %s does not match the topology: there is no channel from node%d to node%d",
+                    fileName.c_str(), entry.nodeId, entry.neighborId);
+        std::get<0>(channel->second) = entry.capacity;
+    }
+
+    EV << "Loaded the capacities of " << snapshot.getEntries().size() << " channel directions from " << fileName << "\n";
+    _buildScalars.push_back(std::make_pair("snapshotChannels", snapshot.getEntries().size()));
+}
+
+void NetBuilder::saveCheckpoint() {
+    // Writes the state of every module and every future event. Each checkpoint goes to its own file if checkpointFile
+    // contains %t, which is replaced by the simulation time.
+
+    std::string fileName = par("checkpointFile").stdstringValue();
+    for (size_t pos = fileName.find("%t"); pos != std::string::npos; pos = fileName.find("%t", pos))
+        fileName.replace(pos, 2, simTime().str());
+
+    std::vector<cModule *> modules;
+    for (cModule::SubmoduleIterator it(getParentModule()); !it.end(); ++it) {
+        if (dynamic_cast<Checkpointable *>(*it) != nullptr)
+            modules.push_back(*it);
+    }
+
+    // Events at the same time and priority run in insertion order, which restoring them in this order preserves
+    cFutureEventSet *fes = getSimulation()->getFES();
+    std::vector<cMessage *> events;
+    for (int i = 0; i < fes->getLength(); i++)
+        events.push_back(check_and_cast<cMessage *>(fes->get(i)));
+    std::sort(events.begin(), events.end(), [](cMessage *a, cMessage *b) {
+        if (a->getArrivalTime() != b->getArrivalTime())
+            return a->getArrivalTime() < b->getArrivalTime();
+        if (a->getSchedulingPriority() != b->getSchedulingPriority())
+            return a->getSchedulingPriority() < b->getSchedulingPriority();
+        return a->getInsertOrder() < b->getInsertOrder();
+    });
+
+    CheckpointWriter writer;
+    try {
+        writer.open(fileName);
+
+        writer.writeInt(SimTime::getScaleExp());
+        writeSimTime(writer, simTime());
+        writer.writeInt(getSimulation()->getLastComponentId());
+        writer.writeUInt(getEnvir()->getNumRNGs());
+        for (int k = 0; k < getEnvir()->getNumRNGs(); k++)
+            check_and_cast<CheckpointRNG *>(getEnvir()->getRNG(k))->writeState(writer);
+
+        writer.writeUInt(modules.size());
+        for (cModule *module : modules) {
+            writer.writeInt(module->getId());
+            dynamic_cast<Checkpointable *>(module)->writeCheckpoint(writer);
+        }
+
+        writer.writeUInt(events.size());
+        for (cMessage *msg : events) {
+            writeMessage(writer, msg);
+            writer.writeInt(msg->getSenderModuleId());
+            writer.writeInt(msg->getSenderGateId());
+            writeSimTime(writer, msg->getSendingTime());
+            writer.writeInt(msg->getArrivalModuleId());
+            writer.writeInt(msg->getArrivalGateId());
+            writeSimTime(writer, msg->getArrivalTime());
+            writer.writeInt(msg->getSchedulingPriority());
+        }
+
+        writer.close();
+    } catch (const std::exception& e) {
+        throw cRuntimeError("%s", e.what());
+    }
+    EV << "Saved checkpoint with " << events.size() << " future events to " << fileName << "\n";
+}
+
+void NetBuilder::restoreCheckpoint() {
+    // Replaces the initial state of the modules with the one of a checkpoint and puts its future events back in the FES.
+    // The run starts at t=0 as usual and its first event is the first one of the checkpoint, so the clock jumps there.
+
+    std::string fileName = par("restoreFile").stdstringValue();
+    simtime_t checkpointTime;
+    CheckpointReader reader;
+    try {
+        reader.open(fileName);
+
+        if (reader.readInt() != SimTime::getScaleExp())
+            throw std::runtime_error(fileName + " was written with a different simtime-resolution");
+        checkpointTime = readSimTime(reader);
+        if (reader.readInt() != getSimulation()->getLastComponentId())
+            throw std::runtime_error(fileName + " was written for a different network");
+
+        // The RNGs continue from their saved state, whatever the network has drawn while it was being built
+        if ((int) reader.readUInt() != getEnvir()->getNumRNGs())
+            throw std::runtime_error(fileName + " was written with a different number of RNGs");
+        for (int k = 0; k < getEnvir()->getNumRNGs(); k++)
+            check_and_cast<CheckpointRNG *>(getEnvir()->getRNG(k))->readState(reader);
+
+        std::vector<Checkpointable *> modules;
+        for (cModule::SubmoduleIterator it(getParentModule()); !it.end(); ++it) {
+            Checkpointable *module = dynamic_cast<Checkpointable *>(*it);
+            if (module != nullptr)
+                modules.push_back(module);
+        }
+        if (reader.readUInt() != modules.size())
+            throw std::runtime_error(fileName + " was written for a different network");
+        for (Checkpointable *module : modules) {
+            if (reader.readInt() != dynamic_cast<cModule *>(module)->getId())
+                throw std::runtime_error(fileName + " was written for a different network");
+            module->readCheckpoint(reader);
+        }
+
+        // Every event that is not a protocol message is a statistics timer
+        numStatisticsTimers = 0;
+        for (uint64_t n = reader.readUInt(); n > 0; n--) {
+            cMessage *msg = readMessage(reader);
+            int senderModuleId = reader.readInt();
+            int senderGateId = reader.readInt();
+            simtime_t sendingTime = readSimTime(reader);
+            int arrivalModuleId = reader.readInt();
+            int arrivalGateId = reader.readInt();
+            simtime_t arrivalTime = readSimTime(reader);
+            short priority = reader.readInt();
+            if (msg == nullptr)
+                continue;
+            if (dynamic_cast<BaseMessage *>(msg) == nullptr)
+                numStatisticsTimers++;
+            msg->setSentFrom(getSimulation()->getModule(senderModuleId), senderGateId, sendingTime);
+            msg->setArrival(arrivalModuleId, arrivalGateId, arrivalTime);
+            msg->setSchedulingPriority(priority);
+            getSimulation()->insertEvent(msg);
+        }
+    } catch (const std::exception& e) {
+        throw cRuntimeError("%s", e.what());
+    }
+
+    if (_checkpointTimer != nullptr) {
+        scheduleAt(checkpointTime + _checkpointInterval, _checkpointTimer);
+        numStatisticsTimers++;
+    }
+    EV << "Restored checkpoint of t=" << checkpointTime << " from " << fileName << "\n";
+    recordScalar("checkpointTime", checkpointTime.dbl(), "s");
+}
+
+void NetBuilder::writeCheckpoint(CheckpointWriter& writer) {
+    // The network-wide statistics (the rest of the globals are rebuilt from the topology and workload)
+    networkPaymentLatency.writeTo(writer);
+    networkCommitBatchingDelay.writeTo(writer);
+    networkLinkDelay.writeTo(writer);
+}
+
+void NetBuilder::readCheckpoint(CheckpointReader& reader) {
+    networkPaymentLatency.readFrom(reader);
+    networkCommitBatchingDelay.readFrom(reader);
+    networkLinkDelay.readFrom(reader);
+}
+
+cMessage *NetBuilder::getCheckpointTimer(const std::string& name) {
+    if (_memoryReportTimer != nullptr && name == _memoryReportTimer->getName())
+        return _memoryReportTimer;
+    if (_warmupTimer != nullptr && name == _warmupTimer->getName())
+        return _warmupTimer;
+    return nullptr;
 }
 
 void NetBuilder::connect(cGate *srcGate, cGate *dstGate, double linkDelay) {
 
+    // Channels between two nodes of other partitions are never used here
+    if (srcGate->getOwnerModule()->isPlaceholder() && dstGate->getOwnerModule()->isPlaceholder())
+        return;
+
+    // Channels into another partition are the lookahead of the parallel run. They are datarate channels without a
+    // datarate, which delay messages exactly like a delay channel but are the ones cLinkDelayLookahead reads.
+    if (dstGate->getOwnerModule()->isPlaceholder()) {
+        if (linkDelay <= 0)
+            throw cRuntimeError("Channel %s -> %s crosses partitions but has no link delay, which leaves no lookahead",
+                    srcGate->getOwnerModule()->getFullName(), dstGate->getOwnerModule()->getFullName());
+        cDatarateChannel *channel = cDatarateChannel::create("channel");
+        channel->setDelay(linkDelay);
+        srcGate->connectTo(dstGate, channel);
+        return;
+    }
+
     cDelayChannel *channel = cDelayChannel::create("channel");
     channel->setDelay(linkDelay);
     srcGate->connectTo(dstGate, channel);
 }
 
-bool NetBuilder::nodeExists(std::map<int, cModule*> nodeList, int nodeId) {
-    std::map<int, cModule*>::iterator it = nodeList.find(nodeId);
+bool NetBuilder::nodeExists(const std::map<int, cModule*>& nodeList, int nodeId) {
+    std::map<int, cModule*>::const_iterator it = nodeList.find(nodeId);
     if (it != nodeList.end())
         return true;
     else
@@ -53,6 +539,7 @@ void NetBuilder::initWorkload() {
     std::string line;
     std::ifstream workloadFile(par("workloadFile").stringValue(), std::ifstream::in);
     pendingPayments.clear();
+    _workloadNodes.clear();
 
     EV << "Initializing workload from file: " << par("topologyFile").stringValue() << "\n";
 
@@ -81,27 +568,18 @@ void NetBuilder::initWorkload() {
         std::string dstName = "node" + std::to_string(dstId);
         auto paymentTuple = std::make_tuple(srcName, value, time);
         pendingPayments[dstName].push_back(paymentTuple);
+        _workloadNodes.insert(srcId);
+        _workloadNodes.insert(dstId);
     }
 
 }
 
-void NetBuilder::buildNetwork(cModule *parent) {
-
-    // Initialize workload
-    initWorkload();
-
-    // Initialize variables and build network
-    std::map<int, cModule *> nodeIdToMod;
+std::vector<TopologyEdge> NetBuilder::readTopology() {
+    std::vector<TopologyEdge> edges;
     std::string line;
-    std::string modClassName = "FullNode";
     std::ifstream topologyFile(par("topologyFile").stringValue(), std::ifstream::in);
-    cModule *srcMod;
-    cModule *dstMod;
-    cTopology::Node *srcNode;
-    cTopology::Node *dstNode;
-    std::vector<std::tuple<cTopology::Link*, cGate*, cGate*>> linksBuffer;
 
-    EV << "Building network from file: " << par("topologyFile").stringValue() << "\n";
+    EV << "Reading topology from file: " << par("topologyFile").stringValue() << "\n";
 
     while (getline(topologyFile, line, '\n')) {
 
@@ -115,81 +593,462 @@ void NetBuilder::buildNetwork(cModule *parent) {
             throw cRuntimeError("wrong line in topology file: 9 items required, line: \"%s\"", line.c_str());
 
         // Get fields from tokens
-        int srcId = atoi(tokens[0].c_str());
-        int dstId = atoi(tokens[1].c_str());
-        double capacity = atof(tokens[2].c_str());
-        double fee = atof(tokens[3].c_str());
-        double linkQuality = atof(tokens[4].c_str());
-        int maxAcceptedHTLCs = atoi(tokens[5].c_str());
-        double HTLCMinimumMsat = atof(tokens[6].c_str());
-        double channelReserveSatoshis = atof(tokens[7].c_str());
-        double linkDelay = atof(tokens[8].c_str());
+        TopologyEdge edge;
+        edge.srcId = atoi(tokens[0].c_str());
+        edge.dstId = atoi(tokens[1].c_str());
+        edge.capacity = atof(tokens[2].c_str());
+        edge.fee = atof(tokens[3].c_str());
+        edge.linkQuality = atof(tokens[4].c_str());
+        edge.maxAcceptedHTLCs = atoi(tokens[5].c_str());
+        edge.HTLCMinimumMsat = atof(tokens[6].c_str());
+        edge.channelReserveSatoshis = atof(tokens[7].c_str());
+        edge.linkDelay = atof(tokens[8].c_str());
 
         // Print found edges
-        EV << "EDGE FOUND: (" << srcId << ", " << dstId << "); linkDelay = " << linkDelay << "ms. Processing...\n";
+        EV << "EDGE FOUND: (" << edge.srcId << ", " << edge.dstId << "); linkDelay = " << edge.linkDelay << "ms. Processing...\n";
 
-        // Define module names
-        std::string srcName = "node" + std::to_string(srcId);
-        std::string dstName = "node" + std::to_string(dstId);
+        edges.push_back(edge);
+    }
 
-        // Check if the source module exists and if not, create a new source module
-        if(!nodeExists(nodeIdToMod,srcId)) {
-            cModuleType *srcModType = cModuleType::find(modClassName.c_str());
-            if (!srcModType)
-                throw cRuntimeError("Source module class `%s' not found", modClassName.c_str());
-            srcMod = srcModType->create(srcName.c_str(), parent);
-            nodeIdToMod[srcId] = srcMod;
-            srcMod->finalizeParameters();
-            srcNode = new cTopology::Node(srcMod->getId());
-            globalTopology->addNode(srcNode);
-        } else {
-            srcMod = nodeIdToMod.find(srcId)->second;
-            srcNode = globalTopology->getNodeFor(srcMod);
-        }
-
-        // Check if the destination module exists and if not, create a new destination module
-        if(!nodeExists(nodeIdToMod,dstId)) {
-            cModuleType *dstModType = cModuleType::find(modClassName.c_str());
-            if (!dstModType)
-                throw cRuntimeError("Destination module class `%s' not found", modClassName.c_str());
-            dstMod = dstModType->create(dstName.c_str(), parent);
-            nodeIdToMod[dstId] = dstMod;
-            dstMod->finalizeParameters();
-            dstNode = new cTopology::Node(dstMod->getId());
-            globalTopology->addNode(dstNode);
+    return edges;
+}
+
+std::vector<TopologyEdge> NetBuilder::readLndSnapshot() {
+    // Imports an LND describegraph JSON snapshot. Nodes are numbered in order of appearance in the snapshot.
+
+    LndGraphOptions options;
+    options.satoshiScale = par("snapshotSatoshiScale").doubleValue();
+    options.linkDelay = par("snapshotLinkDelay").doubleValue();
+    options.nodeMapFile = partitionId == 0 ? par("snapshotNodeMapFile").stdstringValue() : ""; // the same in every partition
+    LndGraphSummary summary;
+    std::vector<TopologyEdge> edges;
+
+    EV << "Importing LND graph snapshot from file: " << par("topologyFile").stringValue() << "\n";
+
+    try {
+        edges = readLndGraph(par("topologyFile").stdstringValue(), options, summary);
+    } catch (const std::runtime_error& e) {
+        throw cRuntimeError("%s", e.what());
+    }
+
+    EV << "Imported " << summary.numNodes << " nodes and " << summary.numChannels << " channels (" << summary.numSkippedChannels << " channels skipped due to missing or disabled policies, "
+            << summary.numMergedChannels << " parallel channels merged).\n";
+
+    return edges;
+}
+
+std::vector<TopologyEdge> NetBuilder::pruneTopology(const std::vector<TopologyEdge>& edges) {
+    // Keeps only the strongly connected component used by the workload, drops the payments that cannot be routed
+    // within it, and marks the nodes hanging from it through a single neighbor so that routing can skip them
+
+    PruningReport report;
+    std::vector<TopologyEdge> keptEdges = extractWorkloadComponent(edges, _workloadNodes, report);
+    int droppedPayments = dropUnroutablePayments(keptEdges);
+
+    leafParents.clear();
+    _leafParentIds = findLeafParents(keptEdges);
+    for (const auto& leaf : _leafParentIds)
+        leafParents["node" + std::to_string(leaf.first)] = "node" + std::to_string(leaf.second);
+
+    EV << "Topology pruning: " << report.numComponents << " strongly connected components found. Kept " << report.numKeptNodes << " nodes and "
+            << report.numKeptEdges << " channel directions, pruned " << report.numPrunedNodes << " nodes and " << report.numPrunedEdges
+            << " channel directions. " << leafParents.size() << " nodes hang from the routing core through a single neighbor. "
+            << droppedPayments << " unroutable payments dropped.\n";
+
+    _buildScalars.push_back(std::make_pair("strongComponents", report.numComponents));
+    _buildScalars.push_back(std::make_pair("prunedNodes", report.numPrunedNodes));
+    _buildScalars.push_back(std::make_pair("prunedChannelDirections", report.numPrunedEdges));
+    _buildScalars.push_back(std::make_pair("leafNodes", leafParents.size()));
+    _buildScalars.push_back(std::make_pair("droppedPayments", droppedPayments));
+
+    return keptEdges;
+}
+
+int NetBuilder::dropUnroutablePayments(const std::vector<TopologyEdge>& edges) {
+    // Removes the pending payments whose source or destination is not part of the given topology
+
+    std::set<std::string> keptNames;
+    for (const auto& edge : edges) {
+        keptNames.insert("node" + std::to_string(edge.srcId));
+        keptNames.insert("node" + std::to_string(edge.dstId));
+    }
+
+    int droppedPayments = 0;
+    for (auto it = pendingPayments.begin(); it != pendingPayments.end(); ) {
+        std::vector<std::tuple<std::string, double, simtime_t> >& payments = it->second;
+        size_t numPayments = payments.size();
+        if (keptNames.count(it->first) == 0) {
+            payments.clear();
         } else {
-            dstMod = nodeIdToMod.find(dstId)->second;
-            dstNode = globalTopology->getNodeFor(dstMod);
+            payments.erase(std::remove_if(payments.begin(), payments.end(),
+                    [&keptNames](const std::tuple<std::string, double, simtime_t>& payment) { return keptNames.count(std::get<0>(payment)) == 0; }),
+                    payments.end());
+        }
+        droppedPayments += numPayments - payments.size();
+        it = payments.empty() ? pendingPayments.erase(it) : std::next(it);
+    }
+
+    return droppedPayments;
+}
+
+std::vector<TopologyEdge> NetBuilder::parseTopology() {
+    // Reads the topology file according to its format
+
+    std::string topologyFormat = par("topologyFormat").stdstringValue();
+    if (topologyFormat == "text")
+        return readTopology();
+    else if (topologyFormat == "lnd-json")
+        return readLndSnapshot();
+    else if (topologyFormat == "binary") {
+        try {
+            return readBinaryTopology(par("topologyFile").stdstringValue());
+        } catch (const std::runtime_error& e) {
+            throw cRuntimeError("%s", e.what());
+        }
+    }
+    else
+        throw cRuntimeError("Unknown topology format `%s'", topologyFormat.c_str());
+}
+
+std::string NetBuilder::getCacheFileName() {
+    // Cache files are named after a hash of everything that determines their contents, so a changed input simply
+    // misses the cache. Returns an empty string if the cache is disabled.
+
+    std::string cacheDirectory = par("cacheDirectory").stdstringValue();
+    if (cacheDirectory.empty())
+        return "";
+
+    std::stringstream configuration;
+    configuration << "version=" << TOPOLOGY_CACHE_VERSION << ";format=" << par("topologyFormat").stdstringValue()
+            << ";prune=" << par("pruneTopology").boolValue() << ";routing=" << ROUTING_COST_FUNCTION;
+    if (par("topologyFormat").stdstringValue() == "lnd-json")
+        configuration << ";satoshiScale=" << par("snapshotSatoshiScale").doubleValue() << ";linkDelay=" << par("snapshotLinkDelay").doubleValue();
+
+    std::vector<std::string> fileNames{par("topologyFile").stdstringValue(), par("workloadFile").stdstringValue()};
+    try {
+        return cacheDirectory + "/" + TopologyCache::computeKey(fileNames, configuration.str()) + ".pcncache";
+    } catch (const std::runtime_error& e) {
+        throw cRuntimeError("%s", e.what());
+    }
+}
+
+std::string NetBuilder::getPartitionFileName(const std::string& fileName) {
+    // Every partition of a parallel run writes its own output files, named <name>-p<partition>.<extensions>
+
+    if (numPartitions == 1 || fileName.empty())
+        return fileName;
+
+    size_t nameStart = fileName.find_last_of('/');
+    size_t extension = fileName.find('.', nameStart == std::string::npos ? 0 : nameStart + 1);
+    if (extension == std::string::npos)
+        extension = fileName.size();
+    return fileName.substr(0, extension) + "-p" + std::to_string(partitionId) + fileName.substr(extension);
+}
+
+std::map<std::pair<int, int>, std::vector<int> > NetBuilder::precomputeRoutes() {
+    // Computes the route of every (payer, payee) pair in the workload with the same algorithm FullNode uses on demand
+
+    std::map<std::pair<int, int>, std::vector<int> > routes;
+    for (const auto& payee : pendingPayments) {
+        int dstId = atoi(payee.first.c_str() + strlen("node"));
+        for (const auto& payment : payee.second) {
+            const std::string& srcName = std::get<0>(payment);
+            std::pair<int, int> key(atoi(srcName.c_str() + strlen("node")), dstId);
+            if (routes.find(key) != routes.end())
+                continue;
+
+            std::vector<int>& route = routes[key];
+            for (const auto& hop : computeRoute(srcName, payee.first, adjMatrix, leafParents))
+                route.push_back(atoi(hop.c_str() + strlen("node")));
+        }
+    }
+    return routes;
+}
+
+void NetBuilder::initChannelStats() {
+    // Reads the channel statistics configuration that FullNodes apply when registering their per-channel signals
+
+    std::string mode = par("channelStatsMode").stdstringValue();
+    if (mode == "full")
+        channelStatsMode = CHANNEL_STATS_FULL;
+    else if (mode == "periodic")
+        channelStatsMode = CHANNEL_STATS_PERIODIC;
+    else if (mode == "sampled")
+        channelStatsMode = CHANNEL_STATS_SAMPLED;
+    else if (mode == "histogram")
+        channelStatsMode = CHANNEL_STATS_HISTOGRAM;
+    else
+        throw cRuntimeError("Unknown channel statistics mode `%s'", mode.c_str());
+
+    channelStatsInterval = par("channelStatsInterval").doubleValue();
+    if (channelStatsMode == CHANNEL_STATS_PERIODIC && channelStatsInterval <= 0)
+        throw cRuntimeError("channelStatsInterval must be positive in periodic mode");
+    if (channelStatsMode == CHANNEL_STATS_SAMPLED && par("channelStatsSampleSize").intValue() < 0)
+        throw cRuntimeError("channelStatsSampleSize must not be negative");
+
+    sampledChannels.clear();
+}
+
+void NetBuilder::selectDetailedChannels(const std::vector<TopologyEdge>& edges, const std::map<int, cModule *>& nodeIdToMod, bool cacheHit) {
+    // Picks the channels whose HTLCs are committed through the COMMITMENT_SIGNED/REVOKE_AND_ACK exchange. A channel is
+    // selected in both directions, so that its two ends always agree on how to commit.
+
+    std::string mode = par("detailedChannels").stdstringValue();
+    if (mode != "all" && mode != "none" && mode != "hubs" && mode != "traffic")
+        throw cRuntimeError("Unknown detailedChannels selection `%s'", mode.c_str());
+    allChannelsDetailed = mode == "all";
+    detailedChannels.clear();
+    if (allChannelsDetailed)
+        return;
+
+    // Channel (lower id, higher id) to the number of workload payments routed over it
+    std::map<std::pair<int, int>, int> traffic;
+    if (mode == "traffic") {
+        std::map<std::pair<int, int>, std::vector<int> > routes;
+        if (!cacheHit)
+            routes = precomputeRoutes();
+        for (const auto& payee : pendingPayments) {
+            int dstId = atoi(payee.first.c_str() + strlen("node"));
+            for (const auto& payment : payee.second) {
+                std::pair<int, int> key(atoi(std::get<0>(payment).c_str() + strlen("node")), dstId);
+                std::vector<int> route;
+                // Payments missing from the cache (found on demand during the run) add no traffic
+                if (cacheHit)
+                    topologyCache.getRoute(key.first, key.second, route);
+                else
+                    route = routes[key];
+                for (size_t i = 1; i < route.size(); i++)
+                    traffic[std::make_pair(std::min(route[i - 1], route[i]), std::max(route[i - 1], route[i]))]++;
+            }
+        }
+    }
+
+    std::map<int, int> degrees;
+    for (const auto& edge : edges)
+        degrees[edge.srcId]++;
+
+    int hubDegree = par("detailedHubDegree").intValue();
+    int trafficThreshold = par("detailedTrafficThreshold").intValue();
+    for (const auto& edge : edges) {
+        bool detailed = false;
+        if (mode == "hubs")
+            detailed = degrees[edge.srcId] >= hubDegree || degrees[edge.dstId] >= hubDegree;
+        else if (mode == "traffic")
+            detailed = traffic[std::make_pair(std::min(edge.srcId, edge.dstId), std::max(edge.srcId, edge.dstId))] >= trafficThreshold;
+
+        // The other end of a channel to another partition can only be reached through messages
+        if (nodeIdToMod.at(edge.srcId)->isPlaceholder() != nodeIdToMod.at(edge.dstId)->isPlaceholder())
+            detailed = true;
+
+        if (detailed) {
+            std::string srcName = "node" + std::to_string(edge.srcId);
+            std::string dstName = "node" + std::to_string(edge.dstId);
+            detailedChannels.insert(std::make_pair(srcName, dstName));
+            detailedChannels.insert(std::make_pair(dstName, srcName));
+        }
+    }
+    _buildScalars.push_back(std::make_pair("detailedChannelDirections", detailedChannels.size()));
+}
+
+cModule* NetBuilder::createNode(cModuleType *modType, cModule *parent, int nodeId, int numOutGates, int numInGates) {
+    // Creates a node module whose gate vectors are already sized to its final degree, so that connecting
+    // its channels later on never has to grow or scan them
+
+    std::string nodeName = "node" + std::to_string(nodeId);
+    cModule *mod = modType->create(nodeName.c_str(), parent);
+    mod->finalizeParameters();
+    mod->setGateSize("out", numOutGates);
+    mod->setGateSize("in", numInGates);
+
+    cTopology::Node *node = new cTopology::Node(mod->getId());
+    globalTopology->addNode(node);
+
+    return mod;
+}
+
+void NetBuilder::buildNetwork(cModule *parent) {
+
+    _startupStart = std::chrono::steady_clock::now();
+
+    // Partitions of a parallel run each build the whole network, with placeholders for the nodes they do not simulate
+    numPartitions = std::max(1, getEnvir()->getParsimNumPartitions());
+    partitionId = numPartitions > 1 ? getEnvir()->getParsimProcId() : 0;
+    _buildScalars.clear();
+    restoringCheckpoint = !par("restoreFile").stdstringValue().empty();
+    if (restoringCheckpoint && numPartitions > 1)
+        throw cRuntimeError("Checkpoints cannot be restored in parallel runs");
+    if (restoringCheckpoint || par("checkpointInterval").doubleValue() > 0) {
+        for (int k = 0; k < getEnvir()->getNumRNGs(); k++) {
+            if (dynamic_cast<CheckpointRNG *>(getEnvir()->getRNG(k)) == nullptr)
+                throw cRuntimeError("Checkpoints require rng-class = \"CheckpointRNG\", whose state can be saved and restored");
+        }
+    }
+
+    // Initialize workload and statistics configuration
+    initWorkload();
+    initChannelStats();
+    networkPaymentLatency.clear();
+    networkCommitBatchingDelay.clear();
+    networkLinkDelay.clear();
+    routeOracle.close(); // its workers read the routing graph of the previous run
+    leafParents.clear();
+    _leafParentIds.clear();
+    topologyCache.clear();
+
+    // Initialize variables and build network
+    std::map<int, cModule *> nodeIdToMod;
+    std::map<int, std::pair<int, int> > nodeDegrees; // nodeId to (outDegree, inDegree)
+    std::map<int, std::pair<int, int> > nextGateIndex; // nodeId to (next out gate, next in gate)
+    std::string modClassName = "FullNode";
+    std::vector<std::tuple<cTopology::Link*, cGate*, cGate*>> linksBuffer;
+    std::vector<std::pair<std::string, std::string> > channelReservoir; // channel directions sampled for statistics so far
+    size_t sampleSize = par("channelStatsSampleSize").intValue();
+
+    cModuleType *modType = cModuleType::find(modClassName.c_str());
+    if (!modType)
+        throw cRuntimeError("Module class `%s' not found", modClassName.c_str());
+
+    EV << "Building network from file: " << par("topologyFile").stringValue() << "\n";
+
+    // First pass: get all edges (from the topology cache if this input was seen before) and count the degree of every node
+    std::vector<TopologyEdge> edges;
+    std::string cacheFileName = getCacheFileName();
+    bool cacheHit = !cacheFileName.empty() && topologyCache.load(cacheFileName);
+    if (cacheHit) {
+        EV << "Loading topology and routes from cache file: " << cacheFileName << "\n";
+        edges = topologyCache.getEdges();
+        _leafParentIds = topologyCache.getLeafParents();
+        leafParents.clear();
+        for (const auto& leaf : _leafParentIds)
+            leafParents["node" + std::to_string(leaf.first)] = "node" + std::to_string(leaf.second);
+        if (par("pruneTopology").boolValue())
+            _buildScalars.push_back(std::make_pair("droppedPayments", dropUnroutablePayments(edges)));
+    }
+    else {
+        edges = parseTopology();
+        if (par("pruneTopology").boolValue())
+            edges = pruneTopology(edges);
+    }
+    if (!cacheFileName.empty())
+        _buildScalars.push_back(std::make_pair("topologyCacheHit", cacheHit));
+
+    // Only fill the cache (e.g. once before a sweep of replications, which then map the same cache file)
+    if (par("cacheOnly").boolValue()) {
+        if (cacheFileName.empty())
+            throw cRuntimeError("cacheOnly requires a cacheDirectory");
+        if (!cacheHit) {
+            adjMatrix.clear();
+            addRoutingEdges(edges, leafParents, adjMatrix);
+            std::map<std::pair<int, int>, std::vector<int> > routes = precomputeRoutes();
+            try {
+                topologyCache.store(cacheFileName, edges, _leafParentIds, routes);
+            } catch (const std::runtime_error& e) {
+                throw cRuntimeError("%s", e.what());
+            }
+            EV << "Stored topology and " << routes.size() << " routes in cache file: " << cacheFileName << "\n";
         }
+        return;
+    }
+
+    for (const auto& edge : edges) {
+        nodeDegrees[edge.srcId].first++;
+        nodeDegrees[edge.dstId].second++;
+    }
+
+    // Second pass: create modules (in order of appearance) with their gate vectors sized exactly
+    for (const auto& edge : edges) {
+        if (!nodeExists(nodeIdToMod, edge.srcId))
+            nodeIdToMod[edge.srcId] = createNode(modType, parent, edge.srcId, nodeDegrees[edge.srcId].first, nodeDegrees[edge.srcId].second);
+        if (!nodeExists(nodeIdToMod, edge.dstId))
+            nodeIdToMod[edge.dstId] = createNode(modType, parent, edge.dstId, nodeDegrees[edge.dstId].first, nodeDegrees[edge.dstId].second);
+    }
+
+    // Third pass: connect every edge to the next free gate index of its endpoints
+    for (const auto& edge : edges) {
+
+        // Define module names
+        std::string srcName = "node" + std::to_string(edge.srcId);
+        std::string dstName = "node" + std::to_string(edge.dstId);
+        cModule *srcMod = nodeIdToMod[edge.srcId];
+        cModule *dstMod = nodeIdToMod[edge.dstId];
 
         // Connect modules
-        cGate *srcOut, *dstIn;
-        srcOut = srcMod->getOrCreateFirstUnconnectedGate("out", 0, false, true);
-        dstIn = dstMod->getOrCreateFirstUnconnectedGate("in", 0, false, true);
-        connect(srcOut, dstIn, linkDelay);
+        cGate *srcOut = srcMod->gate("out", nextGateIndex[edge.srcId].first++);
+        cGate *dstIn = dstMod->gate("in", nextGateIndex[edge.dstId].second++);
+        connect(srcOut, dstIn, edge.linkDelay);
 
         // Define link weights
-        double weight = 1/capacity;
-        std::vector<double> weightVector{capacity, fee, linkQuality};
+        double weight = 1/edge.capacity;
 
         // Add link to links buffer (we use a buffer because we can`t safely add links before all modules are built)
         cTopology::Link *link = new cTopology::Link(weight);
         auto linkTuple = std::make_tuple(link, srcOut, dstIn);
         linksBuffer.push_back(linkTuple);
 
-        //Initialize payment channels and add nodes to adjacency matrix
-        auto pc = std::make_tuple(capacity, fee, linkQuality, maxAcceptedHTLCs, HTLCMinimumMsat, channelReserveSatoshis, srcOut, dstIn);
+        //Initialize payment channels
+        auto pc = std::make_tuple(edge.capacity, edge.fee, edge.linkQuality, edge.maxAcceptedHTLCs, edge.HTLCMinimumMsat, edge.channelReserveSatoshis, srcOut, dstIn);
         nameToPCs[srcName][dstName] = pc;
-        adjMatrix[srcName].push_back(std::make_pair(dstName, weightVector));
 
+        // Reservoir-sample the channel directions whose capacity is recorded in sampled mode
+        if (channelStatsMode == CHANNEL_STATS_SAMPLED) {
+            if (channelReservoir.size() < sampleSize)
+                channelReservoir.push_back(std::make_pair(srcName, dstName));
+            else if (sampleSize > 0) {
+                size_t slot = intuniform(0, linksBuffer.size() - 1);
+                if (slot < sampleSize)
+                    channelReservoir[slot] = std::make_pair(srcName, dstName);
+            }
+        }
+
+    }
+
+    // Nodes hanging from the routing core are reached by walking their leaf parents, so they stay out of the routing
+    // graph. On a cache hit the workload routes are already known and FullNode::findRoute builds the graph only if it
+    // needs a route that was not cached.
+    adjMatrix.clear();
+    if (!cacheHit)
+        addRoutingEdges(edges, leafParents, adjMatrix);
+
+    // Routes only depend on the static channel graph, so they are computed once here and stored along with the topology
+    if (!cacheFileName.empty() && !cacheHit) {
+        std::map<std::pair<int, int>, std::vector<int> > routes = precomputeRoutes();
+        try {
+            topologyCache.store(cacheFileName, edges, _leafParentIds, routes);
+            EV << "Stored topology and " << routes.size() << " routes in cache file: " << cacheFileName << "\n";
+        } catch (const std::runtime_error& e) {
+            EV_WARN << "WARNING: " << e.what() << ". Precomputed routes are only used in this run.\n";
+        }
+    }
+
+    sampledChannels.insert(channelReservoir.begin(), channelReservoir.end());
+    selectDetailedChannels(edges, nodeIdToMod, cacheHit);
+
+    // Channels start from a saved state (e.g. the end of an earlier run's warm-up) instead of the topology's capacities
+    if (!par("channelSnapshotLoadFile").stdstringValue().empty())
+        loadChannelSnapshot();
+
+    // A payee cannot open a channel to a payer in another partition to send the invoice, so in parallel runs payers
+    // create their own invoices (see FullNode::schedulePartitionedPayments)
+    outgoingPayments.clear();
+    if (numPartitions > 1) {
+        for (const auto& payee : pendingPayments) {
+            for (size_t i = 0; i < payee.second.size(); i++) {
+                const std::tuple<std::string, double, simtime_t>& payment = payee.second[i];
+                outgoingPayments[std::get<0>(payment)].push_back(std::make_tuple(payee.first, std::get<1>(payment), std::get<2>(payment), (int) i));
+            }
+        }
     }
 
-    // Build modules
-    std::map<int, cModule*>::iterator it;
-    for (it = nodeIdToMod.begin(); it != nodeIdToMod.end(); it++) {
-        cModule *mod = it->second;
-        mod->buildInside();
+    // Build modules (the kernel initializes them along with the rest of the network)
+    int numLocalNodes = 0;
+    for (const auto& node : nodeIdToMod) {
+        if (node.second->isPlaceholder())
+            continue;
+        node.second->buildInside();
+        numLocalNodes++;
     }
+    if (numPartitions > 1)
+        _buildScalars.push_back(std::make_pair("partitionNodes", numLocalNodes));
 
     // Add links to global topology
     for(const auto& linkTuple: linksBuffer) {
@@ -199,15 +1058,4 @@ void NetBuilder::buildNetwork(cModule *parent) {
         globalTopology->addLink(link, srcGate, dstGate);
     }
 
-    // Initialize modules
-    bool more = true;
-    for (int stage = 0; more; stage++) {
-        more = false;
-        for (it = nodeIdToMod.begin(); it != nodeIdToMod.end(); ++it) {
-            cModule *mod = it->second;
-            if (mod->callInitialize(stage))
-                more = true;
-        }
-    }
-
 }
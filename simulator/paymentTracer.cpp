@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "paymentTracer.h"
+
+void PaymentTracer::configure(const std::string& prefixes, double rate, const std::string& fileName) {
+
+    close();
+    if (rate < 0 || rate > 1)
+        throw std::invalid_argument("the payment tracing rate must be between 0 and 1");
+
+    _prefixes.clear();
+    std::istringstream tokens(prefixes);
+    std::string prefix;
+    while (getline(tokens, prefix, ',')) {
+        prefix.erase(std::remove_if(prefix.begin(), prefix.end(), ::isspace), prefix.end());
+        if (prefix.empty())
+            continue;
+        std::transform(prefix.begin(), prefix.end(), prefix.begin(), ::tolower);
+        if (prefix.find_first_not_of("0123456789abcdef") != std::string::npos)
+            throw std::invalid_argument("payment hash prefix `" + prefix + "' is not hexadecimal");
+        _prefixes.push_back(prefix);
+    }
+    _rateThreshold = (uint64_t) (rate * 4294967296.0);
+
+    _enabled = !_prefixes.empty() || _rateThreshold > 0;
+    if (!_enabled)
+        return;
+
+    if (fileName.empty()) {
+        _out = &std::cout;
+    } else {
+        _file.open(fileName, std::ofstream::out | std::ofstream::trunc);
+        if (!_file)
+            throw std::runtime_error("could not open payment trace file " + fileName);
+        _out = &_file;
+    }
+    _out->precision(12);
+}
+
+void PaymentTracer::close() {
+    if (_out != nullptr)
+        _out->flush();
+    if (_file.is_open())
+        _file.close();
+    _out = nullptr;
+    _enabled = false;
+}
+
+bool PaymentTracer::isTraced(const std::string& paymentHash) const {
+
+    if (!_enabled)
+        return false;
+
+    for (const auto& prefix : _prefixes) {
+        if (paymentHash.compare(0, prefix.size(), prefix) == 0)
+            return true;
+    }
+
+    if (_rateThreshold == 0 || paymentHash.size() < 8)
+        return false;
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        char c = paymentHash[i];
+        value = (value << 4) | (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+    return value < _rateThreshold;
+}
+
+std::ostream& PaymentTracer::log(double simTime, const char *nodeName) {
+    return *_out << "[" << simTime << "] " << nodeName << ": ";
+}
@@ -0,0 +1,34 @@
+#ifndef _PAYMENTTRACER_H_
+#define _PAYMENTTRACER_H_
+
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Selects payments by payment hash and logs their events on every node, independently of EV logging. Selection is
+// deterministic: a payment is traced if its hash starts with one of the configured prefixes or if the hash, read as a
+// number, falls in the configured fraction of the hash space.
+class PaymentTracer {
+
+    public:
+        // prefixes is a comma-separated list of hex prefixes. Logs go to fileName, or to stdout if it is empty.
+        // Throws std::invalid_argument for malformed prefixes or rates and std::runtime_error if the file cannot be opened.
+        void configure(const std::string& prefixes, double rate, const std::string& fileName);
+        void close();
+        bool isEnabled() const { return _enabled; };
+        bool isTraced(const std::string& paymentHash) const;
+
+        // Starts a log line about a traced payment; the caller ends it with "\n"
+        std::ostream& log(double simTime, const char *nodeName);
+
+    private:
+        bool _enabled = false;
+        std::vector<std::string> _prefixes;
+        uint64_t _rateThreshold = 0; // hashes whose first 32 bits are below this are traced
+        std::ofstream _file;
+        std::ostream *_out = nullptr;
+};
+
+#endif
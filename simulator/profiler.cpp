@@ -0,0 +1,118 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include "messages.h"
+#include "profiler.h"
+
+#if PROFILE_ALLOCATIONS
+namespace {
+
+std::atomic<uint64_t> allocationCount(0);
+
+} // namespace
+
+// Replaces the global allocation function; the default operator delete releases the memory with free()
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+uint64_t getAllocationCount() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+#else
+uint64_t getAllocationCount() {
+    return 0;
+}
+#endif
+
+ProfiledHandler getProfiledHandler(int messageType) {
+    switch (messageType) {
+        case TRANSACTION_INIT: return PROFILE_TRANSACTION_INIT;
+        case INVOICE: return PROFILE_INVOICE;
+        case UPDATE_ADD_HTLC: return PROFILE_UPDATE_ADD_HTLC;
+        case UPDATE_FULFILL_HTLC: return PROFILE_UPDATE_FULFILL_HTLC;
+        case UPDATE_FAIL_HTLC: return PROFILE_UPDATE_FAIL_HTLC;
+        case PAYMENT_REFUSED: return PROFILE_PAYMENT_REFUSED;
+        case COMMITMENT_SIGNED: return PROFILE_COMMITMENT_SIGNED;
+        case REVOKE_AND_ACK: return PROFILE_REVOKE_AND_ACK;
+        default: return PROFILE_OTHER;
+    }
+}
+
+const char* getProfiledHandlerName(int handler) {
+    static const char *names[NUM_PROFILED_HANDLERS] = {"TRANSACTION_INIT", "INVOICE", "UPDATE_ADD_HTLC", "UPDATE_FULFILL_HTLC",
+            "UPDATE_FAIL_HTLC", "PAYMENT_REFUSED", "COMMITMENT_SIGNED", "REVOKE_AND_ACK", "OTHER"};
+    return (handler >= 0 && handler < NUM_PROFILED_HANDLERS) ? names[handler] : "UNKNOWN";
+}
+
+void HandlerTimer::stop(HandlerCounters& nodeCounters, HandlerCounters& networkCounters) const {
+    uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+    uint64_t allocations = getAllocationCount() - _startAllocations;
+
+    nodeCounters.events++;
+    nodeCounters.nanoseconds += nanoseconds;
+    nodeCounters.allocations += allocations;
+    networkCounters.events++;
+    networkCounters.nanoseconds += nanoseconds;
+    networkCounters.allocations += allocations;
+}
+
+void HandlerProfiler::configure(bool enabled, const std::string& fileName, const std::string& format, double interval) {
+
+    if (format != "json" && format != "csv")
+        throw std::invalid_argument("unknown profile format `" + format + "'");
+
+    _enabled = enabled;
+    _json = (format == "json");
+    _interval = interval;
+    _networkProfile = HandlerProfile();
+    _start = std::chrono::steady_clock::now();
+    _nextDump = _start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+
+    if (_file.is_open())
+        _file.close();
+    if (!enabled || fileName.empty())
+        return;
+
+    _file.open(fileName, std::ofstream::out | std::ofstream::trunc);
+    if (!_file)
+        throw std::runtime_error("could not open profile file " + fileName);
+    if (!_json)
+        _file << "wallSeconds,simTime,handler,events,seconds,allocations\n";
+}
+
+void HandlerProfiler::dump(double simTime, bool force) {
+
+    if (!_file.is_open())
+        return;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (!force && (_interval <= 0 || now < _nextDump))
+        return;
+    while (_interval > 0 && _nextDump <= now)
+        _nextDump += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(_interval));
+
+    // One JSON object per line (JSON Lines) or one CSV row per handler, cumulative since the start of the run
+    double wallSeconds = std::chrono::duration<double>(now - _start).count();
+    if (_json) {
+        _file << "{\"wallSeconds\":" << wallSeconds << ",\"simTime\":" << simTime << ",\"handlers\":{";
+        for (int i = 0; i < NUM_PROFILED_HANDLERS; i++) {
+            const HandlerCounters& counters = _networkProfile[i];
+            _file << (i > 0 ? "," : "") << "\"" << getProfiledHandlerName(i) << "\":{\"events\":" << counters.events
+                    << ",\"seconds\":" << counters.nanoseconds * 1e-9 << ",\"allocations\":" << counters.allocations << "}";
+        }
+        _file << "}}\n";
+    } else {
+        for (int i = 0; i < NUM_PROFILED_HANDLERS; i++) {
+            const HandlerCounters& counters = _networkProfile[i];
+            _file << wallSeconds << "," << simTime << "," << getProfiledHandlerName(i) << "," << counters.events << ","
+                    << counters.nanoseconds * 1e-9 << "," << counters.allocations << "\n";
+        }
+    }
+    _file.flush();
+}
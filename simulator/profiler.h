@@ -0,0 +1,79 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Counts every operator new call in the process so handlers can report their allocations. The replacement operator new
+// costs an atomic increment on every allocation, profiled or not, so it is only compiled in by `make PROFILE_ALLOCATIONS=1`.
+#ifndef PROFILE_ALLOCATIONS
+#define PROFILE_ALLOCATIONS 0
+#endif
+
+// Handlers whose cost is tracked, in the order they appear in reports
+enum ProfiledHandler {
+    PROFILE_TRANSACTION_INIT,
+    PROFILE_INVOICE,
+    PROFILE_UPDATE_ADD_HTLC,
+    PROFILE_UPDATE_FULFILL_HTLC,
+    PROFILE_UPDATE_FAIL_HTLC,
+    PROFILE_PAYMENT_REFUSED,
+    PROFILE_COMMITMENT_SIGNED,
+    PROFILE_REVOKE_AND_ACK,
+    PROFILE_OTHER, // timers and unknown message types
+    NUM_PROFILED_HANDLERS
+};
+
+ProfiledHandler getProfiledHandler(int messageType);
+const char* getProfiledHandlerName(int handler);
+
+// Number of operator new calls so far (always 0 if PROFILE_ALLOCATIONS is 0)
+uint64_t getAllocationCount();
+
+struct HandlerCounters {
+    uint64_t events = 0;
+    uint64_t nanoseconds = 0;
+    uint64_t allocations = 0;
+};
+
+typedef std::array<HandlerCounters, NUM_PROFILED_HANDLERS> HandlerProfile;
+
+// Measures one handler invocation and adds it to a per-node and a network-wide profile
+class HandlerTimer {
+
+    public:
+        HandlerTimer() : _start(std::chrono::steady_clock::now()), _startAllocations(getAllocationCount()) {};
+
+        void stop(HandlerCounters& nodeCounters, HandlerCounters& networkCounters) const;
+
+    private:
+        std::chrono::steady_clock::time_point _start;
+        uint64_t _startAllocations;
+};
+
+// Network-wide handler profile, optionally appended to a JSON Lines or CSV file every interval of wall-clock time
+class HandlerProfiler {
+
+    public:
+        // Throws std::invalid_argument for unknown formats and std::runtime_error if the file cannot be opened
+        void configure(bool enabled, const std::string& fileName, const std::string& format, double interval);
+        bool isEnabled() const { return _enabled; };
+        HandlerProfile& getNetworkProfile() { return _networkProfile; };
+
+        // Appends a snapshot of the network profile if the dump interval elapsed (or unconditionally if forced)
+        void dump(double simTime, bool force = false);
+
+    private:
+        bool _enabled = false;
+        bool _json = true;
+        double _interval = 0;
+        std::ofstream _file;
+        HandlerProfile _networkProfile;
+        std::chrono::steady_clock::time_point _start;
+        std::chrono::steady_clock::time_point _nextDump;
+};
+
+#endif
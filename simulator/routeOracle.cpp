@@ -0,0 +1,221 @@
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include "routeOracle.h"
+
+void RouteOracle::configure(int numThreads, const AdjacencyMap *graph, const std::map<std::string, std::string> *leafParents) {
+
+    close();
+    if (numThreads < 0)
+        throw std::invalid_argument("the number of route oracle threads cannot be negative");
+    _numRequests = _numWaits = _numInline = _numExpired = 0;
+    _waitTime = 0;
+    if (numThreads == 0)
+        return;
+
+    _graph = graph;
+    _leafParents = leafParents;
+    _stopping = false;
+    for (int i = 0; i < numThreads; i++)
+        _workers.push_back(std::thread(&RouteOracle::workerLoop, this));
+    _enabled = true;
+}
+
+void RouteOracle::close() {
+
+    if (!_enabled)
+        return;
+    _enabled = false;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _condition.notify_all();
+    for (auto& worker : _workers)
+        worker.join();
+    _workers.clear();
+
+    _queue = decltype(_queue)();
+    _completed.store(nullptr);
+    _jobs.clear();
+    _expiry = decltype(_expiry)();
+    _freeJobs.clear();
+    _storage.clear();
+}
+
+void RouteOracle::request(const std::string& src, const std::string& target, double time) {
+
+    if (!_enabled)
+        return;
+    _numRequests++;
+
+    auto key = std::make_pair(src, target);
+    Job *&job = _jobs[key];
+    if (job != nullptr) {
+        job->pendingTakes++;
+        if (time > job->time) {
+            job->time = time;
+            _expiry.push(std::make_pair(time, key));
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        job = allocateJob();
+        job->src = src;
+        job->target = target;
+        job->pendingTakes = 1;
+        job->time = time;
+        job->queued = true;
+        _queue.push(std::make_pair(std::make_pair(time, _sequence++), job));
+    }
+    _expiry.push(std::make_pair(time, key));
+    _condition.notify_one();
+}
+
+bool RouteOracle::take(const std::string& src, const std::string& target, std::vector<std::string>& path) {
+
+    if (!_enabled)
+        return false;
+    auto it = _jobs.find(std::make_pair(src, target));
+    if (it == _jobs.end())
+        return false;
+    Job *job = it->second;
+
+    if (!job->completed)
+        drainCompleted();
+    if (!job->completed) {
+        int queued = JOB_QUEUED;
+        if (job->state.compare_exchange_strong(queued, JOB_RUNNING)) {
+            // No worker got to it yet, so computing it here is faster than waiting for one
+            job->path = computeRoute(job->src, job->target, *_graph, *_leafParents);
+            job->state.store(JOB_DONE);
+            job->completed = true;
+            _numInline++;
+        } else {
+            // Routes take milliseconds at most, so the wait spins instead of sleeping on a condition
+            auto start = std::chrono::steady_clock::now();
+            _numWaits++;
+            while (!job->completed) {
+                std::this_thread::yield();
+                drainCompleted();
+            }
+            _waitTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    if (--job->pendingTakes > 0) {
+        path = job->path;
+    } else {
+        path.swap(job->path);
+        _jobs.erase(it);
+        releaseJob(job);
+    }
+    return true;
+}
+
+void RouteOracle::expire(double time) {
+
+    if (!_enabled)
+        return;
+    drainCompleted();
+
+    std::vector<ExpiryEntry> running;
+    while (!_expiry.empty() && _expiry.top().first < time) {
+        ExpiryEntry entry = _expiry.top();
+        _expiry.pop();
+        auto it = _jobs.find(entry.second);
+        if (it == _jobs.end() || it->second->time != entry.first)
+            continue;
+        Job *job = it->second;
+
+        // A completed job is off the completion stack and one claimed here never gets on it, so either can be freed
+        int queued = JOB_QUEUED;
+        if (!job->completed && !job->state.compare_exchange_strong(queued, JOB_DONE)) {
+            running.push_back(entry);
+            continue;
+        }
+        _jobs.erase(it);
+        releaseJob(job);
+        _numExpired++;
+    }
+    for (auto& entry : running)
+        _expiry.push(entry);
+}
+
+RouteOracle::Job *RouteOracle::allocateJob() {
+    // Called with _mutex held
+
+    if (_freeJobs.empty()) {
+        _storage.emplace_back();
+        return &_storage.back();
+    }
+    Job *job = _freeJobs.back();
+    _freeJobs.pop_back();
+    job->path.clear();
+    job->state.store(JOB_QUEUED);
+    job->next = nullptr;
+    job->completed = false;
+    job->released = false;
+    return job;
+}
+
+void RouteOracle::releaseJob(Job *job) {
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (job->queued)
+        job->released = true;
+    else
+        _freeJobs.push_back(job);
+}
+
+void RouteOracle::workerLoop() {
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _condition.wait(lock, [this] { return !_queue.empty() || _stopping; });
+        if (_stopping)
+            return;
+
+        Job *job = _queue.top().second;
+        _queue.pop();
+        job->queued = false;
+        if (job->released) {
+            _freeJobs.push_back(job);
+            continue;
+        }
+
+        // Claimed before the lock is released: once the job is off the queue, whoever took it inline may free it
+        int queued = JOB_QUEUED;
+        if (!job->state.compare_exchange_strong(queued, JOB_RUNNING))
+            continue;
+        lock.unlock();
+
+        job->path = computeRoute(job->src, job->target, *_graph, *_leafParents);
+        job->state.store(JOB_DONE, std::memory_order_release);
+        pushCompleted(job);
+        lock.lock();
+    }
+}
+
+void RouteOracle::pushCompleted(Job *job) {
+    // Treiber stack push: any number of workers, one consumer
+
+    Job *head = _completed.load(std::memory_order_relaxed);
+    do {
+        job->next = head;
+    } while (!_completed.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void RouteOracle::drainCompleted() {
+    // The single consumer takes the whole stack at once, so popping needs no ABA protection
+
+    Job *job = _completed.exchange(nullptr, std::memory_order_acquire);
+    while (job != nullptr) {
+        Job *next = job->next;
+        job->completed = true;
+        job = next;
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef _ROUTEORACLE_H_
+#define _ROUTEORACLE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "routing.h"
+
+// Computes routes on a pool of worker threads ahead of simulated time. Routes are requested when a payment is
+// scheduled and taken when its invoice arrives, so the event loop only waits for routes that are not ready by then.
+// Workers hand finished routes back through a lock-free completion stack. Everything but the workers runs on the
+// simulation thread, and the routing graph must not change while the oracle is running.
+class RouteOracle {
+
+    public:
+        ~RouteOracle() { close(); };
+
+        // Starts numThreads workers over graph and leafParents (disabled if numThreads is 0)
+        void configure(int numThreads, const AdjacencyMap *graph, const std::map<std::string, std::string> *leafParents);
+        // Stops the workers and drops every route
+        void close();
+        bool isEnabled() const { return _enabled; };
+
+        // Queues the route from src to target, needed at simulated time (routes needed earlier are computed first).
+        // A pair requested several times is computed once.
+        void request(const std::string& src, const std::string& target, double time);
+        // Returns false if the route was not requested. Otherwise waits until it is computed (or computes it right away
+        // if no worker has started on it yet) and fills path; the route is dropped after its last request is taken.
+        bool take(const std::string& src, const std::string& target, std::vector<std::string>& path);
+        // Drops the routes last needed before time that were never taken (their payments ended without asking for
+        // them), except those a worker is still computing, which go on a later call
+        void expire(double time);
+
+        uint64_t getNumRequests() const { return _numRequests; };
+        uint64_t getNumWaits() const { return _numWaits; }; // takes that found their route still being computed
+        uint64_t getNumInline() const { return _numInline; }; // takes that computed their route on the simulation thread
+        uint64_t getNumExpired() const { return _numExpired; }; // routes dropped by expire
+        double getWaitTime() const { return _waitTime; }; // wall-clock seconds the simulation spent waiting for workers
+
+    private:
+        enum JobState { JOB_QUEUED, JOB_RUNNING, JOB_DONE };
+
+        struct Job {
+            std::string src;
+            std::string target;
+            std::vector<std::string> path;
+            std::atomic<int> state{JOB_QUEUED}; // claimed by a worker or by take
+            Job *next = nullptr; // completion stack link
+            bool completed = false; // seen by the simulation thread (through the stack or computed inline)
+            int pendingTakes = 0;
+            double time = 0; // latest simulated time any of its requests needs it
+            bool queued = false; // still referenced by _queue (guarded by _mutex)
+            bool released = false; // taken for the last time (or expired) while still queued, so the worker that pops it frees it
+        };
+
+        // Work queue entries are (time, sequence number) ordered
+        typedef std::pair<std::pair<double, uint64_t>, Job *> QueueEntry;
+        // Expiry entries are (time, (src, target)); one whose time is no longer the job's is stale and skipped
+        typedef std::pair<double, std::pair<std::string, std::string> > ExpiryEntry;
+
+        void workerLoop();
+        void pushCompleted(Job *job);
+        void drainCompleted();
+        Job *allocateJob();
+        void releaseJob(Job *job);
+
+        bool _enabled = false;
+        const AdjacencyMap *_graph = nullptr;
+        const std::map<std::string, std::string> *_leafParents = nullptr;
+
+        // Simulation thread only, except for _freeJobs. A job taken for the last time (or expired) goes back to
+        // _freeJobs once no queue entry refers to it (a job taken inline stays queued until a worker pops and skips
+        // it), so _storage only grows with the routes outstanding at a time.
+        std::deque<Job> _storage;
+        std::vector<Job *> _freeJobs; // guarded by _mutex
+        std::map<std::pair<std::string, std::string>, Job *> _jobs;
+        std::priority_queue<ExpiryEntry, std::vector<ExpiryEntry>, std::greater<ExpiryEntry> > _expiry;
+        uint64_t _sequence = 0;
+        uint64_t _numRequests = 0;
+        uint64_t _numWaits = 0;
+        uint64_t _numInline = 0;
+        uint64_t _numExpired = 0;
+        double _waitTime = 0;
+
+        std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > _queue;
+        bool _stopping = false;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        std::vector<std::thread> _workers;
+
+        std::atomic<Job *> _completed{nullptr};
+};
+
+#endif
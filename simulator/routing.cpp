@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include "routing.h"
+
+void addRoutingEdges(const std::vector<TopologyEdge>& edges, const std::map<std::string, std::string>& leafParents, AdjacencyMap& graph) {
+
+    for (const auto& edge : edges) {
+        std::string srcName = "node" + std::to_string(edge.srcId);
+        std::string dstName = "node" + std::to_string(edge.dstId);
+        if (leafParents.find(srcName) == leafParents.end() && leafParents.find(dstName) == leafParents.end())
+            graph[srcName].push_back(std::make_pair(dstName, std::vector<double>{edge.capacity, edge.fee, edge.linkQuality}));
+    }
+}
+
+std::vector<std::string> dijkstraWeightedShortestPath(const std::string& src, const std::string& target, const AdjacencyMap& graph) {
+    // Heap-based Dijkstra. Among nodes at the same distance, the one with the greatest name is settled first, which is
+    // the order the original linear minimum search over the (sorted) node map used, so routes do not change.
+
+    typedef std::pair<double, const std::string *> QueueEntry;
+    auto settleFirst = [](const QueueEntry& a, const QueueEntry& b) {
+        if (a.first != b.first)
+            return a.first > b.first;
+        return *a.second < *b.second;
+    };
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, decltype(settleFirst)> queue(settleFirst);
+    std::map<std::string, double> distances;
+    std::map<std::string, std::string> parents; // a.k.a nodeToParent
+    std::map<std::string, bool> visited;
+
+    distances[src] = 0;
+    parents[src] = src;
+    queue.push(std::make_pair(0.0, &parents.find(src)->first));
+
+    while (!queue.empty()) {
+        std::string node = *queue.top().second;
+        double distance = queue.top().first;
+        queue.pop();
+        if (visited[node] || distance > distances[node])
+            continue;
+        visited[node] = true;
+        if (node == target)
+            break;
+
+        AdjacencyMap::const_iterator adjacency = graph.find(node);
+        if (adjacency == graph.end())
+            continue;
+
+        // Update distance value of neighbor nodes of the current node
+        for (const auto& edge : adjacency->second) {
+            const std::string& neighbor = edge.first;
+            double capacity = edge.second[0];
+
+            // Define weight as a combination of parameters in the weightVector
+            double linkWeight = 1/capacity;
+
+            if (visited[neighbor])
+                continue;
+            std::map<std::string, double>::iterator neighborDistance = distances.find(neighbor);
+            double newDistance = distance + linkWeight;
+            if (neighborDistance == distances.end() || newDistance < neighborDistance->second) {
+                distances[neighbor] = newDistance;
+                parents[neighbor] = node;
+                queue.push(std::make_pair(newDistance, &parents.find(neighbor)->first));
+            }
+        }
+    }
+
+    // Return the path to source given a target and its parent nodes
+    std::vector<std::string> path;
+    if (parents.find(target) == parents.end())
+        return path;
+    for (std::string node = target; ; node = parents[node]) {
+        path.push_back(node);
+        if (parents[node] == node)
+            break;
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+namespace {
+
+std::vector<std::string> getBranchToCore(const std::string& node, const std::map<std::string, std::string>& leafParents) {
+    // Returns the nodes from the given node up to the routing core, following the parents of nodes pruned as leaves
+
+    std::vector<std::string> branch{node};
+    std::map<std::string, std::string>::const_iterator it = leafParents.find(node);
+    while (it != leafParents.end()) {
+        branch.push_back(it->second);
+        it = leafParents.find(it->second);
+    }
+    return branch;
+}
+
+} // namespace
+
+std::vector<std::string> computeRoute(const std::string& src, const std::string& target, const AdjacencyMap& graph, const std::map<std::string, std::string>& leafParents) {
+    // Nodes that hang from the network through a single neighbor have exactly one way in and out, so we walk up to
+    // their attachment points and only run Dijkstra over the routing core
+
+    std::vector<std::string> srcBranch = getBranchToCore(src, leafParents);
+    std::vector<std::string> targetBranch = getBranchToCore(target, leafParents);
+    std::vector<std::string> path;
+
+    // If both ends hang from the same branch, join them at their first common node
+    for (size_t i = 0; i < srcBranch.size(); i++) {
+        std::vector<std::string>::iterator common = std::find(targetBranch.begin(), targetBranch.end(), srcBranch[i]);
+        if (common != targetBranch.end()) {
+            path.assign(srcBranch.begin(), srcBranch.begin() + i + 1);
+            path.insert(path.end(), std::reverse_iterator<std::vector<std::string>::iterator>(common), targetBranch.rend());
+            return path;
+        }
+    }
+
+    // Otherwise go up to the core, cross it and come down to the target
+    std::vector<std::string> corePath = dijkstraWeightedShortestPath(srcBranch.back(), targetBranch.back(), graph);
+    if (corePath.empty())
+        return corePath;
+    path.assign(srcBranch.begin(), srcBranch.end() - 1);
+    path.insert(path.end(), corePath.begin(), corePath.end());
+    path.insert(path.end(), targetBranch.rbegin() + 1, targetBranch.rend());
+    return path;
+}
@@ -0,0 +1,25 @@
+#ifndef _ROUTING_H_
+#define _ROUTING_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "topology.h"
+
+// Identifies the link weight used by the routing functions below (part of the topology cache key)
+#define ROUTING_COST_FUNCTION "dijkstra;weight=1/capacity"
+
+// nodeName to (neighborName, {capacity, fee, linkQuality}) list, the format of the global adjMatrix
+typedef std::map<std::string, std::vector<std::pair<std::string, std::vector<double> > > > AdjacencyMap;
+
+// Adds every edge that does not touch a node in leafParents to graph, weighted by {capacity, fee, linkQuality}
+void addRoutingEdges(const std::vector<TopologyEdge>& edges, const std::map<std::string, std::string>& leafParents, AdjacencyMap& graph);
+
+// Dijkstra's shortest path from src to target. Returns an empty path if target is unreachable.
+std::vector<std::string> dijkstraWeightedShortestPath(const std::string& src, const std::string& target, const AdjacencyMap& graph);
+
+// Shortest path that walks the branches of nodes pruned as leaves and runs Dijkstra only over the routing core
+std::vector<std::string> computeRoute(const std::string& src, const std::string& target, const AdjacencyMap& graph, const std::map<std::string, std::string>& leafParents);
+
+#endif
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <unordered_map>
+#include "topology.h"
+
+namespace {
+
+// Maps the (possibly sparse) node ids of a topology to dense indexes in order of appearance
+void indexNodes(const std::vector<TopologyEdge>& edges, std::unordered_map<int, int>& idToIndex, std::vector<int>& indexToId) {
+    for (const auto& edge : edges) {
+        for (int nodeId : {edge.srcId, edge.dstId}) {
+            if (idToIndex.find(nodeId) == idToIndex.end()) {
+                idToIndex[nodeId] = indexToId.size();
+                indexToId.push_back(nodeId);
+            }
+        }
+    }
+}
+
+} // namespace
+
+BinaryTopologyWriter::BinaryTopologyWriter(const std::string& fileName) {
+    _file.open(fileName, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    if (!_file)
+        throw std::runtime_error("could not open binary topology file " + fileName);
+
+    // Reserve space for the header; it is rewritten with the final edge count on close
+    TopologyFileHeader header = {};
+    _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+void BinaryTopologyWriter::write(const TopologyEdge& edge) {
+    _file.write(reinterpret_cast<const char *>(&edge), sizeof(edge));
+    _numEdges++;
+}
+
+void BinaryTopologyWriter::close() {
+    if (!_file.is_open())
+        return;
+
+    TopologyFileHeader header = {};
+    strncpy(header.magic, TOPOLOGY_FILE_MAGIC, sizeof(header.magic));
+    header.version = TOPOLOGY_FILE_VERSION;
+    header.edgeSize = sizeof(TopologyEdge);
+    header.numEdges = _numEdges;
+    _file.seekp(0);
+    _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    _file.close();
+}
+
+std::vector<TopologyEdge> readBinaryTopology(const std::string& fileName) {
+
+    std::ifstream topologyFile(fileName, std::ifstream::in | std::ifstream::binary);
+    if (!topologyFile)
+        throw std::runtime_error("could not open binary topology file " + fileName);
+
+    TopologyFileHeader header;
+    topologyFile.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!topologyFile || strncmp(header.magic, TOPOLOGY_FILE_MAGIC, sizeof(header.magic)) != 0)
+        throw std::runtime_error(fileName + " is not a binary topology file");
+    if (header.version != TOPOLOGY_FILE_VERSION || header.edgeSize != sizeof(TopologyEdge))
+        throw std::runtime_error(fileName + " was written by an incompatible version of the simulator");
+
+    // Check the edge count against what follows the header, so a corrupt count fails here instead of in the allocation
+    std::streamoff dataStart = topologyFile.tellg();
+    topologyFile.seekg(0, std::ifstream::end);
+    uint64_t dataSize = topologyFile.tellg() - dataStart;
+    topologyFile.seekg(dataStart);
+    if (!topologyFile || header.numEdges > dataSize / sizeof(TopologyEdge))
+        throw std::runtime_error("truncated binary topology file " + fileName);
+
+    std::vector<TopologyEdge> edges(header.numEdges);
+    topologyFile.read(reinterpret_cast<char *>(edges.data()), header.numEdges * sizeof(TopologyEdge));
+    if (!topologyFile)
+        throw std::runtime_error("truncated binary topology file " + fileName);
+
+    return edges;
+}
+
+std::vector<TopologyEdge> extractWorkloadComponent(const std::vector<TopologyEdge>& edges, const std::set<int>& workloadNodes, PruningReport& report) {
+    // Finds the strongly connected components with an iterative version of Tarjan's algorithm
+
+    // Map node ids to dense indexes and build the adjacency list
+    std::unordered_map<int, int> idToIndex;
+    std::vector<int> indexToId;
+    indexNodes(edges, idToIndex, indexToId);
+    int numNodes = indexToId.size();
+    std::vector<std::vector<int> > neighbors(numNodes);
+    for (const auto& edge : edges)
+        neighbors[idToIndex[edge.srcId]].push_back(idToIndex[edge.dstId]);
+
+    std::vector<int> order(numNodes, -1);
+    std::vector<int> lowLink(numNodes, 0);
+    std::vector<int> component(numNodes, -1);
+    std::vector<bool> onStack(numNodes, false);
+    std::vector<int> stack;
+    std::vector<std::pair<int, size_t> > callStack; // node to next neighbor to visit
+    int counter = 0;
+    int numComponents = 0;
+
+    for (int root = 0; root < numNodes; root++) {
+        if (order[root] != -1)
+            continue;
+
+        callStack.push_back(std::make_pair(root, 0));
+        while (!callStack.empty()) {
+            int node = callStack.back().first;
+            size_t& next = callStack.back().second;
+
+            if (next == 0 && order[node] == -1) {
+                order[node] = lowLink[node] = counter++;
+                stack.push_back(node);
+                onStack[node] = true;
+            }
+
+            if (next < neighbors[node].size()) {
+                int neighbor = neighbors[node][next++];
+                if (order[neighbor] == -1)
+                    callStack.push_back(std::make_pair(neighbor, 0));
+                else if (onStack[neighbor])
+                    lowLink[node] = std::min(lowLink[node], order[neighbor]);
+                continue;
+            }
+
+            // All neighbors visited: close the component if this node is its root and return to the caller
+            if (lowLink[node] == order[node]) {
+                int member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    onStack[member] = false;
+                    component[member] = numComponents;
+                } while (member != node);
+                numComponents++;
+            }
+            callStack.pop_back();
+            if (!callStack.empty()) {
+                int caller = callStack.back().first;
+                lowLink[caller] = std::min(lowLink[caller], lowLink[node]);
+            }
+        }
+    }
+
+    // Choose the component with the most workload endpoints, breaking ties by size
+    std::vector<int> componentSize(numComponents, 0);
+    std::vector<int> componentEndpoints(numComponents, 0);
+    for (int node = 0; node < numNodes; node++) {
+        componentSize[component[node]]++;
+        if (workloadNodes.count(indexToId[node]))
+            componentEndpoints[component[node]]++;
+    }
+    int kept = 0;
+    for (int c = 1; c < numComponents; c++) {
+        if (componentEndpoints[c] > componentEndpoints[kept] ||
+                (componentEndpoints[c] == componentEndpoints[kept] && componentSize[c] > componentSize[kept]))
+            kept = c;
+    }
+
+    std::vector<TopologyEdge> keptEdges;
+    for (const auto& edge : edges) {
+        if (component[idToIndex[edge.srcId]] == kept && component[idToIndex[edge.dstId]] == kept)
+            keptEdges.push_back(edge);
+    }
+
+    report.numComponents = numComponents;
+    report.numKeptNodes = numComponents > 0 ? componentSize[kept] : 0;
+    report.numKeptEdges = keptEdges.size();
+    report.numPrunedNodes = numNodes - report.numKeptNodes;
+    report.numPrunedEdges = edges.size() - keptEdges.size();
+
+    return keptEdges;
+}
+
+std::map<int, int> findLeafParents(const std::vector<TopologyEdge>& edges) {
+    // Nodes that hang from the rest of the network through a single neighbor (leaves, and chains or trees of them)
+    // can never carry through-traffic towards other nodes, so routing only needs to walk up to their attachment point
+
+    std::unordered_map<int, int> idToIndex;
+    std::vector<int> indexToId;
+    indexNodes(edges, idToIndex, indexToId);
+    int numNodes = indexToId.size();
+
+    std::vector<std::vector<int> > neighbors(numNodes);
+    for (const auto& edge : edges) {
+        if (edge.srcId == edge.dstId)
+            continue;
+        neighbors[idToIndex[edge.srcId]].push_back(idToIndex[edge.dstId]);
+        neighbors[idToIndex[edge.dstId]].push_back(idToIndex[edge.srcId]);
+    }
+
+    // Both channel directions appear as separate edges, so count every neighbor only once
+    std::vector<int> degrees(numNodes);
+    std::deque<int> leaves;
+    for (int node = 0; node < numNodes; node++) {
+        std::sort(neighbors[node].begin(), neighbors[node].end());
+        neighbors[node].erase(std::unique(neighbors[node].begin(), neighbors[node].end()), neighbors[node].end());
+        degrees[node] = neighbors[node].size();
+        if (degrees[node] == 1)
+            leaves.push_back(node);
+    }
+
+    std::vector<int> parents(numNodes, -1);
+    while (!leaves.empty()) {
+        int leaf = leaves.front();
+        leaves.pop_front();
+        if (degrees[leaf] != 1)
+            continue;
+
+        // The parent is the only neighbor that has not been peeled yet
+        for (int neighbor : neighbors[leaf]) {
+            if (parents[neighbor] == -1 && degrees[neighbor] > 0) {
+                parents[leaf] = neighbor;
+                degrees[leaf] = 0;
+                if (--degrees[neighbor] == 1)
+                    leaves.push_back(neighbor);
+                break;
+            }
+        }
+    }
+
+    std::map<int, int> leafParents;
+    for (int node = 0; node < numNodes; node++) {
+        if (parents[node] != -1)
+            leafParents[indexToId[node]] = indexToId[parents[node]];
+    }
+
+    return leafParents;
+}
@@ -0,0 +1,67 @@
+#ifndef _TOPOLOGY_H_
+#define _TOPOLOGY_H_
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// A directed edge (one payment channel direction) as read from a topology source
+struct TopologyEdge {
+    int srcId;
+    int dstId;
+    double capacity;
+    double fee;
+    double linkQuality;
+    int maxAcceptedHTLCs;
+    double HTLCMinimumMsat;
+    double channelReserveSatoshis;
+    double linkDelay;
+};
+
+// Binary topology files hold this header followed by numEdges raw TopologyEdge records
+#define TOPOLOGY_FILE_MAGIC "PCNTOPO"
+#define TOPOLOGY_FILE_VERSION 1
+
+struct TopologyFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t edgeSize;
+    uint64_t numEdges;
+};
+
+// Streams edges to a binary topology file. The edge count in the header is filled in when the writer is closed.
+class BinaryTopologyWriter {
+
+    public:
+        BinaryTopologyWriter(const std::string& fileName);
+        ~BinaryTopologyWriter() { close(); };
+
+        void write(const TopologyEdge& edge);
+        void close();
+
+    private:
+        std::ofstream _file;
+        uint64_t _numEdges = 0;
+};
+
+std::vector<TopologyEdge> readBinaryTopology(const std::string& fileName);
+
+// Summary of what extractWorkloadComponent removed from a topology
+struct PruningReport {
+    int numComponents = 0;
+    int numKeptNodes = 0;
+    int numKeptEdges = 0;
+    int numPrunedNodes = 0;
+    int numPrunedEdges = 0;
+};
+
+// Keeps only the strongly connected component that contains the most workload endpoints (the largest one breaks ties)
+std::vector<TopologyEdge> extractWorkloadComponent(const std::vector<TopologyEdge>& edges, const std::set<int>& workloadNodes, PruningReport& report);
+
+// Repeatedly peels nodes with a single neighbor and returns, for every peeled node, the neighbor it hangs from
+std::map<int, int> findLeafParents(const std::vector<TopologyEdge>& edges);
+
+#endif
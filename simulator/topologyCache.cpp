@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <openssl/sha.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "topologyCache.h"
+
+namespace {
+
+size_t alignedSize(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+// Advances offset past a section of count elements, unless the section would not fit in the first size bytes
+bool skipSection(size_t& offset, uint64_t count, size_t elementSize, size_t size) {
+    if (offset > size || count > (size - offset) / elementSize)
+        return false;
+    offset += alignedSize(count * elementSize);
+    return true;
+}
+
+} // namespace
+
+std::string TopologyCache::computeKey(const std::vector<std::string>& fileNames, const std::string& configuration) {
+
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+
+    std::vector<char> buffer(1 << 16);
+    for (const auto& fileName : fileNames) {
+        std::ifstream file(fileName, std::ifstream::in | std::ifstream::binary);
+        if (!file)
+            throw std::runtime_error("could not open " + fileName + " to compute the topology cache key");
+
+        uint64_t fileSize = 0;
+        while (file) {
+            file.read(buffer.data(), buffer.size());
+            SHA256_Update(&sha256, buffer.data(), file.gcount());
+            fileSize += file.gcount();
+        }
+        // Separate the files so that moving bytes from one file to the next changes the key
+        SHA256_Update(&sha256, &fileSize, sizeof(fileSize));
+    }
+    SHA256_Update(&sha256, configuration.data(), configuration.size());
+
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256_Final(hash, &sha256);
+    std::stringstream ss;
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
+        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
+    return ss.str();
+}
+
+bool TopologyCache::setSections(const void *data, size_t size) {
+    // Validates the header and the route entries against the data size and points every section into the data
+
+    const char *base = static_cast<const char *>(data);
+    if (size < sizeof(TopologyCacheHeader))
+        return false;
+
+    const TopologyCacheHeader *header = reinterpret_cast<const TopologyCacheHeader *>(base);
+    if (strncmp(header->magic, TOPOLOGY_CACHE_MAGIC, sizeof(header->magic)) != 0 || header->version != TOPOLOGY_CACHE_VERSION
+            || header->edgeSize != sizeof(TopologyEdge))
+        return false;
+
+    // Counts are checked against the size before they are multiplied, so corrupt ones cannot overflow the offsets
+    size_t offset = sizeof(TopologyCacheHeader);
+    size_t edgesOffset = offset;
+    if (!skipSection(offset, header->numEdges, sizeof(TopologyEdge), size))
+        return false;
+    size_t leafParentsOffset = offset;
+    if (!skipSection(offset, header->numLeafParents, sizeof(CachedLeafParent), size))
+        return false;
+    size_t routesOffset = offset;
+    if (!skipSection(offset, header->numRoutes, sizeof(CachedRoute), size))
+        return false;
+    size_t hopsOffset = offset;
+    if (!skipSection(offset, header->numHops, sizeof(int32_t), size) || offset != size)
+        return false;
+
+    // Every route must lie within the hops section, since getRoute copies it without further checks
+    const CachedRoute *routes = reinterpret_cast<const CachedRoute *>(base + routesOffset);
+    for (uint64_t i = 0; i < header->numRoutes; i++) {
+        if (routes[i].firstHop > header->numHops || routes[i].numHops > header->numHops - routes[i].firstHop)
+            return false;
+    }
+
+    _header = header;
+    _edges = reinterpret_cast<const TopologyEdge *>(base + edgesOffset);
+    _leafParents = reinterpret_cast<const CachedLeafParent *>(base + leafParentsOffset);
+    _routes = routes;
+    _hops = reinterpret_cast<const int32_t *>(base + hopsOffset);
+    return true;
+}
+
+bool TopologyCache::load(const std::string& fileName) {
+    clear();
+
+#ifdef _WIN32
+    // No mmap here, so read the whole file into the aligned storage instead
+    std::ifstream cacheFile(fileName, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+    if (!cacheFile)
+        return false;
+    size_t size = cacheFile.tellg();
+    _storage.resize(alignedSize(size) / sizeof(uint64_t));
+    cacheFile.seekg(0);
+    cacheFile.read(reinterpret_cast<char *>(_storage.data()), size);
+    if (!cacheFile || !setSections(_storage.data(), size)) {
+        clear();
+        return false;
+    }
+#else
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    _mapping = mapping;
+    _mappingSize = fileStat.st_size;
+    if (!setSections(_mapping, _mappingSize)) {
+        clear();
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+void TopologyCache::store(const std::string& fileName, const std::vector<TopologyEdge>& edges, const std::map<int, int>& leafParents,
+        const std::map<std::pair<int, int>, std::vector<int> >& routes) {
+    clear();
+
+    // Lay out the file image in memory first
+    uint64_t numHops = 0;
+    for (const auto& route : routes)
+        numHops += route.second.size();
+
+    size_t edgesOffset = sizeof(TopologyCacheHeader);
+    size_t leafParentsOffset = edgesOffset + alignedSize(edges.size() * sizeof(TopologyEdge));
+    size_t routesOffset = leafParentsOffset + alignedSize(leafParents.size() * sizeof(CachedLeafParent));
+    size_t hopsOffset = routesOffset + alignedSize(routes.size() * sizeof(CachedRoute));
+    size_t size = hopsOffset + alignedSize(numHops * sizeof(int32_t));
+
+    _storage.assign(size / sizeof(uint64_t), 0);
+    char *base = reinterpret_cast<char *>(_storage.data());
+
+    TopologyCacheHeader *header = reinterpret_cast<TopologyCacheHeader *>(base);
+    strncpy(header->magic, TOPOLOGY_CACHE_MAGIC, sizeof(header->magic));
+    header->version = TOPOLOGY_CACHE_VERSION;
+    header->edgeSize = sizeof(TopologyEdge);
+    header->numEdges = edges.size();
+    header->numLeafParents = leafParents.size();
+    header->numRoutes = routes.size();
+    header->numHops = numHops;
+
+    if (!edges.empty())
+        memcpy(base + edgesOffset, edges.data(), edges.size() * sizeof(TopologyEdge));
+
+    CachedLeafParent *leafParent = reinterpret_cast<CachedLeafParent *>(base + leafParentsOffset);
+    for (const auto& leaf : leafParents)
+        *leafParent++ = CachedLeafParent{leaf.first, leaf.second};
+
+    // std::map iterates in (srcId, dstId) order, which is the order getRoute searches in
+    CachedRoute *route = reinterpret_cast<CachedRoute *>(base + routesOffset);
+    int32_t *hops = reinterpret_cast<int32_t *>(base + hopsOffset);
+    uint64_t firstHop = 0;
+    for (const auto& routeEntry : routes) {
+        *route++ = CachedRoute{routeEntry.first.first, routeEntry.first.second, firstHop, routeEntry.second.size()};
+        std::copy(routeEntry.second.begin(), routeEntry.second.end(), hops + firstHop);
+        firstHop += routeEntry.second.size();
+    }
+
+    setSections(base, size);
+
+    // Write to a temporary file and rename it, so that concurrent runs never map a partially written cache
+    std::string tmpFileName = fileName + ".tmp" + std::to_string(getpid());
+    std::ofstream cacheFile(tmpFileName, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    if (!cacheFile)
+        throw std::runtime_error("could not open topology cache file " + tmpFileName);
+    cacheFile.write(base, size);
+    cacheFile.close();
+    if (!cacheFile || std::rename(tmpFileName.c_str(), fileName.c_str()) != 0) {
+        std::remove(tmpFileName.c_str());
+        throw std::runtime_error("could not write topology cache file " + fileName);
+    }
+}
+
+void TopologyCache::clear() {
+#ifndef _WIN32
+    if (_mapping != nullptr)
+        munmap(_mapping, _mappingSize);
+#endif
+    _mapping = nullptr;
+    _mappingSize = 0;
+    _storage.clear();
+    _header = nullptr;
+    _edges = nullptr;
+    _leafParents = nullptr;
+    _routes = nullptr;
+    _hops = nullptr;
+}
+
+std::vector<TopologyEdge> TopologyCache::getEdges() const {
+    if (!isValid())
+        return std::vector<TopologyEdge>();
+    return std::vector<TopologyEdge>(_edges, _edges + _header->numEdges);
+}
+
+std::map<int, int> TopologyCache::getLeafParents() const {
+    std::map<int, int> leafParents;
+    if (!isValid())
+        return leafParents;
+    for (uint64_t i = 0; i < _header->numLeafParents; i++)
+        leafParents[_leafParents[i].nodeId] = _leafParents[i].parentId;
+    return leafParents;
+}
+
+bool TopologyCache::getRoute(int srcId, int dstId, std::vector<int>& path) const {
+    if (!isValid())
+        return false;
+
+    const CachedRoute *end = _routes + _header->numRoutes;
+    const CachedRoute *route = std::lower_bound(_routes, end, std::make_pair(srcId, dstId),
+            [](const CachedRoute& entry, const std::pair<int, int>& key) { return std::make_pair(entry.srcId, entry.dstId) < key; });
+    if (route == end || route->srcId != srcId || route->dstId != dstId)
+        return false;
+
+    path.assign(_hops + route->firstHop, _hops + route->firstHop + route->numHops);
+    return true;
+}
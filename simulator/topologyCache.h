@@ -0,0 +1,80 @@
+#ifndef _TOPOLOGYCACHE_H_
+#define _TOPOLOGYCACHE_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "topology.h"
+
+// Cache files hold this header followed by the edges, leaf parents, route entries and route hops sections. Every
+// section is 8-byte aligned so the file can be used in place from a read-only memory mapping.
+#define TOPOLOGY_CACHE_MAGIC "PCNCACHE"
+#define TOPOLOGY_CACHE_VERSION 1
+
+struct TopologyCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t edgeSize;
+    uint64_t numEdges;
+    uint64_t numLeafParents;
+    uint64_t numRoutes;
+    uint64_t numHops;
+};
+
+struct CachedLeafParent {
+    int32_t nodeId;
+    int32_t parentId;
+};
+
+// Route entries are sorted by (srcId, dstId). The route is hops[firstHop, firstHop + numHops), source and destination
+// included; an empty route means the destination is unreachable.
+struct CachedRoute {
+    int32_t srcId;
+    int32_t dstId;
+    uint64_t firstHop;
+    uint64_t numHops;
+};
+
+// Parsed (and possibly pruned) topology plus the routes of every workload payment, keyed by a hash of the inputs
+class TopologyCache {
+
+    public:
+        TopologyCache() {};
+        ~TopologyCache() { clear(); };
+        TopologyCache(const TopologyCache&) = delete;
+        TopologyCache& operator=(const TopologyCache&) = delete;
+
+        // SHA-256 over the contents of the given files and the configuration string, as a hex string
+        static std::string computeKey(const std::vector<std::string>& fileNames, const std::string& configuration);
+
+        // Maps a cache file. Returns false if it does not exist, was written by an incompatible version or is corrupt.
+        bool load(const std::string& fileName);
+        // Makes the given data the cache contents and writes it to fileName (atomically, through a temporary file)
+        void store(const std::string& fileName, const std::vector<TopologyEdge>& edges, const std::map<int, int>& leafParents,
+                const std::map<std::pair<int, int>, std::vector<int> >& routes);
+        void clear();
+
+        bool isValid() const { return _header != nullptr; };
+        std::vector<TopologyEdge> getEdges() const;
+        std::map<int, int> getLeafParents() const;
+        // Returns false if the route was not precomputed
+        bool getRoute(int srcId, int dstId, std::vector<int>& path) const;
+
+    private:
+        // Sections point either into _storage (after store) or into the mapped file (after load)
+        const TopologyCacheHeader *_header = nullptr;
+        const TopologyEdge *_edges = nullptr;
+        const CachedLeafParent *_leafParents = nullptr;
+        const CachedRoute *_routes = nullptr;
+        const int32_t *_hops = nullptr;
+
+        std::vector<uint64_t> _storage;
+        void *_mapping = nullptr;
+        size_t _mappingSize = 0;
+
+        bool setSections(const void *data, size_t size);
+};
+
+#endif
@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+"""Scaling benchmark for the simulator.
+
+`bench.py run` generates deterministic topologies (topogen) and workloads (workgen) of increasing size, runs the PCN
+network under Cmdenv in express mode and writes a JSON report with events/sec, simulated seconds per wall-clock
+second, peak RSS, startup time and payment throughput for every size. With --headless-savings every size also runs
+with presentation work (message names, display strings, bubbles) enabled, to report the per-event cost headless mode
+saves. `bench.py compare` prints the relative change between two reports, e.g. one produced by the current build and
+one by a baseline build.
+"""
+
+import argparse
+import datetime
+import json
+import os
+import platform
+import re
+import subprocess
+import sys
+import time
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+SIMULATOR_DIR = os.path.join(os.path.dirname(TOOLS_DIR), 'simulator')
+
+# Metrics reported by `compare`, with whether a higher value is better
+METRICS = [
+    ('eventsPerSecond', True),
+    ('simSecondsPerSecond', True),
+    ('paymentsPerSecond', True),
+    ('startupSeconds', False),
+    ('wallSeconds', False),
+    ('peakRssMB', False),
+]
+
+
+def run_command(args, cwd=None):
+    """Runs a command and returns (stdout, wall seconds, peak RSS in MB)."""
+    start = time.monotonic()
+    process = subprocess.Popen(args, cwd=cwd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    output = process.stdout.read()
+    _, status, usage = os.wait4(process.pid, 0)
+    wall = time.monotonic() - start
+    process.returncode = os.waitstatus_to_exitcode(status) if hasattr(os, 'waitstatus_to_exitcode') else status >> 8
+    if process.returncode != 0:
+        sys.stderr.write(output)
+        raise RuntimeError('command failed with exit code %d: %s' % (process.returncode, ' '.join(args)))
+    # ru_maxrss is in kilobytes on Linux and in bytes on macOS
+    peak_rss = usage.ru_maxrss / (1024 * 1024 if sys.platform == 'darwin' else 1024)
+    return output, wall, peak_rss
+
+
+def read_scalars(result_dir):
+    """Returns {(module, name): value} from every .sca file in result_dir."""
+    scalars = {}
+    for file_name in os.listdir(result_dir):
+        if not file_name.endswith('.sca'):
+            continue
+        with open(os.path.join(result_dir, file_name)) as sca_file:
+            for line in sca_file:
+                fields = line.split()
+                if len(fields) >= 4 and fields[0] == 'scalar':
+                    try:
+                        scalars[(fields[1], fields[2])] = float(fields[3])
+                    except ValueError:
+                        pass
+    return scalars
+
+
+def git_revision():
+    try:
+        return subprocess.check_output(['git', 'rev-parse', '--short', 'HEAD'], cwd=TOOLS_DIR, universal_newlines=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return 'unknown'
+
+
+def run_simulator(args, topology_file, workload_file, result_dir, headless):
+    """Runs the simulator on one topology and workload, returning (output, wall seconds, peak RSS in MB)."""
+    if os.path.isdir(result_dir):
+        for file_name in os.listdir(result_dir):
+            os.remove(os.path.join(result_dir, file_name))
+    return run_command([
+        os.path.abspath(args.simulator), '-u', 'Cmdenv', '-f', 'pCN.ini', '-n', '.', '-c', 'General',
+        '--cmdenv-express-mode=true', '--cmdenv-status-frequency=1000s', '--result-dir=' + result_dir,
+        '--**.netBuilder.topologyFile="%s"' % topology_file,
+        '--**.netBuilder.topologyFormat="binary"',
+        '--**.netBuilder.workloadFile="%s"' % workload_file,
+        '--**.netBuilder.channelStatsMode="histogram"',
+        '--**.netBuilder.headless="%s"' % ('true' if headless else 'false'),
+    ] + args.simulator_args, cwd=SIMULATOR_DIR)
+
+
+def bench_size(args, nodes):
+    work_dir = os.path.join(os.path.abspath(args.work_dir), str(nodes))
+    os.makedirs(work_dir, exist_ok=True)
+    topology_file = os.path.join(work_dir, 'topology.bin')
+    workload_file = os.path.join(work_dir, 'workload.txt')
+    result_dir = os.path.join(work_dir, 'results')
+    payments = max(1, int(nodes * args.payments_per_node))
+
+    # Same seed for every size, so a report can always be regenerated
+    run_command([os.path.join(TOOLS_DIR, 'topogen'), '-t', 'barabasi-albert', '-n', str(nodes), '-m', str(args.m),
+                 '-f', 'binary', '-s', str(args.seed), '-o', topology_file], cwd=TOOLS_DIR)
+    run_command([os.path.join(TOOLS_DIR, 'workgen'), '-t', topology_file, '-f', 'binary', '--n_payments', str(payments),
+                 '--any_node', '-s', str(args.seed), '-o', workload_file], cwd=TOOLS_DIR)
+
+    output, wall, peak_rss = run_simulator(args, topology_file, workload_file, result_dir, headless=True)
+
+    # Cmdenv ends with "... simulation ended at event #N, t=T." (or "at t=T, event #N" for time limits)
+    events = [int(n) for n in re.findall(r'event #(\d+)', output)]
+    sim_times = [float(t) for t in re.findall(r't=([0-9.eE+-]+)', output)]
+    num_events = events[-1] if events else 0
+    sim_time = sim_times[-1] if sim_times else 0.0
+
+    scalars = read_scalars(result_dir)
+    startup = scalars.get(('PCN.netBuilder', 'startupWallTime'), 0.0)
+    completed = scalars.get(('PCN.netBuilder', 'paymentLatency:count'), 0.0)
+
+    run = {
+        'nodes': nodes,
+        'payments': payments,
+        'completedPayments': int(completed),
+        'events': num_events,
+        'simSeconds': sim_time,
+        'wallSeconds': wall,
+        'startupSeconds': startup,
+        'eventsPerSecond': num_events / wall if wall > 0 else 0,
+        'simSecondsPerSecond': sim_time / wall if wall > 0 else 0,
+        'paymentsPerSecond': completed / wall if wall > 0 else 0,
+        'peakRssMB': peak_rss,
+    }
+
+    if args.headless_savings:
+        # Same run with message names, display strings and bubbles; the difference is the presentation cost per event
+        _, full_wall, _ = run_simulator(args, topology_file, workload_file, result_dir, headless=False)
+        run['fullDisplayWallSeconds'] = full_wall
+        run['headlessSavingsNsPerEvent'] = (full_wall - wall) / num_events * 1e9 if num_events else 0.0
+    return run
+
+
+def command_run(args):
+    report = {
+        'meta': {
+            'date': datetime.datetime.now().isoformat(timespec='seconds'),
+            'revision': git_revision(),
+            'host': platform.node(),
+            'platform': platform.platform(),
+            'simulator': os.path.abspath(args.simulator),
+            'seed': args.seed,
+            'm': args.m,
+            'paymentsPerNode': args.payments_per_node,
+        },
+        'runs': [],
+    }
+    for nodes in [int(size) for size in args.sizes.split(',')]:
+        print('Benchmarking %d nodes...' % nodes, flush=True)
+        run = bench_size(args, nodes)
+        report['runs'].append(run)
+        print('  %(events)d events in %(wallSeconds).2fs (%(eventsPerSecond).0f ev/s, startup %(startupSeconds).2fs, '
+              'peak RSS %(peakRssMB).0f MB)' % run, flush=True)
+        if args.headless_savings:
+            print('  headless mode saves %(headlessSavingsNsPerEvent).0f ns/event' % run, flush=True)
+
+    with open(args.output, 'w') as report_file:
+        json.dump(report, report_file, indent=2)
+    print('Report written to ' + args.output)
+
+
+def command_compare(args):
+    with open(args.baseline) as baseline_file:
+        baseline = json.load(baseline_file)
+    with open(args.candidate) as candidate_file:
+        candidate = json.load(candidate_file)
+
+    print('baseline:  %s (%s)' % (baseline['meta']['revision'], baseline['meta']['date']))
+    print('candidate: %s (%s)' % (candidate['meta']['revision'], candidate['meta']['date']))
+    baseline_runs = {run['nodes']: run for run in baseline['runs']}
+    regressions = 0
+    for run in candidate['runs']:
+        base = baseline_runs.get(run['nodes'])
+        if base is None:
+            continue
+        print('\n%d nodes' % run['nodes'])
+        for metric, higher_is_better in METRICS:
+            old, new = base[metric], run[metric]
+            change = (new - old) / old * 100 if old else 0.0
+            worse = (change < -args.threshold) if higher_is_better else (change > args.threshold)
+            regressions += worse
+            print('  %-20s %14.3f %14.3f %+8.1f%%%s' % (metric, old, new, change, '  <-- regression' if worse else ''))
+
+    return 1 if regressions and args.fail_on_regression else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    subparsers = parser.add_subparsers(dest='command')
+    subparsers.required = True
+
+    run_parser = subparsers.add_parser('run', help='run the benchmark suite and write a report')
+    run_parser.add_argument('--simulator', default=os.path.join(SIMULATOR_DIR, 'wpcn-omnet'), help='simulator executable')
+    run_parser.add_argument('--sizes', default='1000,10000,100000', help='comma-separated node counts')
+    run_parser.add_argument('--payments-per-node', type=float, default=1.0, help='workload size relative to the network')
+    run_parser.add_argument('-m', type=int, default=2, help='M parameter of the Barabasi-Albert topologies')
+    run_parser.add_argument('--seed', type=int, default=1, help='seed for topologies and workloads')
+    run_parser.add_argument('--work-dir', default='bench-work', help='where generated inputs and results are kept')
+    run_parser.add_argument('--headless-savings', action='store_true',
+                            help='also run every size with presentation work enabled and report the per-event savings')
+    run_parser.add_argument('-o', '--output', default='bench-report.json', help='report file')
+    run_parser.add_argument('simulator_args', nargs='*', help='extra simulator options (after --)')
+    run_parser.set_defaults(func=command_run)
+
+    compare_parser = subparsers.add_parser('compare', help='compare two reports')
+    compare_parser.add_argument('baseline')
+    compare_parser.add_argument('candidate')
+    compare_parser.add_argument('--threshold', type=float, default=5.0, help='percentage change flagged as a regression')
+    compare_parser.add_argument('--fail-on-regression', action='store_true', help='exit with status 1 on regressions')
+    compare_parser.set_defaults(func=command_compare)
+
+    args = parser.parse_args()
+    return args.func(args) or 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
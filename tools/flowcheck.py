@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Validates the flow-level simulator (flowsim) against the packet-level simulator on small networks.
+
+For every size, a deterministic topology (topogen) and workload (workgen) are generated like in the benchmark suite.
+The simulator runs them with the full HTLC protocol and writes its final channel capacities
+(NetBuilder.channelSnapshotFinalFile); flowsim runs the same inputs and writes its own. The report compares the
+payment outcomes, the balance drift (capacity that changed direction, relative to the total) and the capacity of
+every channel direction at the end of both runs, along with their wall times.
+"""
+
+import argparse
+import json
+import os
+import struct
+import sys
+
+from bench import SIMULATOR_DIR, TOOLS_DIR, run_command
+
+SNAPSHOT_HEADER = struct.Struct('<8sIIQ')
+SNAPSHOT_ENTRY = struct.Struct('<iid')  # nodeId, neighborId, capacity
+TOPOLOGY_HEADER = struct.Struct('<8sIIQ')
+TOPOLOGY_EDGE = struct.Struct('<iidddi4xddd')  # srcId, dstId, capacity, fee, linkQuality, maxAcceptedHTLCs, ...
+
+
+def read_records(file_name, magic, header, record):
+    with open(file_name, 'rb') as binary_file:
+        file_magic, version, record_size, num_records = header.unpack(binary_file.read(header.size))
+        if file_magic.rstrip(b'\0') != magic or version != 1 or record_size != record.size:
+            raise ValueError('%s is not a version 1 %s file' % (file_name, magic.decode()))
+        return list(record.iter_unpack(binary_file.read(num_records * record.size)))
+
+
+def read_snapshot(file_name):
+    """Returns {(nodeId, neighborId): capacity} from a channel snapshot."""
+    return {(node, neighbor): capacity
+            for node, neighbor, capacity in read_records(file_name, b'PCNCHSNP', SNAPSHOT_HEADER, SNAPSHOT_ENTRY)}
+
+
+def read_capacities(file_name):
+    """Returns {(srcId, dstId): capacity} from a binary topology (later edges replace earlier ones, as in the simulator)."""
+    return {(edge[0], edge[1]): edge[2] for edge in read_records(file_name, b'PCNTOPO', TOPOLOGY_HEADER, TOPOLOGY_EDGE)}
+
+
+def read_statistic_counts(result_dir, name):
+    """Sums the count field of the <name>:stats statistics of every node."""
+    total = 0
+    for file_name in os.listdir(result_dir):
+        if not file_name.endswith('.sca'):
+            continue
+        current = None
+        with open(os.path.join(result_dir, file_name)) as sca_file:
+            for line in sca_file:
+                fields = line.split()
+                if len(fields) >= 3 and fields[0] == 'statistic':
+                    current = fields[2]
+                elif len(fields) >= 3 and fields[0] == 'field' and fields[1] == 'count' and current == name + ':stats':
+                    total += int(float(fields[2]))
+    return total
+
+
+def balance_drift(initial, final):
+    moved = sum(abs(final.get(direction, capacity) - capacity) for direction, capacity in initial.items())
+    total = sum(initial.values())
+    return moved / 2 / total if total > 0 else 0.0
+
+
+def check_size(args, nodes):
+    work_dir = os.path.join(os.path.abspath(args.work_dir), str(nodes))
+    os.makedirs(work_dir, exist_ok=True)
+    topology_file = os.path.join(work_dir, 'topology.bin')
+    workload_file = os.path.join(work_dir, 'workload.txt')
+    result_dir = os.path.join(work_dir, 'results')
+    detailed_snapshot = os.path.join(work_dir, 'detailed.snapshot')
+    flow_snapshot = os.path.join(work_dir, 'flow.snapshot')
+    flow_report = os.path.join(work_dir, 'flow.json')
+    payments = max(1, int(nodes * args.payments_per_node))
+
+    run_command([os.path.join(TOOLS_DIR, 'topogen'), '-t', 'barabasi-albert', '-n', str(nodes), '-m', str(args.m),
+                 '-f', 'binary', '-s', str(args.seed), '-o', topology_file], cwd=TOOLS_DIR)
+    run_command([os.path.join(TOOLS_DIR, 'workgen'), '-t', topology_file, '-f', 'binary', '--n_payments', str(payments),
+                 '--any_node', '-s', str(args.seed), '-o', workload_file], cwd=TOOLS_DIR)
+
+    if os.path.isdir(result_dir):
+        for file_name in os.listdir(result_dir):
+            os.remove(os.path.join(result_dir, file_name))
+    _, detailed_wall, _ = run_command([
+        os.path.abspath(args.simulator), '-u', 'Cmdenv', '-f', 'pCN.ini', '-n', '.', '-c', 'General',
+        '--cmdenv-express-mode=true', '--cmdenv-status-frequency=1000s', '--result-dir=' + result_dir,
+        '--**.netBuilder.topologyFile="%s"' % topology_file,
+        '--**.netBuilder.topologyFormat="binary"',
+        '--**.netBuilder.workloadFile="%s"' % workload_file,
+        '--**.netBuilder.channelStatsMode="histogram"',
+        '--**.netBuilder.channelSnapshotFinalFile="%s"' % detailed_snapshot,
+    ] + args.simulator_args, cwd=SIMULATOR_DIR)
+
+    _, flow_wall, _ = run_command([
+        os.path.join(TOOLS_DIR, 'flowsim'), '-t', topology_file, '-f', 'binary', '-w', workload_file,
+        '-l', args.latency, '--snapshot-out', flow_snapshot, '-o', flow_report,
+    ], cwd=TOOLS_DIR)
+    with open(flow_report) as report_file:
+        flow = json.load(report_file)
+
+    initial = read_capacities(topology_file)
+    detailed_final = read_snapshot(detailed_snapshot)
+    flow_final = read_snapshot(flow_snapshot)
+    capacity_error = sum(abs(flow_final.get(direction, 0.0) - capacity) for direction, capacity in detailed_final.items())
+    mean_capacity = sum(initial.values()) / len(initial) if initial else 0.0
+
+    detailed = {
+        'completedPayments': read_statistic_counts(result_dir, 'completedPayments'),
+        'failedPayments': read_statistic_counts(result_dir, 'failedPayments'),
+        'canceledPayments': read_statistic_counts(result_dir, 'canceledPayments'),
+    }
+    detailed['successRate'] = detailed['completedPayments'] / payments
+    detailed['balanceDrift'] = balance_drift(initial, detailed_final)
+    detailed['wallSeconds'] = detailed_wall
+
+    flow_result = {key: flow[key] for key in ('completedPayments', 'failedPayments', 'canceledPayments', 'successRate')}
+    flow_result['balanceDrift'] = balance_drift(initial, flow_final)
+    flow_result['wallSeconds'] = flow_wall
+
+    return {
+        'nodes': nodes,
+        'payments': payments,
+        'detailed': detailed,
+        'flow': flow_result,
+        'successRateError': flow_result['successRate'] - detailed['successRate'],
+        'balanceDriftError': flow_result['balanceDrift'] - detailed['balanceDrift'],
+        # Mean absolute difference of the final capacity of a channel direction, relative to the mean initial capacity
+        'capacityError': capacity_error / len(detailed_final) / mean_capacity if detailed_final and mean_capacity else 0.0,
+        'speedup': detailed_wall / flow_wall if flow_wall > 0 else 0.0,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--simulator', default=os.path.join(SIMULATOR_DIR, 'wpcn-omnet'), help='simulator executable')
+    parser.add_argument('--sizes', default='50,100,200', help='comma-separated node counts')
+    parser.add_argument('--payments-per-node', type=float, default=5.0, help='workload size relative to the network')
+    parser.add_argument('-m', type=int, default=2, help='M parameter of the Barabasi-Albert topologies')
+    parser.add_argument('--seed', type=int, default=1, help='seed for topologies and workloads')
+    parser.add_argument('-l', '--latency', default='hops', choices=['none', 'hops'], help='flowsim latency model')
+    parser.add_argument('--work-dir', default='flowcheck-work', help='where generated inputs and results are kept')
+    parser.add_argument('-o', '--output', help='JSON report file')
+    parser.add_argument('simulator_args', nargs='*', help='extra simulator options (after --)')
+    args = parser.parse_args()
+
+    runs = []
+    for nodes in [int(size) for size in args.sizes.split(',')]:
+        print('Checking %d nodes...' % nodes, flush=True)
+        run = check_size(args, nodes)
+        runs.append(run)
+        for mode in ('detailed', 'flow'):
+            print('  %-8s completed/failed/canceled %d/%d/%d, success rate %.4f, balance drift %.4f, %.2fs' % (
+                mode, run[mode]['completedPayments'], run[mode]['failedPayments'], run[mode]['canceledPayments'],
+                run[mode]['successRate'], run[mode]['balanceDrift'], run[mode]['wallSeconds']), flush=True)
+        print('  success rate error %+.4f, balance drift error %+.4f, capacity error %.4f, %.0fx faster' % (
+            run['successRateError'], run['balanceDriftError'], run['capacityError'], run['speedup']), flush=True)
+
+    if args.output:
+        with open(args.output, 'w') as report_file:
+            json.dump({'latencyModel': args.latency, 'seed': args.seed, 'runs': runs}, report_file, indent=2)
+        print('Report written to ' + args.output)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
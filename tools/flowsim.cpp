@@ -0,0 +1,436 @@
+/***********************************************************************************************************************/
+/* flowsim: flow-level simulation of a workload for capacity-planning sweeps. Each payment is applied atomically     */
+/* along the route the simulator would take, with the same capacity checks as FullNode::hasCapacityToForward, instead */
+/* of exchanging the HTLC protocol messages hop by hop. Payments can optionally hold their capacity for an analytic   */
+/* latency derived from the link delays. It reports success rates and balance drift, and can write the final channel  */
+/* capacities as a channel snapshot the simulator loads (NetBuilder.channelSnapshotLoadFile).                        */
+/***********************************************************************************************************************/
+
+#include <getopt.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "topology.h"
+#include "routing.h"
+#include "channelSnapshot.h"
+#include "latencyHistogram.h"
+#include "PaymentChannel.h"
+
+// From the start of a payment to the arrival of its invoice at the payer, as the default FullNode.invoiceDelay in the simulator
+#define FLOW_INVOICE_DELAY 100
+
+struct Options {
+    std::string topologyFile = "../topologies/topology";
+    std::string format = "text";
+    std::string workloadFile = "../workloads/random-workload.txt";
+    bool prune = false;
+    std::string latency = "none";
+    double hopMessages = 3;
+    double commitWait = 0;
+    std::string snapshotIn;
+    std::string snapshotOut;
+    std::string output;
+};
+
+struct FlowPayment {
+    int srcId;
+    int dstId;
+    double value;
+    double time;
+};
+
+// A completed payment whose value reaches the reverse channel directions of its route once it settles
+struct Settlement {
+    double time;
+    size_t seq; // settlements at the same time are applied in the order the payments started
+    std::vector<std::string> path;
+    double value;
+
+    bool operator>(const Settlement& other) const { return time != other.time ? time > other.time : seq > other.seq; }
+};
+
+struct FlowResults {
+    int completed = 0;
+    int failed = 0;
+    int canceled = 0;
+    double volume = 0; // value of the completed payments
+    LatencyHistogram latency;
+};
+
+std::string nodeName(int nodeId) {
+    return "node" + std::to_string(nodeId);
+}
+
+std::vector<TopologyEdge> readEdges(const Options& options) {
+    // Reads the text format like the NetBuilder does (only the binary reader is shared with the simulator)
+
+    if (options.format == "binary")
+        return readBinaryTopology(options.topologyFile);
+
+    std::ifstream topologyFile(options.topologyFile);
+    if (!topologyFile)
+        throw std::runtime_error("could not open topology file " + options.topologyFile);
+
+    std::vector<TopologyEdge> edges;
+    std::string line;
+    while (getline(topologyFile, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream tokens(line);
+        TopologyEdge edge;
+        if (!(tokens >> edge.srcId >> edge.dstId >> edge.capacity >> edge.fee >> edge.linkQuality >> edge.maxAcceptedHTLCs
+                >> edge.HTLCMinimumMsat >> edge.channelReserveSatoshis >> edge.linkDelay))
+            throw std::runtime_error("wrong line in topology file: 9 items required, line: \"" + line + "\"");
+        edges.push_back(edge);
+    }
+    return edges;
+}
+
+std::vector<FlowPayment> readPayments(const Options& options) {
+    // Payment times are whole seconds, as the NetBuilder reads them
+
+    std::ifstream workloadFile(options.workloadFile);
+    if (!workloadFile)
+        throw std::runtime_error("could not open workload file " + options.workloadFile);
+
+    std::vector<FlowPayment> payments;
+    std::string line;
+    while (getline(workloadFile, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream tokens(line);
+        FlowPayment payment;
+        std::string time;
+        if (!(tokens >> payment.srcId >> payment.dstId >> payment.value >> time))
+            throw std::runtime_error("wrong line in workload file: 4 items required, line: \"" + line + "\"");
+        payment.time = atoi(time.c_str());
+        payments.push_back(payment);
+    }
+    return payments;
+}
+
+class FlowSimulator {
+
+    public:
+        FlowSimulator(const std::vector<TopologyEdge>& edges, const std::map<std::string, std::string>& leafParents, const Options& options);
+
+        void loadSnapshot(const std::string& fileName);
+        void run(std::vector<FlowPayment> payments);
+
+        const FlowResults& getResults() const { return _results; };
+        double getBalanceDrift() const;
+        ChannelSnapshot getSnapshot() const;
+
+    private:
+        void startPayment(const FlowPayment& payment, size_t seq);
+        void settle(const Settlement& settlement);
+        double getLatency(const std::vector<std::string>& path);
+
+        const Options& _options;
+        std::map<std::string, std::map<std::string, PaymentChannel> > _channels; // nodeName to neighborName to channel, as in FullNode
+        std::map<std::pair<std::string, std::string>, double> _initialCapacities;
+        std::map<std::pair<std::string, std::string>, double> _linkDelays;
+        AdjacencyMap _graph;
+        std::map<std::string, std::string> _leafParents;
+        std::map<std::pair<std::string, std::string>, std::vector<std::string> > _routes; // routes only depend on the static graph
+        std::priority_queue<Settlement, std::vector<Settlement>, std::greater<Settlement> > _settlements;
+        FlowResults _results;
+};
+
+FlowSimulator::FlowSimulator(const std::vector<TopologyEdge>& edges, const std::map<std::string, std::string>& leafParents, const Options& options)
+        : _options(options), _leafParents(leafParents) {
+
+    // Later lines for the same direction replace earlier ones, like the NetBuilder's channel list
+    for (const auto& edge : edges) {
+        std::string srcName = nodeName(edge.srcId);
+        std::string dstName = nodeName(edge.dstId);
+        _channels[srcName][dstName] = PaymentChannel(edge.capacity, edge.fee, edge.linkQuality, edge.maxAcceptedHTLCs, 0,
+                edge.HTLCMinimumMsat, edge.channelReserveSatoshis, nullptr, nullptr);
+        _linkDelays[std::make_pair(srcName, dstName)] = edge.linkDelay;
+    }
+    addRoutingEdges(edges, _leafParents, _graph);
+}
+
+void FlowSimulator::loadSnapshot(const std::string& fileName) {
+    // Starts from the capacities of a channel snapshot, like NetBuilder.channelSnapshotLoadFile
+
+    ChannelSnapshot snapshot;
+    snapshot.read(fileName);
+    for (const auto& entry : snapshot.getEntries()) {
+        auto node = _channels.find(nodeName(entry.nodeId));
+        if (node == _channels.end() || node->second.find(nodeName(entry.neighborId)) == node->second.end())
+            throw std::runtime_error("channel snapshot " + fileName + " does not match the topology: there is no channel from node"
+                    + std::to_string(entry.nodeId) + " to node" + std::to_string(entry.neighborId));
+        node->second[nodeName(entry.neighborId)]._capacity = entry.capacity;
+    }
+}
+
+void FlowSimulator::run(std::vector<FlowPayment> payments) {
+    // Payments start when their invoice reaches the payer, in workload order at equal times
+
+    for (const auto& node : _channels) {
+        for (const auto& channel : node.second)
+            _initialCapacities[std::make_pair(node.first, channel.first)] = channel.second._capacity;
+    }
+
+    std::stable_sort(payments.begin(), payments.end(), [](const FlowPayment& a, const FlowPayment& b) { return a.time < b.time; });
+    for (size_t i = 0; i < payments.size(); i++) {
+        double startTime = payments[i].time + FLOW_INVOICE_DELAY;
+        while (!_settlements.empty() && _settlements.top().time <= startTime) {
+            settle(_settlements.top());
+            _settlements.pop();
+        }
+        startPayment(payments[i], i);
+    }
+    while (!_settlements.empty()) {
+        settle(_settlements.top());
+        _settlements.pop();
+    }
+}
+
+void FlowSimulator::startPayment(const FlowPayment& payment, size_t seq) {
+    // The outcomes of FullNode: canceled if there is no route or the payer cannot fund the first hop, failed if a hop
+    // cannot forward it (PAYMENT_REFUSED), completed otherwise. Routes are simple paths, so checking every hop against
+    // the current capacities before taking any of them is the same as checking them one after the other.
+
+    std::string srcName = nodeName(payment.srcId);
+    std::string dstName = nodeName(payment.dstId);
+    auto route = _routes.find(std::make_pair(srcName, dstName));
+    if (route == _routes.end())
+        route = _routes.insert(std::make_pair(std::make_pair(srcName, dstName), computeRoute(srcName, dstName, _graph, _leafParents))).first;
+    const std::vector<std::string>& path = route->second;
+
+    if (path.size() < 2 || !_channels[srcName][path[1]].hasCapacityToForward(srcName, path[1], payment.value)) {
+        _results.canceled++;
+        return;
+    }
+    for (size_t hop = 1; hop + 1 < path.size(); hop++) {
+        if (!_channels[path[hop]][path[hop + 1]].hasCapacityToForward(path[hop], path[hop + 1], payment.value)) {
+            _results.failed++;
+            return;
+        }
+    }
+
+    // The value leaves every forward direction now and reaches the reverse directions when the payment settles
+    for (size_t hop = 0; hop + 1 < path.size(); hop++)
+        _channels[path[hop]][path[hop + 1]]._capacity -= payment.value;
+    _results.completed++;
+    _results.volume += payment.value;
+
+    Settlement settlement;
+    settlement.time = payment.time + FLOW_INVOICE_DELAY;
+    settlement.seq = seq;
+    settlement.path = path;
+    settlement.value = payment.value;
+    if (_options.latency == "hops") {
+        double latency = getLatency(path);
+        settlement.time += latency;
+        _results.latency.record(latency);
+    }
+    if (settlement.time <= payment.time + FLOW_INVOICE_DELAY)
+        settle(settlement);
+    else
+        _settlements.push(settlement);
+}
+
+void FlowSimulator::settle(const Settlement& settlement) {
+    for (size_t hop = 0; hop + 1 < settlement.path.size(); hop++)
+        _channels[settlement.path[hop + 1]][settlement.path[hop]]._capacity += settlement.value;
+}
+
+double FlowSimulator::getLatency(const std::vector<std::string>& path) {
+    // Every hop costs hopMessages link delays (UPDATE_ADD_HTLC, COMMITMENT_SIGNED and REVOKE_AND_ACK by default) plus
+    // the commitment wait, once on the way to the payee and once more for the fulfill on the way back
+
+    double latency = 0;
+    for (size_t hop = 0; hop + 1 < path.size(); hop++)
+        latency += _options.hopMessages * _linkDelays[std::make_pair(path[hop], path[hop + 1])] + _options.commitWait;
+    return 2 * latency;
+}
+
+double FlowSimulator::getBalanceDrift() const {
+    // Capacity that changed direction, relative to the total capacity of the network
+
+    double moved = 0;
+    double total = 0;
+    for (const auto& node : _channels) {
+        for (const auto& channel : node.second) {
+            double initial = _initialCapacities.at(std::make_pair(node.first, channel.first));
+            moved += std::fabs(channel.second._capacity - initial);
+            total += initial;
+        }
+    }
+    return total > 0 ? moved / 2 / total : 0;
+}
+
+ChannelSnapshot FlowSimulator::getSnapshot() const {
+    ChannelSnapshot snapshot;
+    for (const auto& node : _channels) {
+        for (const auto& channel : node.second)
+            snapshot.add(atoi(node.first.c_str() + strlen("node")), atoi(channel.first.c_str() + strlen("node")), channel.second._capacity);
+    }
+    return snapshot;
+}
+
+void printUsage() {
+    std::cout <<
+        "Usage: flowsim [OPTIONS]\n"
+        "\n"
+        "  Simulates a workload at the flow level: every payment is applied atomically\n"
+        "  along its route, without the HTLC protocol messages\n"
+        "\n"
+        "Options:\n"
+        "  -t, --topology FILE             Topology file\n"
+        "  -f, --format [text|binary]      Topology file format\n"
+        "  -w, --workload FILE             Workload file\n"
+        "  --prune                         Prune the topology like NetBuilder.pruneTopology\n"
+        "  -l, --latency [none|hops]       Latency model: payments settle at once (none)\n"
+        "                                  or hold their capacity for a time derived\n"
+        "                                  from the link delays of their route (hops)\n"
+        "  --hop-messages FLOAT            hops model: link delays per hop and direction\n"
+        "  --commit-wait FLOAT             hops model: commitment wait per hop and direction\n"
+        "  --snapshot-in FILE              Start from the capacities of a channel snapshot\n"
+        "  --snapshot-out FILE             Write the final capacities as a channel snapshot\n"
+        "  -o, --output FILE               JSON report file\n"
+        "  --help                          Show this message and exit.\n";
+}
+
+int main(int argc, char **argv) {
+
+    Options options;
+    static struct option longOptions[] = {
+        {"topology", required_argument, 0, 't'},
+        {"format", required_argument, 0, 'f'},
+        {"workload", required_argument, 0, 'w'},
+        {"prune", no_argument, 0, 'P'},
+        {"latency", required_argument, 0, 'l'},
+        {"hop-messages", required_argument, 0, 'm'},
+        {"commit-wait", required_argument, 0, 'c'},
+        {"snapshot-in", required_argument, 0, 'i'},
+        {"snapshot-out", required_argument, 0, 'S'},
+        {"output", required_argument, 0, 'o'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:f:w:l:o:h", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 't': options.topologyFile = optarg; break;
+            case 'f': options.format = optarg; break;
+            case 'w': options.workloadFile = optarg; break;
+            case 'P': options.prune = true; break;
+            case 'l': options.latency = optarg; break;
+            case 'm': options.hopMessages = atof(optarg); break;
+            case 'c': options.commitWait = atof(optarg); break;
+            case 'i': options.snapshotIn = optarg; break;
+            case 'S': options.snapshotOut = optarg; break;
+            case 'o': options.output = optarg; break;
+            case 'h': printUsage(); return 0;
+            default: printUsage(); return 2;
+        }
+    }
+
+    try {
+        if (options.format != "text" && options.format != "binary")
+            throw std::invalid_argument("unknown format " + options.format);
+        if (options.latency != "none" && options.latency != "hops")
+            throw std::invalid_argument("unknown latency model " + options.latency);
+        if (options.hopMessages < 0 || options.commitWait < 0)
+            throw std::invalid_argument("invalid hop messages or commit wait");
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<TopologyEdge> edges = readEdges(options);
+        std::vector<FlowPayment> payments = readPayments(options);
+
+        // Same pruning as the NetBuilder: the workload component, without the payments outside it, and leaf parents
+        std::map<std::string, std::string> leafParents;
+        int droppedPayments = 0;
+        if (options.prune) {
+            std::set<int> workloadNodes;
+            for (const auto& payment : payments) {
+                workloadNodes.insert(payment.srcId);
+                workloadNodes.insert(payment.dstId);
+            }
+            PruningReport report;
+            edges = extractWorkloadComponent(edges, workloadNodes, report);
+            std::set<int> keptNodes;
+            for (const auto& edge : edges) {
+                keptNodes.insert(edge.srcId);
+                keptNodes.insert(edge.dstId);
+            }
+            std::vector<FlowPayment> keptPayments;
+            for (const auto& payment : payments) {
+                if (keptNodes.count(payment.srcId) && keptNodes.count(payment.dstId))
+                    keptPayments.push_back(payment);
+            }
+            droppedPayments = payments.size() - keptPayments.size();
+            payments.swap(keptPayments);
+            for (const auto& leaf : findLeafParents(edges))
+                leafParents[nodeName(leaf.first)] = nodeName(leaf.second);
+        }
+
+        FlowSimulator simulator(edges, leafParents, options);
+        if (!options.snapshotIn.empty())
+            simulator.loadSnapshot(options.snapshotIn);
+        simulator.run(payments);
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (!options.snapshotOut.empty())
+            simulator.getSnapshot().write(options.snapshotOut);
+
+        const FlowResults& results = simulator.getResults();
+        int numPayments = payments.size();
+        double successRate = numPayments > 0 ? double(results.completed) / numPayments : 0;
+        std::cout << "Simulated " << numPayments << " payments in " << wall << "s";
+        if (droppedPayments > 0)
+            std::cout << " (" << droppedPayments << " unroutable payments dropped)";
+        std::cout << "\n";
+        std::cout << "  completed/failed/canceled: " << results.completed << "/" << results.failed << "/" << results.canceled << "\n";
+        std::cout << "  success rate: " << successRate << "\n";
+        std::cout << "  balance drift: " << simulator.getBalanceDrift() << "\n";
+        if (options.latency == "hops")
+            std::cout << "  payment latency: mean " << results.latency.getMean() << ", p99 " << results.latency.getQuantile(0.99) << "\n";
+        if (!options.snapshotOut.empty())
+            std::cout << "Wrote final channel capacities to " << options.snapshotOut << "\n";
+
+        if (!options.output.empty()) {
+            std::ofstream report(options.output);
+            report << "{\n"
+                   << "  \"payments\": " << numPayments << ",\n"
+                   << "  \"droppedPayments\": " << droppedPayments << ",\n"
+                   << "  \"completedPayments\": " << results.completed << ",\n"
+                   << "  \"failedPayments\": " << results.failed << ",\n"
+                   << "  \"canceledPayments\": " << results.canceled << ",\n"
+                   << "  \"successRate\": " << successRate << ",\n"
+                   << "  \"volume\": " << results.volume << ",\n"
+                   << "  \"balanceDrift\": " << simulator.getBalanceDrift() << ",\n"
+                   << "  \"latencyModel\": \"" << options.latency << "\",\n"
+                   << "  \"paymentLatencyMean\": " << results.latency.getMean() << ",\n"
+                   << "  \"paymentLatencyP50\": " << results.latency.getQuantile(0.5) << ",\n"
+                   << "  \"paymentLatencyP99\": " << results.latency.getQuantile(0.99) << ",\n"
+                   << "  \"wallSeconds\": " << wall << "\n"
+                   << "}\n";
+            if (!report)
+                throw std::runtime_error("could not write report file " + options.output);
+            std::cout << "Report written to " << options.output << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
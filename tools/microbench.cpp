@@ -0,0 +1,251 @@
+/***********************************************************************************************************************/
+/* microbench: isolated benchmarks of the simulator's hot spots (routing, HTLC bookkeeping on a payment channel and   */
+/* the crypto helpers) on synthetic inputs. The simulator sources are compiled with PCN_STANDALONE, so nothing here   */
+/* needs the OMNeT++ kernel and every benchmark runs in a fraction of a second.                                       */
+/***********************************************************************************************************************/
+
+#include <getopt.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "routing.h"
+#include "crypto.h"
+#include "PaymentChannel.h"
+
+struct Options {
+    int nodes = 1000;
+    int m = 2;
+    int pending = 100;
+    int batch = 10;
+    double minTime = 0.5;
+    std::string filter;
+    unsigned long seed = 1;
+};
+
+// Results are accumulated here so the compiler cannot drop the benchmarked calls
+static volatile size_t sink = 0;
+
+struct Benchmark {
+    std::string name;
+    int size;
+    std::function<void()> run; // one operation
+};
+
+void measure(const Benchmark& benchmark, double minTime) {
+    // Doubles the iteration count until a round takes at least minTime seconds and reports that round
+
+    typedef std::chrono::steady_clock Clock;
+    long iterations = 1;
+    double elapsed = 0;
+    while (true) {
+        Clock::time_point start = Clock::now();
+        for (long i = 0; i < iterations; i++)
+            benchmark.run();
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (elapsed >= minTime || iterations >= (1L << 40))
+            break;
+        iterations *= 2;
+    }
+    printf("%-28s %10d %12ld %14.1f\n", benchmark.name.c_str(), benchmark.size, iterations, elapsed / iterations * 1e9);
+    fflush(stdout);
+}
+
+AdjacencyMap makeGraph(const Options& options, std::mt19937_64& rng) {
+    // Barabasi-Albert graph with both channel directions, named and weighted like the simulator's adjMatrix
+
+    std::uniform_real_distribution<double> capacity(1, 1000);
+    AdjacencyMap graph;
+    std::vector<int> targets; // every endpoint once per channel, for preferential attachment
+    auto addChannel = [&](int u, int v) {
+        std::string uName = "node" + std::to_string(u);
+        std::string vName = "node" + std::to_string(v);
+        graph[uName].push_back(std::make_pair(vName, std::vector<double>{capacity(rng), 0, 1}));
+        graph[vName].push_back(std::make_pair(uName, std::vector<double>{capacity(rng), 0, 1}));
+        targets.push_back(u);
+        targets.push_back(v);
+    };
+
+    for (int u = 1; u <= options.m; u++)
+        addChannel(0, u);
+    for (int u = options.m + 1; u < options.nodes; u++) {
+        std::vector<int> neighbors;
+        while ((int) neighbors.size() < options.m) {
+            int v = targets[std::uniform_int_distribution<size_t>(0, targets.size() - 1)(rng)];
+            if (std::find(neighbors.begin(), neighbors.end(), v) == neighbors.end())
+                neighbors.push_back(v);
+        }
+        for (int v : neighbors)
+            addChannel(u, v);
+    }
+    return graph;
+}
+
+std::vector<std::unique_ptr<HTLC> > makeHTLCs(int count, const std::string& prefix) {
+    // HTLCs cycle through add, fulfill and fail updates, with ids built like FullNode::createHTLCId
+
+    static const int types[] = { UPDATE_ADD_HTLC, UPDATE_FULFILL_HTLC, UPDATE_FAIL_HTLC };
+    std::vector<std::unique_ptr<HTLC> > HTLCs;
+    for (int i = 0; i < count; i++) {
+        std::unique_ptr<HTLC> htlc(new HTLC());
+        htlc->setType(types[i % 3]);
+        htlc->setPaymentHash(sha256(prefix + std::to_string(i)));
+        htlc->setHtlcId(htlc->getPaymentHash() + ":" + std::to_string(htlc->getType()));
+        htlc->setValue(0.01);
+        HTLCs.push_back(std::move(htlc));
+    }
+    return HTLCs;
+}
+
+void fillPending(PaymentChannel& channel, const std::vector<std::unique_ptr<HTLC> >& HTLCs) {
+    // Queues the HTLCs as pending on the me->neighbor channel, half of them sent by us
+    for (size_t i = 0; i < HTLCs.size(); i++) {
+        HTLC *htlc = HTLCs[i].get();
+        channel.setPendingHTLC(htlc->getHtlcId(), htlc);
+        channel.setLastPendingHTLCFIFO(htlc);
+        channel.setPreviousHopUp(htlc->getHtlcId(), i % 2 ? "me" : "neighbor");
+        channel.setPreviousHopDown(htlc->getHtlcId(), i % 2 ? "neighbor" : "me");
+    }
+}
+
+void printUsage() {
+    std::cout <<
+        "Usage: microbench [OPTIONS]\n"
+        "\n"
+        "  Runs microbenchmarks of routing, HTLC bookkeeping and crypto kernels and prints\n"
+        "  the time per operation\n"
+        "\n"
+        "Options:\n"
+        "  -n, --nodes INTEGER             Number of nodes of the routing graph\n"
+        "  -m INTEGER                      Channels per new node of the (Barabasi-Albert) routing graph\n"
+        "  -p, --pending INTEGER           Pending HTLCs on the benchmarked channel\n"
+        "  -b, --batch INTEGER             HTLCs per commitment in the pending/commit benchmark\n"
+        "  -t, --min_time FLOAT            Minimum measured time per benchmark, in seconds\n"
+        "  -f, --filter STRING             Only run benchmarks whose name contains STRING\n"
+        "  -s, --seed INTEGER              Random seed of the synthetic inputs\n"
+        "  --help                          Show this message and exit.\n";
+}
+
+int main(int argc, char **argv) {
+
+    Options options;
+    static struct option longOptions[] = {
+        {"nodes", required_argument, 0, 'n'},
+        {"pending", required_argument, 0, 'p'},
+        {"batch", required_argument, 0, 'b'},
+        {"min_time", required_argument, 0, 't'},
+        {"filter", required_argument, 0, 'f'},
+        {"seed", required_argument, 0, 's'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:m:p:b:t:f:s:h", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'n': options.nodes = atoi(optarg); break;
+            case 'm': options.m = atoi(optarg); break;
+            case 'p': options.pending = atoi(optarg); break;
+            case 'b': options.batch = atoi(optarg); break;
+            case 't': options.minTime = atof(optarg); break;
+            case 'f': options.filter = optarg; break;
+            case 's': options.seed = strtoul(optarg, NULL, 10); break;
+            case 'h': printUsage(); return 0;
+            default: printUsage(); return 2;
+        }
+    }
+
+    try {
+        if (options.m < 1 || options.nodes <= options.m || options.pending < 1 || options.batch < 1 || options.minTime <= 0)
+            throw std::invalid_argument("invalid graph size, HTLC count or minimum time");
+
+        std::mt19937_64 rng(options.seed);
+        std::vector<Benchmark> benchmarks;
+
+        // Routing: shortest paths between random node pairs
+        AdjacencyMap graph = makeGraph(options, rng);
+        std::vector<std::pair<std::string, std::string> > queries;
+        std::uniform_int_distribution<int> node(0, options.nodes - 1);
+        for (int i = 0; i < 64; i++)
+            queries.push_back(std::make_pair("node" + std::to_string(node(rng)), "node" + std::to_string(node(rng))));
+        size_t query = 0;
+        benchmarks.push_back({"dijkstraWeightedShortestPath", options.nodes, [&]() {
+            const auto& q = queries[query++ % queries.size()];
+            sink += dijkstraWeightedShortestPath(q.first, q.second, graph).size();
+        }});
+
+        // Channel queries over a standing pending queue
+        std::vector<std::unique_ptr<HTLC> > pendingHTLCs = makeHTLCs(options.pending, "pending");
+        PaymentChannel channel(1e9, 0, 1, 483, 0, 0, 0, nullptr, nullptr);
+        fillPending(channel, pendingHTLCs);
+        benchmarks.push_back({"hasCapacityToForward", options.pending, [&]() {
+            sink += channel.hasCapacityToForward("me", "neighbor", 1);
+        }});
+
+        std::vector<HTLC *> commitment;
+        for (const auto& htlc : pendingHTLCs)
+            commitment.push_back(htlc.get());
+        std::shuffle(commitment.begin(), commitment.end(), rng);
+        benchmarks.push_back({"getSortedPendingHTLCs", options.pending, [&]() {
+            sink += channel.getSortedPendingHTLCs(commitment).size();
+        }});
+
+        // A batch going through the same pending -> committed -> settled transitions FullNode applies
+        std::vector<std::unique_ptr<HTLC> > batchHTLCs = makeHTLCs(options.batch, "batch");
+        PaymentChannel batchChannel(1e9, 0, 1, 483, 0, 0, 0, nullptr, nullptr);
+        benchmarks.push_back({"pendingCommitTransitions", options.batch, [&]() {
+            fillPending(batchChannel, batchHTLCs);
+            std::vector<HTLC *> HTLCs;
+            for (const auto& htlc : batchChannel.getPendingHTLCsFIFO())
+                HTLCs.push_back(htlc);
+            batchChannel.setHTLCsWaitingForAck(0, HTLCs);
+            for (const auto& htlc : batchChannel.getSortedPendingHTLCs(HTLCs)) {
+                if (batchChannel.isCommittedHTLC(htlc))
+                    continue;
+                std::string htlcId = htlc->getHtlcId();
+                batchChannel.removePendingHTLC(htlcId);
+                batchChannel.removePendingHTLCFIFOByValue(htlc);
+                batchChannel.setCommittedHTLC(htlcId, htlc);
+                batchChannel.setLastCommittedHTLCFIFO(htlc);
+            }
+            batchChannel.removeHTLCsWaitingForAck(0);
+            for (const auto& htlc : batchHTLCs) {
+                std::string htlcId = htlc->getHtlcId();
+                batchChannel.removeCommittedHTLCFIFOByValue(htlc.get());
+                batchChannel.removeCommittedHTLC(htlcId);
+                batchChannel.removePendingHTLC(htlcId);
+                batchChannel.removePreviousHopUp(htlcId);
+                batchChannel.removePreviousHopDown(htlcId);
+            }
+            sink += batchChannel.getCommittedBatchSize();
+        }});
+
+        // Crypto helpers used for every invoice
+        std::string preImage = generatePreImage();
+        benchmarks.push_back({"sha256", PREIMAGE_SIZE, [&]() {
+            sink += sha256(preImage).size();
+        }});
+        benchmarks.push_back({"generatePreImage", PREIMAGE_SIZE, [&]() {
+            sink += generatePreImage().size();
+        }});
+
+        printf("%-28s %10s %12s %14s\n", "benchmark", "size", "iterations", "ns/op");
+        for (const auto& benchmark : benchmarks) {
+            if (benchmark.name.find(options.filter) != std::string::npos)
+                measure(benchmark, options.minTime);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,482 @@
+/***********************************************************************************************************************/
+/* partition: places the nodes of a topology on the partitions of a parallel run. Nodes are weighted by the events    */
+/* they are expected to handle (payments they send or receive plus the payments routed through them, estimated with   */
+/* the simulator's own routing), channels by the inverse of their link delay, which is the lookahead they give when   */
+/* cut. Partitions are grown around the highest-degree nodes and then refined to cut fewer channels within the load  */
+/* balance, and the assignment is written as partition-id lines for omnetpp.ini.                                     */
+/***********************************************************************************************************************/
+
+#include <getopt.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "topology.h"
+#include "routing.h"
+
+// Channels without a link delay give no lookahead, so they are kept within a partition whenever possible
+#define NO_DELAY_WEIGHT 1e9
+
+struct Options {
+    int partitions = 2;
+    std::string topologyFile = "../topologies/topology";
+    std::string format = "text";
+    std::string workloadFile = "../workloads/random-workload.txt";
+    std::string output = "partitions.ini";
+    int routes = 200;
+    int hubs = -1;
+    double imbalance = 0.05;
+    int passes = 10;
+    unsigned long seed = 1;
+};
+
+struct Graph {
+    std::vector<int> nodeIds; // dense index to node id
+    std::unordered_map<int, int> indexes; // node id to dense index
+    std::vector<std::vector<std::pair<int, double> > > neighbors; // (neighbor, weight of the channel directions between them)
+    std::vector<std::vector<std::pair<int, double> > > delays; // (neighbor, smallest link delay towards it)
+    std::vector<double> weights; // expected events per node
+};
+
+std::vector<TopologyEdge> readEdges(const Options& options) {
+    // Reads the text format like the NetBuilder does (only the binary reader is shared with the simulator)
+
+    if (options.format == "binary")
+        return readBinaryTopology(options.topologyFile);
+
+    std::ifstream topologyFile(options.topologyFile);
+    if (!topologyFile)
+        throw std::runtime_error("could not open topology file " + options.topologyFile);
+
+    std::vector<TopologyEdge> edges;
+    std::string line;
+    while (getline(topologyFile, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream tokens(line);
+        TopologyEdge edge;
+        if (!(tokens >> edge.srcId >> edge.dstId >> edge.capacity >> edge.fee >> edge.linkQuality >> edge.maxAcceptedHTLCs
+                >> edge.HTLCMinimumMsat >> edge.channelReserveSatoshis >> edge.linkDelay))
+            throw std::runtime_error("wrong line in topology file: 9 items required, line: \"" + line + "\"");
+        edges.push_back(edge);
+    }
+    return edges;
+}
+
+std::vector<std::pair<int, int> > readPayments(const Options& options) {
+
+    std::ifstream workloadFile(options.workloadFile);
+    if (!workloadFile)
+        throw std::runtime_error("could not open workload file " + options.workloadFile);
+
+    std::vector<std::pair<int, int> > payments;
+    std::string line;
+    while (getline(workloadFile, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream tokens(line);
+        int srcId, dstId;
+        if (!(tokens >> srcId >> dstId))
+            throw std::runtime_error("wrong line in workload file: \"" + line + "\"");
+        payments.push_back(std::make_pair(srcId, dstId));
+    }
+    return payments;
+}
+
+Graph buildGraph(const std::vector<TopologyEdge>& edges) {
+    // Merges both directions of a channel into one undirected, inverse-delay weighted edge
+
+    Graph graph;
+    std::map<std::pair<int, int>, std::pair<double, double> > channels; // (u, v) with u < v to (weight, smallest delay)
+    for (const auto& edge : edges) {
+        for (int nodeId : {edge.srcId, edge.dstId}) {
+            if (graph.indexes.find(nodeId) == graph.indexes.end()) {
+                graph.indexes[nodeId] = graph.nodeIds.size();
+                graph.nodeIds.push_back(nodeId);
+            }
+        }
+        if (edge.srcId == edge.dstId)
+            continue;
+        int u = graph.indexes[edge.srcId];
+        int v = graph.indexes[edge.dstId];
+        auto inserted = channels.insert(std::make_pair(std::make_pair(std::min(u, v), std::max(u, v)),
+                std::make_pair(0.0, std::numeric_limits<double>::infinity())));
+        std::pair<double, double>& channel = inserted.first->second;
+        channel.first += edge.linkDelay > 0 ? 1 / edge.linkDelay : NO_DELAY_WEIGHT;
+        channel.second = std::min(channel.second, edge.linkDelay);
+    }
+
+    graph.neighbors.resize(graph.nodeIds.size());
+    graph.delays.resize(graph.nodeIds.size());
+    graph.weights.assign(graph.nodeIds.size(), 1);
+    for (const auto& channel : channels) {
+        int u = channel.first.first;
+        int v = channel.first.second;
+        graph.neighbors[u].push_back(std::make_pair(v, channel.second.first));
+        graph.neighbors[v].push_back(std::make_pair(u, channel.second.first));
+        graph.delays[u].push_back(std::make_pair(v, channel.second.second));
+        graph.delays[v].push_back(std::make_pair(u, channel.second.second));
+    }
+    return graph;
+}
+
+void weighNodes(Graph& graph, const std::vector<TopologyEdge>& edges, const std::vector<std::pair<int, int> >& payments,
+        const Options& options, std::mt19937_64& rng) {
+    // Every node gets one unit, plus one per payment it sends or receives, plus one per payment routed through it.
+    // Routes are computed for a sample of the payments with the simulator's routing and scaled up to the whole workload.
+
+    for (const auto& payment : payments) {
+        for (int nodeId : {payment.first, payment.second}) {
+            auto it = graph.indexes.find(nodeId);
+            if (it != graph.indexes.end())
+                graph.weights[it->second]++;
+        }
+    }
+
+    size_t numRoutes = options.routes == 0 ? payments.size() : std::min(payments.size(), (size_t) options.routes);
+    if (numRoutes == 0)
+        return;
+
+    AdjacencyMap adjMatrix;
+    std::map<std::string, std::string> noLeafParents;
+    addRoutingEdges(edges, noLeafParents, adjMatrix);
+
+    std::vector<size_t> sample(payments.size());
+    for (size_t i = 0; i < sample.size(); i++)
+        sample[i] = i;
+    std::shuffle(sample.begin(), sample.end(), rng);
+    sample.resize(numRoutes);
+
+    double scale = double(payments.size()) / numRoutes;
+    for (size_t i : sample) {
+        std::vector<std::string> path = computeRoute("node" + std::to_string(payments[i].first), "node" + std::to_string(payments[i].second),
+                adjMatrix, noLeafParents);
+        for (size_t hop = 1; hop + 1 < path.size(); hop++)
+            graph.weights[graph.indexes[atoi(path[hop].c_str() + strlen("node"))]] += scale;
+    }
+}
+
+class Partitioner {
+
+    public:
+        Partitioner(const Graph& graph, const Options& options) : _graph(graph), _options(options) {
+            _numPartitions = options.partitions;
+            _parts.assign(graph.nodeIds.size(), -1);
+            _loads.assign(_numPartitions, 0);
+            _hubCounts.assign(_numPartitions, 0);
+            _isHub.assign(graph.nodeIds.size(), false);
+            double totalWeight = 0;
+            for (double weight : graph.weights)
+                totalWeight += weight;
+            _maxLoad = (1 + options.imbalance) * totalWeight / _numPartitions;
+        };
+
+        std::vector<int> run();
+
+    private:
+        void pickHubs();
+        void grow();
+        void assign(int node, int part);
+        bool fits(int node, int part) const;
+        void connectionWeights(int node, std::vector<double>& connections) const;
+        bool refine();
+
+        const Graph& _graph;
+        const Options& _options;
+        int _numPartitions;
+        double _maxLoad;
+        std::vector<int> _parts; // node to partition (-1 if not placed yet)
+        std::vector<double> _loads;
+        std::vector<bool> _isHub;
+        std::vector<int> _hubCounts;
+        int _maxHubsPerPartition = 0;
+};
+
+std::vector<int> Partitioner::run() {
+
+    pickHubs();
+    grow();
+    for (int pass = 0; pass < _options.passes; pass++) {
+        if (!refine())
+            break;
+    }
+    return _parts;
+}
+
+void Partitioner::pickHubs() {
+    // The highest-degree nodes are spread evenly: each partition grows around some of them and never holds more than
+    // its share, so a scale-free core does not end up in a single partition
+
+    int numNodes = _graph.nodeIds.size();
+    int numHubs = std::min(numNodes, _options.hubs >= 0 ? _options.hubs : 4 * _numPartitions);
+    std::vector<int> byDegree(numNodes);
+    for (int i = 0; i < numNodes; i++)
+        byDegree[i] = i;
+    std::stable_sort(byDegree.begin(), byDegree.end(),
+            [this](int a, int b) { return _graph.neighbors[a].size() > _graph.neighbors[b].size(); });
+
+    _maxHubsPerPartition = (numHubs + _numPartitions - 1) / _numPartitions;
+    for (int i = 0; i < numHubs; i++)
+        _isHub[byDegree[i]] = true;
+
+    // Hubs go round-robin, heaviest first, so the partitions start with similar loads
+    std::vector<int> hubs(byDegree.begin(), byDegree.begin() + numHubs);
+    std::stable_sort(hubs.begin(), hubs.end(), [this](int a, int b) { return _graph.weights[a] > _graph.weights[b]; });
+    for (int i = 0; i < numHubs; i++)
+        assign(hubs[i], i % _numPartitions);
+}
+
+void Partitioner::assign(int node, int part) {
+    _parts[node] = part;
+    _loads[part] += _graph.weights[node];
+    if (_isHub[node])
+        _hubCounts[part]++;
+}
+
+bool Partitioner::fits(int node, int part) const {
+    if (_isHub[node] && _hubCounts[part] >= _maxHubsPerPartition)
+        return false;
+    return _loads[part] + _graph.weights[node] <= _maxLoad || _loads[part] == 0;
+}
+
+void Partitioner::grow() {
+    // Partitions take turns, the least loaded first, claiming the unplaced node most strongly connected to them
+
+    typedef std::pair<double, int> Candidate; // (connection weight to the partition, node)
+    std::vector<std::priority_queue<Candidate> > frontiers(_numPartitions);
+    std::vector<std::unordered_map<int, double> > connections(_numPartitions);
+    auto expand = [&](int node) {
+        int part = _parts[node];
+        for (const auto& neighbor : _graph.neighbors[node]) {
+            if (_parts[neighbor.first] != -1)
+                continue;
+            double& connection = connections[part][neighbor.first];
+            connection += neighbor.second;
+            frontiers[part].push(std::make_pair(connection, neighbor.first));
+        }
+    };
+
+    for (size_t node = 0; node < _parts.size(); node++) {
+        if (_parts[node] != -1)
+            expand(node);
+    }
+
+    while (true) {
+        int part = -1;
+        for (int p = 0; p < _numPartitions; p++) {
+            if (!frontiers[p].empty() && (part == -1 || _loads[p] < _loads[part]))
+                part = p;
+        }
+        if (part == -1)
+            break;
+
+        int node = frontiers[part].top().second;
+        frontiers[part].pop();
+        if (_parts[node] != -1 || !fits(node, part))
+            continue;
+        assign(node, part);
+        expand(node);
+    }
+
+    // Nodes no partition could reach (or take) go to the least loaded partition that accepts them
+    for (size_t node = 0; node < _parts.size(); node++) {
+        if (_parts[node] != -1)
+            continue;
+        int best = -1;
+        for (int p = 0; p < _numPartitions; p++) {
+            if ((_isHub[node] && _hubCounts[p] >= _maxHubsPerPartition))
+                continue;
+            if (best == -1 || _loads[p] < _loads[best])
+                best = p;
+        }
+        assign(node, best == -1 ? 0 : best);
+    }
+}
+
+void Partitioner::connectionWeights(int node, std::vector<double>& connections) const {
+    std::fill(connections.begin(), connections.end(), 0);
+    for (const auto& neighbor : _graph.neighbors[node])
+        connections[_parts[neighbor.first]] += neighbor.second;
+}
+
+bool Partitioner::refine() {
+    // Moves nodes to the partition they are most connected to when that reduces the cut weight and keeps the balance,
+    // or keeps the cut weight and improves the balance. Returns whether any node moved.
+
+    std::vector<double> connections(_numPartitions);
+    bool moved = false;
+    for (size_t node = 0; node < _parts.size(); node++) {
+        int from = _parts[node];
+        connectionWeights(node, connections);
+
+        int best = from;
+        double bestGain = 0;
+        for (int to = 0; to < _numPartitions; to++) {
+            if (to == from || !fits(node, to) || _loads[to] + _graph.weights[node] > _maxLoad)
+                continue;
+            double gain = connections[to] - connections[from];
+            bool balances = gain == 0 && _loads[to] + _graph.weights[node] < _loads[from];
+            if (gain > bestGain || (best == from && balances)) {
+                best = to;
+                bestGain = gain;
+            }
+        }
+        if (best == from)
+            continue;
+
+        _loads[from] -= _graph.weights[node];
+        if (_isHub[node])
+            _hubCounts[from]--;
+        assign(node, best);
+        moved = true;
+    }
+    return moved;
+}
+
+void printUsage() {
+    std::cout <<
+        "Usage: partition [OPTIONS]\n"
+        "\n"
+        "  Assigns the nodes of a topology to the partitions of a parallel simulation\n"
+        "  and writes the partition-id lines for omnetpp.ini\n"
+        "\n"
+        "Options:\n"
+        "  -k, --partitions INTEGER        Number of partitions\n"
+        "  -t, --topology FILE             Topology file\n"
+        "  -f, --format [text|binary]      Topology file format\n"
+        "  -w, --workload FILE             Workload file (node weights)\n"
+        "  -o, --output FILE               Configuration file to write (- for stdout)\n"
+        "  -r, --routes INTEGER            Payments routed to estimate through-traffic\n"
+        "                                  (0 routes every payment)\n"
+        "  --hubs INTEGER                  Highest-degree nodes spread evenly over the\n"
+        "                                  partitions (default 4 per partition)\n"
+        "  --imbalance FLOAT               Allowed load above the average partition load\n"
+        "  --passes INTEGER                Maximum refinement passes\n"
+        "  -s, --seed INTEGER              Random seed of the route sample\n"
+        "  --help                          Show this message and exit.\n";
+}
+
+int main(int argc, char **argv) {
+
+    Options options;
+    static struct option longOptions[] = {
+        {"partitions", required_argument, 0, 'k'},
+        {"topology", required_argument, 0, 't'},
+        {"format", required_argument, 0, 'f'},
+        {"workload", required_argument, 0, 'w'},
+        {"output", required_argument, 0, 'o'},
+        {"routes", required_argument, 0, 'r'},
+        {"hubs", required_argument, 0, 'H'},
+        {"imbalance", required_argument, 0, 'i'},
+        {"passes", required_argument, 0, 'p'},
+        {"seed", required_argument, 0, 's'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "k:t:f:w:o:r:s:h", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'k': options.partitions = atoi(optarg); break;
+            case 't': options.topologyFile = optarg; break;
+            case 'f': options.format = optarg; break;
+            case 'w': options.workloadFile = optarg; break;
+            case 'o': options.output = optarg; break;
+            case 'r': options.routes = atoi(optarg); break;
+            case 'H': options.hubs = atoi(optarg); break;
+            case 'i': options.imbalance = atof(optarg); break;
+            case 'p': options.passes = atoi(optarg); break;
+            case 's': options.seed = strtoul(optarg, NULL, 10); break;
+            case 'h': printUsage(); return 0;
+            default: printUsage(); return 2;
+        }
+    }
+
+    try {
+        if (options.format != "text" && options.format != "binary")
+            throw std::invalid_argument("unknown format " + options.format);
+        if (options.partitions < 1 || options.routes < 0 || options.imbalance < 0 || options.passes < 0)
+            throw std::invalid_argument("invalid partition count, route sample, imbalance or pass count");
+
+        std::vector<TopologyEdge> edges = readEdges(options);
+        Graph graph = buildGraph(edges);
+        if (graph.nodeIds.empty())
+            throw std::runtime_error("the topology has no channels");
+
+        std::mt19937_64 rng(options.seed);
+        weighNodes(graph, edges, readPayments(options), options, rng);
+        std::vector<int> parts = Partitioner(graph, options).run();
+
+        // Cut, lookahead and balance of the result
+        int numCutChannels = 0;
+        double cutWeight = 0;
+        double lookahead = std::numeric_limits<double>::infinity();
+        std::vector<double> loads(options.partitions, 0);
+        std::vector<int> numNodes(options.partitions, 0);
+        double totalWeight = 0;
+        for (size_t node = 0; node < parts.size(); node++) {
+            loads[parts[node]] += graph.weights[node];
+            numNodes[parts[node]]++;
+            totalWeight += graph.weights[node];
+            for (size_t i = 0; i < graph.neighbors[node].size(); i++) {
+                int neighbor = graph.neighbors[node][i].first;
+                if (parts[neighbor] == parts[node])
+                    continue;
+                lookahead = std::min(lookahead, graph.delays[node][i].second);
+                if ((int) node < neighbor) {
+                    numCutChannels++;
+                    cutWeight += graph.neighbors[node][i].second;
+                }
+            }
+        }
+        double imbalance = *std::max_element(loads.begin(), loads.end()) / (totalWeight / options.partitions) - 1;
+
+        std::ofstream outputFile;
+        if (options.output != "-") {
+            outputFile.open(options.output);
+            if (!outputFile)
+                throw std::runtime_error("could not open output file " + options.output);
+        }
+        std::ostream& out = options.output == "-" ? std::cout : outputFile;
+        out << "# " << options.partitions << " partitions of " << options.topologyFile << " for " << options.workloadFile << "\n";
+        out << "# " << numCutChannels << " cut channels, load imbalance " << imbalance << "\n";
+        std::vector<size_t> order(parts.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&graph](size_t a, size_t b) { return graph.nodeIds[a] < graph.nodeIds[b]; });
+        for (size_t node : order)
+            out << "PCN.node" << graph.nodeIds[node] << ".partition-id = " << parts[node] << "\n";
+        out.flush();
+        if (!out)
+            throw std::runtime_error("could not write output file " + options.output);
+
+        std::ostream& log = options.output == "-" ? std::cerr : std::cout;
+        log << "Partitioned " << parts.size() << " nodes into " << options.partitions << " partitions\n";
+        for (int p = 0; p < options.partitions; p++)
+            log << "  partition " << p << ": " << numNodes[p] << " nodes, load " << loads[p] << "\n";
+        log << "Cut channels: " << numCutChannels << " (weight " << cutWeight << ")\n";
+        log << "Load imbalance: " << imbalance << "\n";
+        if (numCutChannels > 0)
+            log << "Lookahead (smallest cut link delay): " << lookahead << "\n";
+        if (options.output != "-")
+            log << "Wrote partition-id lines to " << options.output << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
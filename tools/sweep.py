@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Runs the replications of a configuration as parallel simulator processes that share one topology cache.
+
+The parsed topology and the routes of every workload payment are computed once, by a simulator run that only fills
+the cache (NetBuilder.cacheOnly), before any replication starts. Every replication then maps the same read-only
+cache file, so its pages are shared through the page cache instead of being rebuilt per process, and each worker only
+holds the mutable state of its own run (channels, HTLCs, statistics). Up to -j replications run at a time; each writes
+its results to RESULT_DIR/run<N>, and the per-run wall time, startup time and peak RSS are printed and optionally
+written to a JSON report.
+"""
+
+import argparse
+import concurrent.futures
+import json
+import os
+import sys
+import time
+
+from bench import SIMULATOR_DIR, read_scalars, run_command
+
+
+def parse_runs(runs):
+    """Expands a run filter such as '0..9' or '0,2,5..7' into a list of run numbers."""
+    numbers = []
+    for part in runs.split(','):
+        if '..' in part:
+            first, last = part.split('..')
+            numbers.extend(range(int(first), int(last) + 1))
+        elif part.strip():
+            numbers.append(int(part))
+    return numbers
+
+
+def simulator_command(args, run, result_dir):
+    return [
+        os.path.abspath(args.simulator), '-u', 'Cmdenv', '-n', '.', '-c', args.config, '-r', str(run),
+        '--cmdenv-express-mode=true', '--cmdenv-status-frequency=1000s', '--result-dir=' + result_dir,
+        '--**.netBuilder.cacheDirectory="%s"' % os.path.abspath(args.cache_dir),
+    ] + sum([['-f', ini_file] for ini_file in args.ini_files], []) + args.simulator_args
+
+
+def run_replication(args, run):
+    result_dir = os.path.join(os.path.abspath(args.result_dir), 'run%d' % run)
+    os.makedirs(result_dir, exist_ok=True)
+    _, wall, peak_rss = run_command(simulator_command(args, run, result_dir), cwd=SIMULATOR_DIR)
+    scalars = read_scalars(result_dir)
+    return {
+        'run': run,
+        'wallSeconds': wall,
+        'startupSeconds': scalars.get(('PCN.netBuilder', 'startupWallTime'), 0.0),
+        'topologyCacheHit': bool(scalars.get(('PCN.netBuilder', 'topologyCacheHit'), 0.0)),
+        'peakRssMB': peak_rss,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--simulator', default=os.path.join(SIMULATOR_DIR, 'wpcn-omnet'), help='simulator executable')
+    parser.add_argument('-f', dest='ini_files', action='append', help='ini file(s), relative to the simulator directory '
+                        '(pCN.ini by default)')
+    parser.add_argument('-c', '--config', default='General', help='configuration to run')
+    parser.add_argument('-r', '--runs', default='0', help="run numbers, e.g. '0..9' or '0,2,5..7'")
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help='replications running at a time')
+    parser.add_argument('--cache-dir', default='sweep-cache', help='topology cache directory shared by the replications')
+    parser.add_argument('--result-dir', default='sweep-results', help='results go to RESULT_DIR/run<N>')
+    parser.add_argument('-o', '--output', help='JSON report file')
+    parser.add_argument('simulator_args', nargs='*', help='extra simulator options (after --)')
+    args = parser.parse_args()
+    args.ini_files = args.ini_files or ['pCN.ini']
+
+    runs = parse_runs(args.runs)
+    if not runs:
+        parser.error('no runs selected')
+    os.makedirs(args.cache_dir, exist_ok=True)
+
+    # Fill the cache once. Replications whose topology or workload differs from the first run's (e.g. through
+    # iteration variables) miss it and store their own entry on the fly.
+    print('Filling topology cache in %s...' % args.cache_dir, flush=True)
+    warm_dir = os.path.join(os.path.abspath(args.result_dir), 'cache')
+    os.makedirs(warm_dir, exist_ok=True)
+    _, warm_wall, _ = run_command(simulator_command(args, runs[0], warm_dir) + ['--**.netBuilder.cacheOnly=true'],
+                                  cwd=SIMULATOR_DIR)
+    print('  done in %.2fs' % warm_wall, flush=True)
+
+    start = time.monotonic()
+    results = []
+    with concurrent.futures.ThreadPoolExecutor(max_workers=max(1, args.jobs)) as executor:
+        futures = [executor.submit(run_replication, args, run) for run in runs]
+        for future in concurrent.futures.as_completed(futures):
+            result = future.result()
+            results.append(result)
+            print('  run %(run)d: %(wallSeconds).2fs (startup %(startupSeconds).2fs, peak RSS %(peakRssMB).0f MB)' % result,
+                  flush=True)
+    sweep_wall = time.monotonic() - start
+
+    results.sort(key=lambda result: result['run'])
+    misses = [result['run'] for result in results if not result['topologyCacheHit']]
+    print('%d runs in %.2fs with %d jobs (%.2f runs/s)' % (len(results), sweep_wall, args.jobs, len(results) / sweep_wall))
+    if misses:
+        print('runs that missed the cache: ' + ' '.join(str(run) for run in misses))
+
+    if args.output:
+        with open(args.output, 'w') as report_file:
+            json.dump({'cacheSeconds': warm_wall, 'wallSeconds': sweep_wall, 'jobs': args.jobs, 'runs': results},
+                      report_file, indent=2)
+        print('Report written to ' + args.output)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
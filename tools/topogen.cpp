@@ -0,0 +1,448 @@
+/***********************************************************************************************************************/
+/* topogen: native topology generator. Mirrors the options of `generate_topology_workload.py genTopo` but streams      */
+/* edges straight to the simulator's text or binary topology format, so it scales to millions of channels.            */
+/***********************************************************************************************************************/
+
+#include <getopt.h>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "topology.h"
+
+// Same exchange rate used by scripts/datasets/channels_statistics.py
+#define BITCOIN_TO_EURO_EXCHANGE 43037.31
+
+struct Options {
+    std::string topology = "scale-free";
+    int nodes = 10;
+    double alpha = 0.5;
+    double beta = 0.00001;
+    double gamma = 0.49999;
+    int k = 2;
+    double p = 0.1;
+    int m = 2;
+    bool lightning = false;
+    std::string statsFile = "../scripts/datasets/channels2.txt";
+    std::string output = "../topologies/topology";
+    std::string format = "text";
+    unsigned long seed = std::random_device()();
+};
+
+/***********************************************************************************************************************/
+/* OUTPUT                                                                                                              */
+/***********************************************************************************************************************/
+
+class TopologyOutput {
+    public:
+        virtual ~TopologyOutput() {};
+        virtual void write(const TopologyEdge& edge) = 0;
+};
+
+class TextTopologyOutput : public TopologyOutput {
+    public:
+        TextTopologyOutput(const std::string& fileName);
+        virtual ~TextTopologyOutput() { fclose(_file); };
+        virtual void write(const TopologyEdge& edge) override;
+
+    private:
+        FILE *_file;
+};
+
+TextTopologyOutput::TextTopologyOutput(const std::string& fileName) {
+    _file = fopen(fileName.c_str(), "w");
+    if (!_file)
+        throw std::runtime_error("could not open topology file " + fileName);
+}
+
+void TextTopologyOutput::write(const TopologyEdge& edge) {
+    // Same column order that NetBuilder::readTopology expects. Numbers are formatted with to_chars (shortest
+    // round-trip representation, like Python's repr), which is several times faster than printf for doubles.
+    char line[256];
+    char *p = line;
+    auto append = [&](auto value, char separator) {
+        p = std::to_chars(p, line + sizeof(line) - 1, value).ptr;
+        *p++ = separator;
+    };
+    append(edge.srcId, ' ');
+    append(edge.dstId, ' ');
+    append(edge.capacity, ' ');
+    append(edge.fee, ' ');
+    append(edge.linkQuality, ' ');
+    append(edge.maxAcceptedHTLCs, ' ');
+    append(edge.HTLCMinimumMsat, ' ');
+    append(edge.channelReserveSatoshis, ' ');
+    append(edge.linkDelay, '\n');
+    fwrite(line, 1, p - line, _file);
+}
+
+class BinaryTopologyOutput : public TopologyOutput {
+    public:
+        BinaryTopologyOutput(const std::string& fileName) : _writer(fileName) {};
+        virtual void write(const TopologyEdge& edge) override { _writer.write(edge); };
+
+    private:
+        BinaryTopologyWriter _writer;
+};
+
+/***********************************************************************************************************************/
+/* CHANNEL ATTRIBUTES                                                                                                  */
+/***********************************************************************************************************************/
+
+class ChannelModel {
+    // Draws channel attributes either uniformly (as functions.py does by default) or from the empirical Lightning
+    // Network distributions in the channel statistics file (as functions.py does with --lightning)
+
+    public:
+        ChannelModel(const Options& options, std::mt19937_64& rng);
+        TopologyEdge makeEdge(int srcId, int dstId);
+
+    private:
+        std::mt19937_64& _rng;
+        bool _lightning;
+        std::vector<double> _capacities;
+        std::vector<double> _feesBase;
+        std::vector<double> _minHTLCs;
+
+        double sample(const std::vector<double>& values);
+};
+
+std::vector<double> loadChannelStats(const std::string& fileName, const std::string& stats) {
+    // Parses the same "key": "value" lines as get_channel_stats() in channels_statistics.py and converts them to euros
+    std::ifstream statsFile(fileName);
+    if (!statsFile)
+        throw std::runtime_error("could not open channel statistics file " + fileName);
+
+    std::vector<double> values;
+    std::string line;
+    while (getline(statsFile, line)) {
+        if (line.find(stats) == std::string::npos)
+            continue;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+
+        std::string value;
+        for (char c : line.substr(colon + 1)) {
+            if (c != ' ' && c != ',' && c != '"' && c != '\r')
+                value.push_back(c);
+        }
+        if (value.empty() || value == "null")
+            continue;
+        values.push_back(atof(value.c_str()) * 1e-8 * BITCOIN_TO_EURO_EXCHANGE);
+    }
+
+    if (values.empty())
+        throw std::runtime_error("no values for " + stats + " found in " + fileName);
+    return values;
+}
+
+ChannelModel::ChannelModel(const Options& options, std::mt19937_64& rng) : _rng(rng), _lightning(options.lightning) {
+    if (_lightning) {
+        _capacities = loadChannelStats(options.statsFile, "capacity");
+        _feesBase = loadChannelStats(options.statsFile, "fee_base_msat");
+        _minHTLCs = loadChannelStats(options.statsFile, "min_htlc");
+    }
+}
+
+double ChannelModel::sample(const std::vector<double>& values) {
+    // Samples with replacement, since large topologies have more channels than the dataset
+    std::uniform_int_distribution<size_t> index(0, values.size() - 1);
+    return values[index(_rng)];
+}
+
+TopologyEdge ChannelModel::makeEdge(int srcId, int dstId) {
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    TopologyEdge edge;
+    edge.srcId = srcId;
+    edge.dstId = dstId;
+    if (_lightning) {
+        edge.capacity = std::round(sample(_capacities));
+        edge.fee = sample(_feesBase);
+        edge.HTLCMinimumMsat = sample(_minHTLCs);
+    } else {
+        edge.capacity = std::uniform_real_distribution<double>(0, 10)(_rng);
+        edge.fee = std::uniform_real_distribution<double>(1e-5, 1e-4)(_rng);
+        edge.HTLCMinimumMsat = 0.1;
+    }
+    edge.linkQuality = unit(_rng);
+    edge.maxAcceptedHTLCs = 483;
+    edge.channelReserveSatoshis = 0.01;
+    edge.linkDelay = 100;
+    return edge;
+}
+
+/***********************************************************************************************************************/
+/* GRAPH MODELS                                                                                                        */
+/***********************************************************************************************************************/
+
+class ChannelSink {
+    // Receives undirected channels from the graph models, drops self loops and parallel channels, and writes both
+    // directions of every new channel as soon as it is generated
+
+    public:
+        ChannelSink(TopologyOutput& output, ChannelModel& model) : _output(output), _model(model) {};
+        void addChannel(int u, int v);
+        size_t getNumChannels() const { return _channels.size(); };
+
+    private:
+        TopologyOutput& _output;
+        ChannelModel& _model;
+        std::unordered_set<uint64_t> _channels;
+};
+
+void ChannelSink::addChannel(int u, int v) {
+    if (u == v)
+        return;
+
+    uint64_t key = (uint64_t(std::min(u, v)) << 32) | uint32_t(std::max(u, v));
+    if (!_channels.insert(key).second)
+        return;
+
+    _output.write(_model.makeEdge(u, v));
+    _output.write(_model.makeEdge(v, u));
+}
+
+void generateScaleFree(const Options& options, std::mt19937_64& rng, ChannelSink& sink) {
+    // Directed scale-free graph of Bollobás et al., following networkx.scale_free_graph (delta_in = 0.2, delta_out = 0)
+    const double deltaIn = 0.2;
+    const double deltaOut = 0;
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    if (std::fabs(options.alpha + options.beta + options.gamma - 1) > 1e-6)
+        throw std::invalid_argument("alpha + beta + gamma must be equal to 1");
+
+    // Sources and targets of every edge (so that a uniform pick is proportional to out/in degree)
+    std::vector<int> sources{0, 1, 2};
+    std::vector<int> targets{1, 2, 0};
+    int numNodes = 3;
+    for (size_t i = 0; i < sources.size(); i++)
+        sink.addChannel(sources[i], targets[i]);
+
+    auto chooseNode = [&](const std::vector<int>& candidates, double delta) {
+        if (delta > 0) {
+            double biasSum = numNodes * delta;
+            if (unit(rng) < biasSum / (biasSum + candidates.size()))
+                return int(std::uniform_int_distribution<int>(0, numNodes - 1)(rng));
+        }
+        return candidates[std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(rng)];
+    };
+
+    while (numNodes < options.nodes) {
+        double r = unit(rng);
+        int v, w;
+        if (r < options.alpha) {
+            v = numNodes++;
+            w = chooseNode(targets, deltaIn);
+        } else if (r < options.alpha + options.beta) {
+            v = chooseNode(sources, deltaOut);
+            w = chooseNode(targets, deltaIn);
+        } else {
+            v = chooseNode(sources, deltaOut);
+            w = numNodes++;
+        }
+        sources.push_back(v);
+        targets.push_back(w);
+        sink.addChannel(v, w);
+    }
+}
+
+void generateBarabasiAlbert(const Options& options, std::mt19937_64& rng, ChannelSink& sink) {
+    // Preferential attachment starting from a star with m + 1 nodes, following networkx.barabasi_albert_graph
+    if (options.m < 1 || options.m >= options.nodes)
+        throw std::invalid_argument("Barabasi-Albert network must have m >= 1 and m < n");
+
+    std::vector<int> repeatedNodes;
+    for (int i = 1; i <= options.m; i++) {
+        sink.addChannel(0, i);
+        repeatedNodes.push_back(0);
+        repeatedNodes.push_back(i);
+    }
+
+    std::vector<int> targets;
+    for (int source = options.m + 1; source < options.nodes; source++) {
+        targets.clear();
+        while (int(targets.size()) < options.m) {
+            int node = repeatedNodes[std::uniform_int_distribution<size_t>(0, repeatedNodes.size() - 1)(rng)];
+            if (std::find(targets.begin(), targets.end(), node) == targets.end())
+                targets.push_back(node);
+        }
+        for (int target : targets) {
+            sink.addChannel(source, target);
+            repeatedNodes.push_back(target);
+            repeatedNodes.push_back(source);
+        }
+    }
+}
+
+void generateWattsStrogatz(const Options& options, std::mt19937_64& rng, ChannelSink& sink) {
+    // Ring lattice with k nearest neighbors whose edges are rewired with probability p, following
+    // networkx.watts_strogatz_graph. Rewiring changes earlier edges, so the channels are only streamed out at the end.
+    int n = options.nodes;
+    int k = options.k;
+    if (k > n)
+        throw std::invalid_argument("k > n, choose smaller k or larger n");
+
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::uniform_int_distribution<int> anyNode(0, n - 1);
+    auto key = [](int u, int v) { return (uint64_t(std::min(u, v)) << 32) | uint32_t(std::max(u, v)); };
+
+    std::vector<std::pair<int, int> > edges;
+    std::unordered_set<uint64_t> edgeSet;
+    std::vector<int> degrees(n, 0);
+    for (int j = 1; j <= k / 2; j++) {
+        for (int u = 0; u < n; u++) {
+            int v = (u + j) % n;
+            if (u == v || !edgeSet.insert(key(u, v)).second)
+                continue;
+            edges.push_back(std::make_pair(u, v));
+            degrees[u]++;
+            degrees[v]++;
+        }
+    }
+
+    size_t edgeIndex = 0;
+    for (int j = 1; j <= k / 2; j++) {
+        for (int u = 0; u < n && edgeIndex < edges.size(); u++) {
+            if (edges[edgeIndex].first != u || edges[edgeIndex].second != (u + j) % n)
+                continue;
+            std::pair<int, int>& edge = edges[edgeIndex++];
+            if (unit(rng) >= options.p || degrees[u] >= n - 1)
+                continue;
+
+            int w = anyNode(rng);
+            while (w == u || edgeSet.count(key(u, w)))
+                w = anyNode(rng);
+
+            edgeSet.erase(key(edge.first, edge.second));
+            degrees[edge.second]--;
+            edge.second = w;
+            edgeSet.insert(key(u, w));
+            degrees[w]++;
+        }
+    }
+
+    for (const auto& edge : edges)
+        sink.addChannel(edge.first, edge.second);
+}
+
+/***********************************************************************************************************************/
+/* COMMAND LINE                                                                                                        */
+/***********************************************************************************************************************/
+
+void printUsage() {
+    std::cout <<
+        "Usage: topogen [OPTIONS]\n"
+        "\n"
+        "  Generates a topology for the simulation\n"
+        "\n"
+        "Options:\n"
+        "  -t, --topology [scale-free|barabasi-albert|watts-strogatz]\n"
+        "                                  Topology used in the simulation\n"
+        "  -n, --nodes INTEGER             Number of nodes in the topology\n"
+        "  --alpha FLOAT                   Alpha parameter for scale-free topology\n"
+        "  --beta FLOAT                    Beta parameter for scale-free topology\n"
+        "  --gamma FLOAT                   Gamma parameter for scale-free topology\n"
+        "  -k INTEGER                      K parameter for Watts-Strogatz graph\n"
+        "  -p FLOAT                        P parameter for Watts-Strogatz graph\n"
+        "  -m INTEGER                      M parameter for Barabasi-Albert graph\n"
+        "  --lightning                     Channel capacities are modeled following\n"
+        "                                  real-world lightning network channels\n"
+        "  --stats FILE                    Channel statistics used by --lightning\n"
+        "  -o, --output FILE               Topology file to write\n"
+        "  -f, --format [text|binary]      Topology file format\n"
+        "  -s, --seed INTEGER              Random seed (random if not given)\n"
+        "  --help                          Show this message and exit.\n";
+}
+
+int main(int argc, char **argv) {
+
+    Options options;
+    static struct option longOptions[] = {
+        {"topology", required_argument, 0, 't'},
+        {"nodes", required_argument, 0, 'n'},
+        {"alpha", required_argument, 0, 'a'},
+        {"beta", required_argument, 0, 'b'},
+        {"gamma", required_argument, 0, 'g'},
+        {"lightning", no_argument, 0, 'l'},
+        {"stats", required_argument, 0, 'S'},
+        {"output", required_argument, 0, 'o'},
+        {"format", required_argument, 0, 'f'},
+        {"seed", required_argument, 0, 's'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:n:k:p:m:o:f:s:h", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 't': options.topology = optarg; break;
+            case 'n': options.nodes = atoi(optarg); break;
+            case 'a': options.alpha = atof(optarg); break;
+            case 'b': options.beta = atof(optarg); break;
+            case 'g': options.gamma = atof(optarg); break;
+            case 'k': options.k = atoi(optarg); break;
+            case 'p': options.p = atof(optarg); break;
+            case 'm': options.m = atoi(optarg); break;
+            case 'l': options.lightning = true; break;
+            case 'S': options.statsFile = optarg; break;
+            case 'o': options.output = optarg; break;
+            case 'f': options.format = optarg; break;
+            case 's': options.seed = strtoul(optarg, NULL, 10); break;
+            case 'h': printUsage(); return 0;
+            default: printUsage(); return 2;
+        }
+    }
+
+    try {
+        if (options.topology != "scale-free" && options.topology != "barabasi-albert" && options.topology != "watts-strogatz")
+            throw std::invalid_argument("unknown topology " + options.topology);
+        if (options.format != "text" && options.format != "binary")
+            throw std::invalid_argument("unknown format " + options.format);
+
+        std::mt19937_64 rng(options.seed);
+        ChannelModel model(options, rng);
+
+        std::unique_ptr<TopologyOutput> output;
+        if (options.format == "text")
+            output.reset(new TextTopologyOutput(options.output));
+        else
+            output.reset(new BinaryTopologyOutput(options.output));
+        ChannelSink sink(*output, model);
+
+        std::cout << "Setting topology to " << options.topology << "\n";
+        std::cout << "Setting n to " << options.nodes << "\n";
+        std::cout << "Setting seed to " << options.seed << "\n";
+        if (options.topology == "scale-free") {
+            std::cout << "Setting alpha to " << options.alpha << "\n";
+            std::cout << "Setting beta to " << options.beta << "\n";
+            std::cout << "Setting gamma to " << options.gamma << "\n";
+            generateScaleFree(options, rng, sink);
+        } else if (options.topology == "watts-strogatz") {
+            std::cout << "Setting k to " << options.k << "\n";
+            std::cout << "Setting p to " << options.p << "\n";
+            generateWattsStrogatz(options, rng, sink);
+        } else {
+            std::cout << "Setting m to " << options.m << "\n";
+            generateBarabasiAlbert(options, rng, sink);
+        }
+
+        std::cout << "Wrote " << sink.getNumChannels() << " channels (" << 2 * sink.getNumChannels() << " channel directions) to " << options.output << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Reads the binary HTLC event traces written by the simulator (NetBuilder.traceFile).
+
+`trace.py summary FILE` counts the records per event. `trace.py payment FILE HASH` prints every transition of the
+payments whose hash starts with HASH, in time order, which shows the path the payment took and how long it spent at
+each hop. `trace.py csv FILE` converts the whole trace to CSV.
+"""
+
+import argparse
+import collections
+import gzip
+import struct
+import sys
+
+MAGIC = b'PCNTRACE'
+HEADER = struct.Struct('<8sII')
+RECORD = struct.Struct('<ddiihB5x32s')  # time, value, nodeId, neighborId, htlcType, event, paymentHash
+
+EVENTS = ['PENDING', 'WAITING_FOR_ACK', 'COMMITTED', 'REFUSED', 'FAILED', 'FULFILLED', 'CANCELED']
+HTLC_TYPES = {0: '-', 128: 'UPDATE_ADD_HTLC', 130: 'UPDATE_FULFILL_HTLC', 131: 'UPDATE_FAIL_HTLC'}
+
+
+def read_trace(file_name):
+    """Yields (time, value, nodeId, neighborId, htlcType, event, paymentHash) tuples."""
+    with gzip.open(file_name, 'rb') as trace_file:
+        magic, version, record_size = HEADER.unpack(trace_file.read(HEADER.size))
+        if magic != MAGIC or version != 1 or record_size != RECORD.size:
+            raise ValueError('%s is not a version 1 trace file' % file_name)
+        while True:
+            chunk = trace_file.read(RECORD.size * 4096)
+            if not chunk:
+                break
+            for record in RECORD.iter_unpack(chunk[:len(chunk) - len(chunk) % RECORD.size]):
+                yield record[:6] + (record[6].hex(),)
+
+
+def node_name(node_id):
+    return 'node%d' % node_id if node_id >= 0 else '-'
+
+
+def command_summary(args):
+    counts = collections.Counter()
+    payments = set()
+    for record in read_trace(args.file):
+        counts[record[5]] += 1
+        payments.add(record[6])
+    print('%d payments' % len(payments))
+    for event, name in enumerate(EVENTS):
+        print('  %-16s %12d' % (name, counts[event]))
+
+
+def command_payment(args):
+    prefix = args.hash.lower()
+    records = sorted((r for r in read_trace(args.file) if r[6].startswith(prefix)), key=lambda r: r[0])
+    if not records:
+        print('No payment with hash prefix ' + prefix)
+        return 1
+    for time, value, node_id, neighbor_id, htlc_type, event, payment_hash in records:
+        print('%14.6f  %-10s %-10s %-16s %-20s %10.6f  %s' % (time, node_name(node_id), node_name(neighbor_id),
+              EVENTS[event] if event < len(EVENTS) else event, HTLC_TYPES.get(htlc_type, htlc_type), value, payment_hash[:16]))
+    return 0
+
+
+def command_csv(args):
+    out = sys.stdout
+    out.write('time,node,neighbor,event,htlcType,value,paymentHash\n')
+    for time, value, node_id, neighbor_id, htlc_type, event, payment_hash in read_trace(args.file):
+        out.write('%r,%s,%s,%s,%s,%r,%s\n' % (time, node_name(node_id), node_name(neighbor_id),
+                  EVENTS[event] if event < len(EVENTS) else event, HTLC_TYPES.get(htlc_type, htlc_type), value, payment_hash))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    subparsers = parser.add_subparsers(dest='command')
+    subparsers.required = True
+
+    summary_parser = subparsers.add_parser('summary', help='count records per event')
+    summary_parser.add_argument('file')
+    summary_parser.set_defaults(func=command_summary)
+
+    payment_parser = subparsers.add_parser('payment', help='print the transitions of a payment')
+    payment_parser.add_argument('file')
+    payment_parser.add_argument('hash', help='payment hash or a prefix of it')
+    payment_parser.set_defaults(func=command_payment)
+
+    csv_parser = subparsers.add_parser('csv', help='convert the trace to CSV on stdout')
+    csv_parser.add_argument('file')
+    csv_parser.set_defaults(func=command_csv)
+
+    args = parser.parse_args()
+    return args.func(args) or 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,189 @@
+/***********************************************************************************************************************/
+/* workgen: native workload generator. Mirrors the uniform mode of `generate_topology_workload.py genWork` (random    */
+/* end-host pairs, uniform values, integer timestamps in [1, 5000]) but reads topologies in either of the simulator's */
+/* formats and is fully determined by its seed, so benchmarks can regenerate identical workloads.                     */
+/***********************************************************************************************************************/
+
+#include <getopt.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "topology.h"
+
+struct Options {
+    int payments = 1;
+    double minPayment = 0.1;
+    double maxPayment = 1;
+    bool anyNode = false;
+    int maxTime = 5000;
+    std::string topologyFile = "../topologies/topology";
+    std::string format = "text";
+    std::string output = "../workloads/random-workload.txt";
+    unsigned long seed = std::random_device()();
+};
+
+std::vector<std::pair<int, int> > readChannels(const Options& options) {
+    // Only the endpoints matter here, so the text format is read without going through the simulator's parser
+
+    std::vector<std::pair<int, int> > channels;
+    if (options.format == "binary") {
+        for (const auto& edge : readBinaryTopology(options.topologyFile))
+            channels.push_back(std::make_pair(edge.srcId, edge.dstId));
+        return channels;
+    }
+
+    std::ifstream topologyFile(options.topologyFile);
+    if (!topologyFile)
+        throw std::runtime_error("could not open topology file " + options.topologyFile);
+
+    std::string line;
+    while (getline(topologyFile, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream tokens(line);
+        int srcId, dstId;
+        if (!(tokens >> srcId >> dstId))
+            throw std::runtime_error("wrong line in topology file: \"" + line + "\"");
+        channels.push_back(std::make_pair(srcId, dstId));
+    }
+    return channels;
+}
+
+std::vector<int> getEndHosts(const std::vector<std::pair<int, int> >& channels, bool anyNode) {
+    // End hosts are the nodes with a single neighbor (as in genWork), in order of appearance
+
+    std::vector<int> nodes;
+    std::unordered_map<int, std::unordered_set<int> > neighbors;
+    for (const auto& channel : channels) {
+        for (int nodeId : {channel.first, channel.second}) {
+            if (neighbors.find(nodeId) == neighbors.end()) {
+                neighbors[nodeId];
+                nodes.push_back(nodeId);
+            }
+        }
+        if (channel.first != channel.second) {
+            neighbors[channel.first].insert(channel.second);
+            neighbors[channel.second].insert(channel.first);
+        }
+    }
+
+    if (anyNode)
+        return nodes;
+
+    std::vector<int> endHosts;
+    for (int nodeId : nodes) {
+        if (neighbors[nodeId].size() == 1)
+            endHosts.push_back(nodeId);
+    }
+    return endHosts;
+}
+
+void printUsage() {
+    std::cout <<
+        "Usage: workgen [OPTIONS]\n"
+        "\n"
+        "  Generates a payment workload for the simulation\n"
+        "\n"
+        "Options:\n"
+        "  --n_payments INTEGER            Number of payments in the network simulation\n"
+        "  --min_payment FLOAT             Minimum value of a payment in the network\n"
+        "  --max_payment FLOAT             Maximum value of a payment in the network\n"
+        "  --any_node                      Transactions are issued by any node in the\n"
+        "                                  network, not only end hosts\n"
+        "  --max_time INTEGER              Latest payment timestamp\n"
+        "  -t, --topology FILE             Topology file to draw the nodes from\n"
+        "  -f, --format [text|binary]      Topology file format\n"
+        "  -o, --output FILE               Workload file to write\n"
+        "  -s, --seed INTEGER              Random seed (random if not given)\n"
+        "  --help                          Show this message and exit.\n";
+}
+
+int main(int argc, char **argv) {
+
+    Options options;
+    static struct option longOptions[] = {
+        {"n_payments", required_argument, 0, 'n'},
+        {"min_payment", required_argument, 0, 'a'},
+        {"max_payment", required_argument, 0, 'b'},
+        {"any_node", no_argument, 0, 'A'},
+        {"max_time", required_argument, 0, 'T'},
+        {"topology", required_argument, 0, 't'},
+        {"format", required_argument, 0, 'f'},
+        {"output", required_argument, 0, 'o'},
+        {"seed", required_argument, 0, 's'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:t:f:o:s:h", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'n': options.payments = atoi(optarg); break;
+            case 'a': options.minPayment = atof(optarg); break;
+            case 'b': options.maxPayment = atof(optarg); break;
+            case 'A': options.anyNode = true; break;
+            case 'T': options.maxTime = atoi(optarg); break;
+            case 't': options.topologyFile = optarg; break;
+            case 'f': options.format = optarg; break;
+            case 'o': options.output = optarg; break;
+            case 's': options.seed = strtoul(optarg, NULL, 10); break;
+            case 'h': printUsage(); return 0;
+            default: printUsage(); return 2;
+        }
+    }
+
+    try {
+        if (options.format != "text" && options.format != "binary")
+            throw std::invalid_argument("unknown format " + options.format);
+        if (options.payments < 0 || options.maxTime < 1 || options.minPayment > options.maxPayment)
+            throw std::invalid_argument("invalid payment count, value range or time range");
+
+        std::vector<int> endHosts = getEndHosts(readChannels(options), options.anyNode);
+        if (endHosts.size() < 2)
+            throw std::runtime_error("the topology has fewer than two end hosts (see --any_node)");
+
+        std::mt19937_64 rng(options.seed);
+        std::uniform_int_distribution<size_t> hostDistribution(0, endHosts.size() - 1);
+        std::uniform_real_distribution<double> valueDistribution(options.minPayment, options.maxPayment);
+        std::uniform_int_distribution<int> timeDistribution(1, options.maxTime);
+
+        std::vector<std::tuple<int, int, int, double> > payments; // (timestamp, srcId, dstId, value)
+        payments.reserve(options.payments);
+        for (int i = 0; i < options.payments; i++) {
+            size_t src = hostDistribution(rng);
+            size_t dst = hostDistribution(rng);
+            while (dst == src)
+                dst = hostDistribution(rng);
+            double value = valueDistribution(rng);
+            payments.push_back(std::make_tuple(timeDistribution(rng), endHosts[src], endHosts[dst], value));
+        }
+        std::stable_sort(payments.begin(), payments.end(),
+                [](const std::tuple<int, int, int, double>& a, const std::tuple<int, int, int, double>& b) { return std::get<0>(a) < std::get<0>(b); });
+
+        FILE *workloadFile = fopen(options.output.c_str(), "w");
+        if (!workloadFile)
+            throw std::runtime_error("could not open workload file " + options.output);
+        for (const auto& payment : payments)
+            fprintf(workloadFile, "%d %d %.17g %d\n", std::get<1>(payment), std::get<2>(payment), std::get<3>(payment), std::get<0>(payment));
+        fclose(workloadFile);
+
+        std::cout << "Setting seed to " << options.seed << "\n";
+        std::cout << "Wrote " << payments.size() << " payments between " << endHosts.size() << " end hosts to " << options.output << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}